@@ -0,0 +1,51 @@
+#include "Sha256Test.h"
+#include "sha256.h"
+#include "test.h"
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <stdexcept>
+#include <iostream>
+
+void Sha256Test::run() const
+{
+    static const char abc[] =
+        "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad";
+    static const char abc2[] =
+        "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1";
+    std::string a(1000000, 'a');
+
+    test("", 1, "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+    test("abc", 1, abc);
+    test("abc", 3, abc);
+    test("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", 7, abc2);
+    test("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", 56, abc2);
+    test(a.c_str(), 1000, "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+    test(a.c_str(), 333, "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+}
+
+/* Hashes `data` in pieces of `chunk` bytes */
+
+void Sha256Test::test(const char *const data, const size_t chunk, const char *const digest) const
+{
+    struct sha256 ctx;
+    unsigned char md[SHA256_LEN];
+    char hex[2 * SHA256_LEN + 1];
+    size_t l = strlen(data);
+
+    sha256_init(&ctx);
+
+    for (size_t i = 0; i < l; i += chunk)
+        sha256_update(&ctx, data + i, l - i < chunk ? l - i : chunk);
+
+    sha256_final(&ctx, md);
+
+    for (int i = 0; i < SHA256_LEN; i++)
+        snprintf(hex + 2 * i, 3, "%02x", md[i]);
+
+    if (strcmp(hex, digest))
+    {
+        std::cerr << "Expected \"" << digest << "\" got \"" << hex << "\"" << std::endl;
+        FATAL_ERROR;
+    }
+}
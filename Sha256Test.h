@@ -0,0 +1,15 @@
+#ifndef SHA256_TEST_H
+#define SHA256_TEST_H
+
+#include <cstddef>
+
+class Sha256Test
+{
+public:
+    void run() const;
+
+private:
+    void test(const char *data, size_t chunk, const char *digest) const;
+};
+
+#endif // SHA256_TEST_H
@@ -0,0 +1,597 @@
+/*
+Copyright (c) 2016-2018, Carsten Kunze <carsten.kunze@arcor.de>
+
+Permission to use, copy, modify, and/or distribute this software for any
+purpose with or without fee is hereby granted, provided that the above
+copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+PERFORMANCE OF THIS SOFTWARE.
+*/
+
+/*
+ * Queue of file comparisons which are done after the directory is
+ * displayed.
+ *
+ * With option `fast_approx` build_diff_db() compares only samples of big
+ * files.  With option `background_compare` it does not compare files at
+ * all.  Such files are displayed with '?' and queued here.
+ *
+ * With `background_compare` a worker thread compares the queued files.
+ * Only the main thread uses curses and the diff DB.  It takes the
+ * results while waiting for input in cmpq_getch() and redraws the
+ * lines.  Without the thread the main thread compares the files in steps
+ * of CQ_STEP bytes each time no key had been typed.  Hence a big file
+ * doesn't block the input.
+ *
+ * The queue holds pointers into the current diff DB, hence it is dropped
+ * when the DB is freed or stored and rebuilt when a stored DB is
+ * restored.  The worker only uses the paths and the size which it takes
+ * from the queue entry.  A result for a dropped queue is ignored.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef HAVE_PTHREAD
+# include <pthread.h>
+#endif
+#include "compat.h"
+#include "main.h"
+#include "diff.h"
+#include "ui.h"
+#include "db.h"
+#include "fcmp.h"
+#include "digest.h"
+#include "cmpq.h"
+#include "watch.h"
+
+/* Bytes compared by the main thread between two getch() */
+#define CQ_STEP (1024 * 1024)
+/* No entry compared by the main thread */
+#define CQ_NONE ((size_t)-1)
+
+enum cmpq_state { CQ_QUEUED, CQ_BUSY, CQ_DONE };
+
+struct cmpq_ent {
+    struct filediff *f;
+    char *pth[2];
+    off_t siz;
+    enum cmpq_state state;
+    int res; /* cmp_file() return value */
+    /* Comparison in steps by the main thread */
+    int fd[2];
+    off_t off;
+};
+
+static void cmpq_next_step(bool);
+static int cmpq_step(struct cmpq_ent *);
+static void cmpq_step_close(struct cmpq_ent *);
+static void cmpq_fin(struct cmpq_ent *, int);
+static void cmpq_apply(void);
+static void cmpq_set(struct filediff *, int);
+#ifdef HAVE_PTHREAD
+static void *cmpq_worker(void *);
+static int cmpq_file(struct fcmp *, char *const pth[2], off_t);
+#endif
+
+bool fast_approx;
+bool bg_cmp;
+static struct cmpq_ent *cq_v;
+static size_t cq_num;
+static size_t cq_size;
+static size_t cq_next; /* Index of next result to apply */
+static size_t cq_wnext; /* Index of next entry to compare */
+static size_t cq_cur = CQ_NONE; /* Entry compared by cmpq_next_step() */
+#ifdef HAVE_PTHREAD
+static unsigned long cq_gen; /* Incremented by cmpq_clear() */
+static pthread_mutex_t cq_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cq_cond = PTHREAD_COND_INITIALIZER; /* to worker */
+static pthread_cond_t cq_done = PTHREAD_COND_INITIALIZER; /* to main */
+static bool cq_thread;
+# define CQ_LOCK() pthread_mutex_lock(&cq_mtx)
+# define CQ_UNLOCK() pthread_mutex_unlock(&cq_mtx)
+#else
+# define CQ_LOCK()
+# define CQ_UNLOCK()
+#endif
+
+void
+cmpq_add(struct filediff *f)
+{
+    struct cmpq_ent *e;
+
+    CQ_LOCK();
+
+    if (cq_num == cq_size) {
+        cq_size = cq_size ? 2 * cq_size : 64;
+        cq_v = realloc(cq_v, cq_size * sizeof(*cq_v));
+    }
+
+    e = &cq_v[cq_num++];
+    e->f = f;
+    e->pth[0] = strdup(syspth[0]);
+    e->pth[1] = strdup(syspth[1]);
+    e->siz = f->siz[0];
+    e->state = CQ_QUEUED;
+    e->fd[0] = -1;
+    e->fd[1] = -1;
+    e->off = 0;
+#ifdef HAVE_PTHREAD
+
+    if (bg_cmp) {
+        if (!cq_thread) {
+            pthread_t tid;
+
+            if (!pthread_create(&tid, NULL, cmpq_worker, NULL)) {
+                pthread_detach(tid);
+                cq_thread = TRUE;
+            }
+        }
+
+        pthread_cond_signal(&cq_cond);
+    }
+#endif
+    CQ_UNLOCK();
+}
+
+void
+cmpq_clear(void)
+{
+    size_t i;
+
+    CQ_LOCK();
+
+    for (i = cq_next; i < cq_num; i++) {
+        cmpq_step_close(&cq_v[i]);
+        free(cq_v[i].pth[0]);
+        free(cq_v[i].pth[1]);
+    }
+
+    cq_num = 0;
+    cq_next = 0;
+    cq_wnext = 0;
+    cq_cur = CQ_NONE;
+#ifdef HAVE_PTHREAD
+    cq_gen++;
+#endif
+    CQ_UNLOCK();
+}
+
+void
+cmpq_rescan(void)
+{
+    unsigned i;
+
+    cmpq_clear();
+
+    if (!db_list[0])
+        return;
+
+    for (i = 0; i < db_num[0]; i++) {
+        struct filediff *f = db_list[0][i];
+
+        if (f->diff != '?')
+            continue;
+
+        pthcat(syspth[0], pthlen[0], f->name);
+        pthcat(syspth[1], pthlen[1], f->name);
+        cmpq_add(f);
+    }
+
+    syspth[0][pthlen[0]] = 0;
+    syspth[1][pthlen[1]] = 0;
+}
+
+void
+cmpq_refine(struct filediff *f)
+{
+    struct cmpq_ent *e = NULL;
+    bool msg = FALSE;
+    size_t i;
+    int rv;
+
+    if (f->diff != '?')
+        return;
+
+    CQ_LOCK();
+
+    for (i = cq_next; i < cq_num; i++) {
+        if (cq_v[i].f == f) {
+            e = &cq_v[i];
+            break;
+        }
+    }
+
+    if (!e) {
+        CQ_UNLOCK();
+        return;
+    }
+#ifdef HAVE_PTHREAD
+
+    /* Wait for the worker.  After '%' `f` stays '?' and gets the result
+     * later by cmpq_apply(). */
+    while (i != cq_cur && cq_v[i].state == CQ_BUSY) {
+        struct timespec ts;
+        int c;
+
+        clock_gettime(CLOCK_REALTIME, &ts);
+
+        if ((ts.tv_nsec += 100000000) >= 1000000000) {
+            ts.tv_nsec -= 1000000000;
+            ts.tv_sec++;
+        }
+
+        if (pthread_cond_timedwait(&cq_done, &cq_mtx, &ts) != ETIMEDOUT)
+            continue;
+
+        CQ_UNLOCK();
+
+        if (!msg) {
+            mvwaddstr(wstat, 0, 0, "Type '%' to stop file compare");
+            wrefresh(wstat);
+            msg = TRUE;
+        }
+
+        nodelay(stdscr, TRUE);
+        c = getch();
+        nodelay(stdscr, FALSE);
+
+        if (c == '%')
+            return;
+
+        CQ_LOCK();
+    }
+
+    e = &cq_v[i];
+#endif
+
+    if (e->state == CQ_DONE) {
+        int res = e->res;
+
+        e->f = NULL;
+        CQ_UNLOCK();
+        cmpq_set(f, res);
+        return;
+    }
+
+    /* Taken by the main thread.  The worker skips it. */
+    e->state = CQ_BUSY;
+    CQ_UNLOCK();
+    nodelay(stdscr, TRUE);
+
+    while ((rv = cmpq_step(e)) == -1) {
+        if (!msg) {
+            mvwaddstr(wstat, 0, 0, "Type '%' to stop file compare");
+            wrefresh(wstat);
+            msg = TRUE;
+        }
+
+        if (getch() == '%')
+            break;
+    }
+
+    nodelay(stdscr, FALSE);
+
+    if (rv != -1) {
+        if (i == cq_cur)
+            cq_cur = CQ_NONE;
+
+        cmpq_fin(e, rv);
+        return;
+    }
+
+    /* Stopped: `f` stays '?' and is compared again later */
+    cmpq_step_close(e);
+    CQ_LOCK();
+
+    if (i == cq_cur)
+        cq_cur = CQ_NONE;
+
+    e->state = CQ_QUEUED;
+
+    if (cq_wnext > i)
+        cq_wnext = i;
+#ifdef HAVE_PTHREAD
+    pthread_cond_signal(&cq_cond);
+#endif
+    CQ_UNLOCK();
+}
+
+int
+cmpq_getch(void)
+{
+    int c;
+
+    while (1) {
+        bool bg;
+
+        CQ_LOCK();
+
+        if (cq_next == cq_num) {
+            CQ_UNLOCK();
+            break;
+        }
+#ifdef HAVE_PTHREAD
+        bg = cq_thread;
+#else
+        bg = FALSE;
+#endif
+        CQ_UNLOCK();
+
+        /* With the worker wait some time for input, else compare as soon
+         * as no key is typed */
+        timeout(bg ? 100 : 0);
+        c = getch();
+        timeout(-1);
+
+        if (c == ERR)
+            cmpq_next_step(bg);
+
+        cmpq_apply();
+
+        if (c != ERR)
+            return c;
+    }
+
+    return watch_getch();
+}
+
+/* Does the next step of the comparison of the main thread.  A new entry
+ * is only taken if there is no worker (`!bg`). */
+
+static void
+cmpq_next_step(bool bg)
+{
+    struct cmpq_ent *e;
+    int rv;
+
+    CQ_LOCK();
+
+    if (cq_cur == CQ_NONE) {
+        /* cq_wnext may already point to an entry compared by
+         * cmpq_refine() */
+        while (cq_wnext < cq_num && cq_v[cq_wnext].state != CQ_QUEUED)
+            cq_wnext++;
+
+        if (bg || cq_wnext == cq_num) {
+            CQ_UNLOCK();
+            return;
+        }
+
+        cq_cur = cq_wnext++;
+        cq_v[cq_cur].state = CQ_BUSY;
+    }
+
+    e = &cq_v[cq_cur];
+    CQ_UNLOCK();
+
+    if ((rv = cmpq_step(e)) != -1) {
+        cq_cur = CQ_NONE;
+        cmpq_fin(e, rv);
+    }
+}
+
+/* Compares the next CQ_STEP bytes of `e` in the main thread.  The files
+ * are opened at the first step and closed at the last one.
+ * Return value: -1 not done yet, else as for cmp_file() */
+
+static int
+cmpq_step(struct cmpq_ent *e)
+{
+    off_t end;
+    int rv = 2;
+    int i;
+
+    if (e->fd[0] == -1) {
+        for (i = 0; i < 2; i++) {
+            if ((e->fd[i] = open(e->pth[i], O_RDONLY)) == -1)
+                goto close;
+        }
+
+        if ((rv = digest_cached(e->fd)) != -1)
+            goto close;
+    }
+
+    end = e->siz - e->off > CQ_STEP ? e->off + CQ_STEP : e->siz;
+
+    while (e->off < end) {
+        const size_t l = end - e->off < BUF_SIZE ? (size_t)(end - e->off) :
+                                                   BUF_SIZE;
+        ssize_t n[2];
+
+        n[0] = pread(e->fd[0], lbuf, l, e->off);
+        n[1] = pread(e->fd[1], rbuf, l, e->off);
+
+        if (n[0] == -1 || n[1] == -1) {
+            rv = 2;
+            goto close;
+        }
+
+        /* A file which got shorter differs too */
+        if (n[0] != (ssize_t)l || n[1] != (ssize_t)l ||
+            memcmp(lbuf, rbuf, l))
+        {
+            rv = 1;
+            goto close;
+        }
+
+        e->off += (off_t)l;
+    }
+
+    if (e->off < e->siz)
+        return -1;
+
+    rv = 0;
+close:
+    cmpq_step_close(e);
+    return rv;
+}
+
+static void
+cmpq_step_close(struct cmpq_ent *e)
+{
+    int i;
+
+    for (i = 0; i < 2; i++) {
+        if (e->fd[i] != -1) {
+            close(e->fd[i]);
+            e->fd[i] = -1;
+        }
+    }
+
+    e->off = 0;
+}
+
+/* Sets the result of a comparison of the main thread */
+
+static void
+cmpq_fin(struct cmpq_ent *e, int rv)
+{
+    if (e->f)
+        cmpq_set(e->f, rv);
+
+    CQ_LOCK();
+    e->f = NULL;
+    e->state = CQ_DONE;
+#ifdef HAVE_PTHREAD
+    pthread_cond_broadcast(&cq_done);
+#endif
+    CQ_UNLOCK();
+}
+
+/* Sets the results of finished comparisons and removes them from the
+ * queue. */
+
+static void
+cmpq_apply(void)
+{
+    CQ_LOCK();
+
+    while (cq_next < cq_num && cq_v[cq_next].state == CQ_DONE) {
+        struct cmpq_ent *e = &cq_v[cq_next++];
+
+        free(e->pth[0]);
+        free(e->pth[1]);
+
+        if (e->f) {
+            /* Unlocked since the worker doesn't use `f` */
+            CQ_UNLOCK();
+            cmpq_set(e->f, e->res);
+            CQ_LOCK();
+        }
+    }
+
+    if (cq_next == cq_num) {
+        cq_num = 0;
+        cq_next = 0;
+        cq_wnext = 0;
+    }
+
+    CQ_UNLOCK();
+}
+
+static void
+cmpq_set(struct filediff *f, int res)
+{
+    switch (res) {
+    case 0:
+        f->diff = ' ';
+        break;
+    case 1:
+        f->diff = '!';
+        break;
+    default:
+        f->diff = '-';
+    }
+
+    disp_fdiff(f);
+}
+
+#ifdef HAVE_PTHREAD
+static void *
+cmpq_worker(void *arg)
+{
+    struct fcmp cmp;
+    char *sbuf[2];
+
+    (void)arg;
+    memset(&cmp, 0, sizeof cmp);
+    sbuf[0] = malloc(BUF_SIZE);
+    sbuf[1] = malloc(BUF_SIZE);
+    cmp.sbuf[0] = sbuf[0];
+    cmp.sbuf[1] = sbuf[1];
+    CQ_LOCK();
+
+    while (1) {
+        char *pth[2];
+        off_t siz;
+        unsigned long gen;
+        size_t i;
+        int res;
+
+        while (cq_wnext < cq_num && cq_v[cq_wnext].state != CQ_QUEUED)
+            cq_wnext++;
+
+        if (cq_wnext == cq_num) {
+            pthread_cond_wait(&cq_cond, &cq_mtx);
+            continue;
+        }
+
+        i = cq_wnext++;
+        cq_v[i].state = CQ_BUSY;
+        /* Copies since the main thread frees them in cmpq_clear() */
+        pth[0] = strdup(cq_v[i].pth[0]);
+        pth[1] = strdup(cq_v[i].pth[1]);
+        siz = cq_v[i].siz;
+        gen = cq_gen;
+        CQ_UNLOCK();
+
+        res = cmpq_file(&cmp, pth, siz);
+        free(pth[0]);
+        free(pth[1]);
+
+        CQ_LOCK();
+
+        if (gen == cq_gen) {
+            cq_v[i].res = res;
+            cq_v[i].state = CQ_DONE;
+            pthread_cond_broadcast(&cq_done);
+        }
+    }
+
+    return NULL;
+}
+
+/* cmp_file() without dialogs */
+
+static int
+cmpq_file(struct fcmp *cmp, char *const pth[2], off_t siz)
+{
+    int fd[2];
+    int rv = 2;
+    int i;
+
+    if ((fd[0] = open(pth[0], O_RDONLY)) == -1)
+        return 2;
+
+    if ((fd[1] = open(pth[1], O_RDONLY)) == -1)
+        goto close;
+
+    if ((rv = digest_cmp(cmp, fd, &i)) == -1)
+        rv = fcmp_run(cmp, fd, siz, NULL, &i);
+
+    close(fd[1]);
+close:
+    close(fd[0]);
+    return rv;
+}
+#endif
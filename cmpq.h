@@ -0,0 +1,35 @@
+#ifndef CMPQ_H
+#define CMPQ_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "compat.h"
+
+struct filediff;
+
+/* RC option "fast_approx" */
+extern bool fast_approx;
+/* RC option "background_compare" */
+extern bool bg_cmp;
+
+/* Queues the file pair `syspth[0]`, `syspth[1]` of `f` for a full
+ * comparison. `f->diff` is '?' until then. */
+void cmpq_add(struct filediff *f);
+/* Drops the queue.  To be called when the diff DB is freed or stored. */
+void cmpq_clear(void);
+/* Queues all '?' entries of the current diff DB. */
+void cmpq_rescan(void);
+/* Compares `f` now if it is queued or waits for the worker.  Key '%'
+ * stops the comparison or the wait, `f->diff` is still '?' then. */
+void cmpq_refine(struct filediff *f);
+/* getch() which does queued comparisons or takes the results of the
+ * worker thread while no key is typed. */
+int cmpq_getch(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CMPQ_H */
@@ -0,0 +1,94 @@
+#include <stdexcept>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "compat.h"
+#include "cmpq_test.h"
+#include "main.h"
+#include "test.h"
+#include "diff.h"
+#include "tc.h"
+#include "cmpq.h"
+
+// Writes `siz` bytes of value `c` to `path`, the last one is `last`
+
+static void writeFile(const std::string &path, const size_t siz,
+                      const char c, const char last)
+{
+    const int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    if (fd == -1)
+        FATAL_ERROR;
+
+    std::vector<char> buf(siz, c);
+    buf[siz - 1] = last;
+    const ssize_t n = write(fd, buf.data(), siz);
+    close(fd);
+
+    if (n != (ssize_t)siz)
+        FATAL_ERROR;
+}
+
+void CmpqTest::run() const
+{
+    fprintf(debug, "->cmpq_test\n");
+
+    if (mkdir(left, 0777) || mkdir(right, 0777))
+        FATAL_ERROR;
+
+    queuedCompare(false);
+    queuedCompare(true);
+    fprintf(debug, "<-cmpq_test\n");
+}
+
+// Files queued with '?' get their result by cmpq_getch().  Without the
+// worker the main thread compares them in steps.
+
+void CmpqTest::queuedCompare(const bool worker) const
+{
+    fprintf(debug, "->queuedCompare(%d)\n", worker ? 1 : 0);
+
+    // Bigger than a step of the main thread
+
+    const size_t siz = 3 * 1024 * 1024 + 10;
+    const char *const names[] { "Equal", "Different", "Missing" };
+    const char results[] { ' ', '!', '-' };
+    filediff f[3];
+
+    writeFile(std::string(left) + "/Equal", siz, 'a', 'a');
+    writeFile(std::string(right) + "/Equal", siz, 'a', 'a');
+    writeFile(std::string(left) + "/Different", siz, 'a', 'a');
+    writeFile(std::string(right) + "/Different", siz, 'a', 'b');
+    writeFile(std::string(left) + "/Missing", siz, 'a', 'a');
+
+    fmode = FALSE;
+    bmode = FALSE;
+    bg_cmp = worker;
+
+    for (int i = 0; i < 3; ++i) {
+        memset(&f[i], 0, sizeof f[i]);
+        f[i].name = names[i];
+        f[i].siz[0] = (off_t)siz;
+        f[i].siz[1] = (off_t)siz;
+        f[i].diff = '?';
+        snprintf(syspth[0], sizeof syspth[0], "%s/%s", left, names[i]);
+        snprintf(syspth[1], sizeof syspth[1], "%s/%s", right, names[i]);
+        cmpq_add(&f[i]);
+    }
+
+    // Returns after the queue is empty, since no key can be typed
+
+    cmpq_getch();
+    bg_cmp = FALSE;
+
+    for (int i = 0; i < 3; ++i) {
+        if (f[i].diff != results[i])
+            FATAL_ERROR;
+    }
+
+    fprintf(debug, "<-queuedCompare\n");
+}
@@ -0,0 +1,16 @@
+#ifndef CMPQ_TEST_H
+#define CMPQ_TEST_H
+
+class CmpqTest
+{
+public:
+    void run() const;
+
+private:
+    void queuedCompare(const bool worker) const;
+
+    const char *const left { TEST_DIR "/Queue left" };
+    const char *const right { TEST_DIR "/Queue right" };
+};
+
+#endif // CMPQ_TEST_H
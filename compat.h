@@ -0,0 +1,19 @@
+#ifndef _XOPEN_SOURCE_EXTENDED
+# define _XOPEN_SOURCE_EXTENDED
+#endif
+
+#if defined(HAVE_NCURSESW_CURSES_H)
+# include <ncursesw/curses.h>
+#elif defined(HAVE_NCURSES_CURSES_H)
+# include <ncurses/curses.h>
+#else
+# include <curses.h>
+
+# ifndef false
+#  define false 0
+# endif
+
+# ifndef true
+#  define true 1
+# endif
+#endif
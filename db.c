@@ -41,14 +41,113 @@ PERFORMANCE OF THIS SOFTWARE.
 #include "tc.h"
 #include "dl.h"
 #include "misc.h"
+#include "cmpq.h"
+
+/* Hash index of names for the diff DB and name_db.  Linear probing, the
+ * table is at most half full.  `key` returns the name of an item. */
+struct name_ix {
+	void **tab;
+	size_t size; /* power of 2 or 0 */
+	size_t num;
+	const char *(*key)(const void *);
+};
+
+/* Memory block of a diff DB or the scan DB.  The data follows the
+ * header. */
+struct mem_blk {
+	struct mem_blk *next;
+	size_t used, size;
+};
+
+union mem_align {
+	void *p;
+	long l;
+	off_t o;
+	double d;
+};
+
+#define MEM_ALIGN sizeof(union mem_align)
+#define MEM_HDR ((sizeof(struct mem_blk) + MEM_ALIGN - 1) & ~(MEM_ALIGN - 1))
+#define MEM_MIN 4096
+#define MEM_MAX (256 * 1024)
+
+/* The entries in the order they were added or, after diff_db_sort(), in
+ * sort order.  No tree nodes are allocated, `ix` is used for lookup.
+ * The entries, names and link targets are allocated in `mem` and are
+ * freed all at once. */
+struct diff_db {
+	struct filediff **ent;
+	size_t num, size;
+	struct name_ix ix;
+	struct mem_blk *mem;
+	bool sorted;
+};
+
+/* Node of the scan DB, one for each path component of the directories
+ * with differences or statistics and their parent directories.  The
+ * root node is "/".
+ * Nodes are not freed before the whole scan DB. */
+struct scan_node {
+	struct scan_node *parent;
+	/* Number of directories with differences in the tree */
+	unsigned long ndiff;
+	/* The directory itself contains differences */
+	bool diff;
+	/* Sum of the statistics of the tree (option disp_dirstats) or
+	 * NULL */
+	struct dir_stat *st;
+	char name[];
+};
+
+/* The child nodes are found by (parent, name) in a hash table of all
+ * nodes.  Linear probing, the table is at most half full. */
+struct scan_trie {
+	struct scan_node **tab;
+	size_t size; /* power of 2 or 0 */
+	size_t num;
+	struct scan_node *root;
+	struct mem_blk *mem;
+};
+
+/* Sort key of a diff DB entry */
+struct sort_key {
+	struct filediff *f;
+	const char *name;
+	/* Extension, owner, group or link target */
+	const char *s;
+	/* Modification time or size */
+	long long n;
+	long ns;
+	unsigned cls;
+};
 
 static void db_dl_free(char **);
+static void set_sort_key(struct sort_key *, struct filediff *);
+static int key_name_cmp(const struct sort_key *, const struct sort_key *);
+static int key_cmp(const void *, const void *);
+static int key_num_cmp(const void *, const void *);
+static int key_str_cmp(const void *, const void *);
+static void sort_ents(struct diff_db *);
+static void mk_list(struct diff_db *);
+static const char *diff_key(const void *);
+static const char *str_key(const void *);
+static size_t ix_hash(const char *);
+static void *ix_srch(struct name_ix *, const char *);
+static void *ix_add(struct name_ix *, void *);
+static void ix_del(struct name_ix *, const char *);
+static void ix_grow(struct name_ix *);
+static struct diff_db *diff_db_get(int);
+static void *mem_get(struct mem_blk **, size_t, size_t);
+static void mem_free(struct mem_blk *);
+static void sn_init(void);
+static struct scan_node *sn_walk(const char *, bool);
+static struct scan_node *sn_find(struct scan_node *, const char *, size_t,
+    bool);
+static size_t sn_hash(const struct scan_node *, const char *, size_t);
+static void sn_grow(void);
 #ifdef HAVE_LIBAVLBST
-static int diff_cmp(union bst_val, union bst_val);
 static int ddl_cmp(union bst_val, union bst_val);
 static int bdl_cmp(union bst_val, union bst_val);
-static void mk_list(struct bst_node *);
-static void diff_db_delete(struct bst_node *);
 static void del_strs(struct bst_node *);
 static void mk_ddl(struct bst_node *);
 static void mk_bdl(struct bst_node *);
@@ -60,14 +159,12 @@ struct curs_pos {
 };
 
 static int name_cmp(const void *, const void *);
-static int diff_cmp(const void *, const void *);
 static int curs_cmp(const void *, const void *);
 static int ext_cmp(const void *, const void *);
 static int uz_cmp(const void *, const void *);
 static int ptr_db_cmp(const void *, const void *);
 static int ddl_cmp(const void *, const void *);
 static int bdl_cmp(const void *, const void *);
-static void mk_list(const void *, const VISIT, const int);
 static void mk_ddl(const void *, const VISIT, const int);
 static void mk_bdl(const void *, const VISIT, const int);
 static void mk_str_list(const void *, const VISIT, const int);
@@ -84,8 +181,6 @@ static unsigned long maxmajor, maxminor;
 unsigned short bsizlen[2];
 unsigned short majorlen[2], minorlen[2];
 short noequal, real_diff;
-void *scan_db;
-void *name_db;
 void *skipext_db;
 void *uz_path_db;
 static void *alias_db;
@@ -95,17 +190,22 @@ bool nohidden; /* in db.c because it must be possible to toggle with ',' */
 static void *curs_db[2];
 static void *ext_db;
 static void *uz_ext_db;
-static unsigned db_idx, tot_db_num[2];
+static unsigned db_idx;
 static char **str_list;
+/* Realpaths of the directories which contain differences.  NULL if
+ * empty. */
+static struct scan_trie *scan_db;
 static struct scan_db *scan_db_list;
+/* Use: UI dir diff: Every file found on left side is put into name_db
+ * to check if it is found on right side too or if there are supernumerary
+ * files in right side. */
+static struct name_ix name_db = { NULL, 0, 0, str_key };
 
+static struct diff_db *diff_db[2];
 #ifdef HAVE_LIBAVLBST
-static struct bst diff_db[2] = { { NULL, diff_cmp },
-                                 { NULL, diff_cmp } };
 static struct bst ddl_db = { NULL, ddl_cmp };
 static struct bst bdl_db = { NULL, bdl_cmp };
 #else
-static void *diff_db[2];
 static void *ddl_db;
 static void *bdl_db;
 #endif
@@ -114,8 +214,6 @@ static void *bdl_db;
 void
 db_init(void)
 {
-	scan_db    = db_new(name_cmp);
-	name_db    = db_new(name_cmp);
 	curs_db[0] = db_new(name_cmp);
 	curs_db[1] = db_new(name_cmp);
 	ext_db     = db_new(name_cmp);
@@ -452,9 +550,6 @@ push_scan_db(bool os)
 
 	if (os) {
 		one_scan = TRUE;
-#ifdef HAVE_LIBAVLBST
-		scan_db = db_new(name_cmp);
-#endif
 	}
 }
 
@@ -467,9 +562,6 @@ pop_scan_db(void)
 	fprintf(debug, "<>pop_scan_db()\n");
 #endif
 	free_scan_db(FALSE);
-#ifdef HAVE_LIBAVLBST
-	free(scan_db);
-#endif
 
 	if (!(p = scan_db_list)) {
 		return;
@@ -483,23 +575,240 @@ pop_scan_db(void)
 void
 free_scan_db(bool os)
 {
-#ifdef HAVE_LIBAVLBST
-	struct bst_node *n;
-#else
-	char *n;
-#endif
-
 #if defined(TRACE)
 	fprintf(debug, "<>free_scan_db(%d)\n", os ? 1 : 0);
 #endif
 
-	while ((n = str_db_get_node(scan_db))) {
-		str_db_del(&scan_db, n);
+	if (scan_db) {
+		mem_free(scan_db->mem);
+		free(scan_db->tab);
+		free(scan_db);
+		scan_db = NULL;
 	}
 
 	one_scan = os;
 }
 
+void
+scan_db_add(const char *path)
+{
+	struct scan_node *n;
+
+	if (!scan_db)
+		sn_init();
+
+	n = sn_walk(path, TRUE);
+
+	if (n->diff)
+		return;
+
+	n->diff = TRUE;
+
+	for (; n; n = n->parent)
+		n->ndiff++;
+}
+
+void
+scan_db_stat(const char *path, const struct dir_stat *st)
+{
+	struct scan_node *n;
+	int i;
+
+	if (!scan_db)
+		sn_init();
+
+	for (n = sn_walk(path, TRUE); n; n = n->parent) {
+		if (!n->st) {
+			n->st = mem_get(&scan_db->mem, sizeof(struct dir_stat),
+			    MEM_ALIGN);
+			memset(n->st, 0, sizeof(struct dir_stat));
+		}
+
+		for (i = 0; i < 2; i++) {
+			n->st->only[i] += st->only[i];
+		}
+
+		n->st->diff += st->diff;
+		n->st->equal += st->equal;
+		n->st->dsiz += st->dsiz;
+	}
+}
+
+const struct dir_stat *
+scan_db_get_stat(const char *path)
+{
+	struct scan_node *n;
+
+	return (n = sn_walk(path, FALSE)) ? n->st : NULL;
+}
+
+bool
+scan_db_srch(const char *path)
+{
+	struct scan_node *n;
+
+	return (n = sn_walk(path, FALSE)) && n->ndiff;
+}
+
+unsigned long
+scan_db_cnt(const char *path)
+{
+	struct scan_node *n;
+
+	return (n = sn_walk(path, FALSE)) ? n->ndiff : 0;
+}
+
+void
+scan_db_del(const char *path)
+{
+	struct scan_node *n, *p, *q;
+	unsigned long k;
+	size_t i;
+
+	if (!(n = sn_walk(path, FALSE)) || !(k = n->ndiff))
+		return;
+
+	/* Not counted for the parent directories anymore */
+	for (p = n->parent; p; p = p->parent)
+		p->ndiff -= k;
+
+	/* Clear the tree `n`.  Nodes have no links to their children, but
+	 * this is rarely done. */
+	for (i = 0; i < scan_db->size; i++) {
+		if (!(p = scan_db->tab[i]) || !p->ndiff)
+			continue;
+
+		for (q = p->parent; q && q != n; q = q->parent);
+
+		if (q) {
+			p->ndiff = 0;
+			p->diff = FALSE;
+		}
+	}
+
+	n->ndiff = 0;
+	n->diff = FALSE;
+}
+
+static void
+sn_init(void)
+{
+	scan_db = calloc(1, sizeof(struct scan_trie));
+	scan_db->root = mem_get(&scan_db->mem, sizeof(struct scan_node) + 1,
+	    MEM_ALIGN);
+	memset(scan_db->root, 0, sizeof(struct scan_node) + 1);
+}
+
+/* Returns the node of `path` or NULL.  `add`: Missing nodes are
+ * added. */
+
+static struct scan_node *
+sn_walk(const char *path, bool add)
+{
+	struct scan_node *n;
+	const char *s;
+
+	if (!scan_db)
+		return NULL;
+
+	n = scan_db->root;
+
+	while (1) {
+		while (*path == '/')
+			path++;
+
+		if (!*path)
+			return n;
+
+		for (s = path; *s && *s != '/'; s++);
+
+		if (!(n = sn_find(n, path, s - path, add)))
+			return NULL;
+
+		path = s;
+	}
+}
+
+static struct scan_node *
+sn_find(struct scan_node *parent, const char *name, size_t l, bool add)
+{
+	struct scan_node *n;
+	size_t m, k;
+
+	if (add && 2 * (scan_db->num + 1) > scan_db->size)
+		sn_grow();
+
+	if (!scan_db->size)
+		return NULL;
+
+	m = scan_db->size - 1;
+
+	for (k = sn_hash(parent, name, l) & m; (n = scan_db->tab[k]);
+	    k = (k + 1) & m)
+	{
+		if (n->parent == parent && !memcmp(n->name, name, l) &&
+		    !n->name[l])
+		{
+			return n;
+		}
+	}
+
+	if (!add)
+		return NULL;
+
+	n = mem_get(&scan_db->mem, sizeof(struct scan_node) + l + 1,
+	    MEM_ALIGN);
+	n->parent = parent;
+	n->ndiff = 0;
+	n->diff = FALSE;
+	n->st = NULL;
+	memcpy(n->name, name, l);
+	n->name[l] = 0;
+	scan_db->tab[k] = n;
+	scan_db->num++;
+	return n;
+}
+
+/* FNV-1a of the name, seeded with the parent node */
+
+static size_t
+sn_hash(const struct scan_node *parent, const char *name, size_t l)
+{
+	size_t h = 2166136261U ^ ((size_t)parent / MEM_ALIGN);
+
+	while (l--) {
+		h ^= (unsigned char)*name++;
+		h *= 16777619U;
+	}
+
+	return h;
+}
+
+static void
+sn_grow(void)
+{
+	struct scan_node **tab = scan_db->tab;
+	size_t size = scan_db->size;
+	struct scan_node *n;
+	size_t m, k, j;
+
+	scan_db->size = size ? 2 * size : 64;
+	scan_db->tab = calloc(scan_db->size, sizeof(struct scan_node *));
+	m = scan_db->size - 1;
+
+	for (j = 0; j < size; j++) {
+		if (!(n = tab[j]))
+			continue;
+
+		for (k = sn_hash(n->parent, n->name, strlen(n->name)) & m;
+		    scan_db->tab[k]; k = (k + 1) & m);
+
+		scan_db->tab[k] = n;
+	}
+
+	free(tab);
+}
+
 /****************
  * unzip ext DB *
  ****************/
@@ -891,33 +1200,26 @@ curs_cmp(const void *a, const void *b)
 void
 diff_db_store(struct ui_state *st)
 {
-#ifdef HAVE_LIBAVLBST
-	st->bst = diff_db->root;
-	diff_db->root = NULL;
-#else
-	st->bst = *diff_db;
+	st->db = *diff_db;
 	*diff_db = NULL;
-#endif
 	st->num = *db_num;
 	*db_num = 0;
 	st->list = *db_list;
 	*db_list = NULL;
 	st->mmrkd = *mmrkd;
 	*mmrkd = 0;
+	cmpq_clear();
 }
 
 void
 diff_db_restore(struct ui_state *st)
 {
 	diff_db_free(0);
-#ifdef HAVE_LIBAVLBST
-	diff_db->root = st->bst;
-#else
-	*diff_db = st->bst;
-#endif
+	*diff_db = st->db;
 	*db_num = st->num;
 	*db_list = st->list;
 	*mmrkd = st->mmrkd;
+	cmpq_rescan();
 }
 
 void
@@ -930,20 +1232,21 @@ diff_db_sort(int i)
 	tusrlen = 0;
 	tgrplen = 0;
 
-	if (!tot_db_num[i]) {
+	if (!diff_db[i] || !diff_db[i]->num) {
 		goto exit;
 	}
 
+	if (!diff_db[i]->sorted) {
+		sort_ents(diff_db[i]);
+		diff_db[i]->sorted = TRUE;
+	}
+
 	if (!db_list[i]) {
-		db_list[i] = malloc(tot_db_num[i] * sizeof(struct filediff *));
+		db_list[i] = malloc(diff_db[i]->num * sizeof(struct filediff *));
 	}
 
 	cur_list = db_list[i];
-#ifdef HAVE_LIBAVLBST
-	mk_list(diff_db[i].root);
-#else
-	twalk(diff_db[i], mk_list);
-#endif
+	mk_list(diff_db[i]);
 exit:
 	db_num[i] = db_idx;
 	usrlen[i] = tusrlen + 1; /* column separator */
@@ -989,14 +1292,15 @@ exit:
         && \
 	    (bmode || fmode || \
 	     ((!noequal || \
-	       f->diff == '!' || \
+	       f->diff == '!' || f->diff == '?' || \
 	       (S_ISDIR(f->type[0]) && (!recursive || is_diff_dir(f))) || \
 	       (f->type[0] & S_IFMT) != (f->type[1] & S_IFMT)) \
 	      && \
           (!hide_diff_files || f->diff == ' ') \
           && \
 	      (!real_diff || \
-	       f->diff == '!' || (S_ISDIR(f->type[0]) && S_ISDIR(f->type[1]) \
+	       f->diff == '!' || f->diff == '?' || \
+	       (S_ISDIR(f->type[0]) && S_ISDIR(f->type[1]) \
 	       && (!recursive || is_diff_dir(f)))) \
 	      && \
 	      (!nosingle || \
@@ -1049,11 +1353,7 @@ exit:
 		\
 		if (add_owner) { \
 			if (f->type[0]) { \
-				if (!(pw = getpwuid(f->uid[0]))) { \
-					l = 5; \
-				} else { \
-					l = strlen(pw->pw_name); \
-				} \
+				l = strlen(uid_name(f->uid[0])); \
 				\
 				if (l > tusrlen) { \
 					tusrlen = l; \
@@ -1061,11 +1361,7 @@ exit:
 			} \
 			\
 			if (f->type[1]) { \
-				if (!(pw = getpwuid(f->uid[1]))) { \
-					l = 5; \
-				} else { \
-					l = strlen(pw->pw_name); \
-				} \
+				l = strlen(uid_name(f->uid[1])); \
 				\
 				if (l > tusrlen) { \
 					tusrlen = l; \
@@ -1075,11 +1371,7 @@ exit:
 		\
 		if (add_group) { \
 			if (f->type[0]) { \
-				if (!(gr = getgrgid(f->gid[0]))) { \
-					l = 5; \
-				} else { \
-					l = strlen(gr->gr_name); \
-				} \
+				l = strlen(gid_name(f->gid[0])); \
 				\
 				if (l > tgrplen) { \
 					tgrplen = l; \
@@ -1087,11 +1379,7 @@ exit:
 			} \
 			\
 			if (f->type[1]) { \
-				if (!(gr = getgrgid(f->gid[1]))) { \
-					l = 5; \
-				} else { \
-					l = strlen(gr->gr_name); \
-				} \
+				l = strlen(gid_name(f->gid[1])); \
 				\
 				if (l > tgrplen) { \
 					tgrplen = l; \
@@ -1101,213 +1389,231 @@ exit:
 	} \
 	} while (0)
 
-#ifdef HAVE_LIBAVLBST
 static void
-mk_list(struct bst_node *n)
+mk_list(struct diff_db *d)
 {
 	struct filediff *f;
-	struct passwd *pw;
-	struct group *gr;
-	size_t l;
+	size_t l, k;
 
-	if (!n) {
-		return;
+	for (k = 0; k < d->num; k++) {
+		f = d->ent[k];
+		PROC_DIFF_NODE();
 	}
-
-	mk_list(n->left);
-	f = n->key.p;
-	PROC_DIFF_NODE();
-	mk_list(n->right);
 }
-#else
+
+#define IS_F_DIR(f) \
+    /* both are dirs */ \
+    ((S_ISDIR(f->type[0]) && S_ISDIR(f->type[1])) || \
+    /* only left dir present */ \
+     (S_ISDIR(f->type[0]) && !f->type[1]) || \
+    /* only right dir present */ \
+     (S_ISDIR(f->type[1]) && !f->type[0]))
+
+/* Sets the sort key of `f` for the current sort mode.
+ * cls: 0 for "..", else 2 or 3 for entries which are sorted before or
+ *      after the other entries (directories, entries without link) */
+
 static void
-mk_list(const void *n, const VISIT which, const int depth)
+set_sort_key(struct sort_key *k, struct filediff *f)
 {
-	struct filediff *f;
-	struct passwd *pw;
-	struct group *gr;
-	size_t l;
+	const int i = f->type[0] ? 0 : 1;
 
-	(void)depth;
+	k->f = f;
+	k->name = f->name;
+	k->s = NULL;
+	k->n = 0;
+	k->ns = 0;
+	k->cls = 2;
 
-	switch (which) {
-	case postorder:
-	case leaf:
-		f = *(struct filediff * const *)n;
-		PROC_DIFF_NODE();
+	if (str_eq_dotdot(f->name)) {
+		k->cls = 0;
+		return;
+	}
+
+	switch (sorting) {
+	case SORTMTIME:
+		k->n = f->mtime[i];
+		k->ns = f->mtime_ns[i];
+		break;
+	case SORTSIZE:
+		k->cls += !IS_F_DIR(f);
+		k->n = FD_SIZ(f, i);
+		break;
+	case SORT_OWNER:
+		k->s = uid_name(f->uid[i]);
+		break;
+	case SORT_GROUP:
+		k->s = gid_name(f->gid[i]);
+		break;
+	case SORT_SYMLINK:
+		k->s = f->link[i];
+		k->cls += !k->s;
+		break;
+	case SORT_EXTENSION:
+		k->s = get_filename_extension(f->name);
+		/* fall through */
+	case DIRSFIRST:
+		k->cls += !IS_F_DIR(f);
+		break;
+	case FILESFIRST:
+		k->cls += IS_F_DIR(f);
 		break;
 	default:
 		;
 	}
 }
-#endif
 
-#define IS_F_DIR(n) \
-    /* both are dirs */ \
-    (S_ISDIR(f##n->type[0]) && S_ISDIR(f##n->type[1])) || \
-    /* only left dir present */ \
-    (S_ISDIR(f##n->type[0]) && !f##n->type[1]) || \
-    /* only right dir present */ \
-    (S_ISDIR(f##n->type[1]) && !f##n->type[0])
+static int
+key_name_cmp(const struct sort_key *k1, const struct sort_key *k2)
+{
+	int i;
+
+	if (sortic && (i = strcasecmp(k1->name, k2->name))) {
+		return i;
+	}
+
+	return strcmp(k1->name, k2->name);
+}
+
+/* Comparators for qsort(3), one for each type of sort key */
 
 static int
-diff_cmp(
-#ifdef HAVE_LIBAVLBST
-    union bst_val a, union bst_val b
-#else
-    const void *a, const void *b
-#endif
-    )
+key_cmp(const void *a, const void *b)
 {
-	const struct filediff
-#ifdef HAVE_LIBAVLBST
-	    *f1 = a.p,
-	    *f2 = b.p;
-#else
-	    *f1 = a,
-	    *f2 = b;
-#endif
-	const char *name1 = f1->name;
-	const char *name2 = f2->name;
-	const bool dotdot2 = str_eq_dotdot(name2);
-
-	if (str_eq_dotdot(name1)) {
-		if (dotdot2) {
-			return 0;
-		} else {
-			return -1;
-		}
-	} else if (dotdot2) {
-		return 1;
-	} else if (sorting == SORTMTIME) {
-        struct timespec t1, t2;
-
-		t1 = f1->type[0] ? f1->mtim[0] : f1->mtim[1];
-		t2 = f2->type[0] ? f2->mtim[0] : f2->mtim[1];
-
-        const int i = cmp_timespec(t1, t2);
-        if (i)
-            return i;
-	} else if (sorting == SORTSIZE) {
-		off_t t1, t2;
-		short f1_dir = IS_F_DIR(1),
-		      f2_dir = IS_F_DIR(2);
-		short dirsort = f1_dir && !f2_dir ? -1 :
-		                f2_dir && !f1_dir ?  1 : 0;
-
-		if (dirsort)
-			return dirsort;
-
-		t1 = f1->type[0] ? f1->siz[0] : f1->siz[1];
-		t2 = f2->type[0] ? f2->siz[0] : f2->siz[1];
-
-		if      (t1 < t2) return -1;
-		else if (t1 > t2) return  1;
-
-    } else if (sorting == SORT_OWNER) {
-        uid_t uid1 = f1->type[0] ? f1->uid[0] : f1->uid[1];
-        uid_t uid2 = f2->type[0] ? f2->uid[0] : f2->uid[1];
-        get_uid_name(uid1, lbuf, sizeof lbuf);
-        get_uid_name(uid2, rbuf, sizeof rbuf);
-        const int i = strcmp(lbuf, rbuf);
-        if (i)
-            return i;
-    } else if (sorting == SORT_GROUP) {
-        gid_t gid1 = f1->type[0] ? f1->gid[0] : f1->gid[1];
-        gid_t gid2 = f2->type[0] ? f2->gid[0] : f2->gid[1];
-        get_gid_name(gid1, lbuf, sizeof lbuf);
-        get_gid_name(gid2, rbuf, sizeof rbuf);
-        const int i = strcmp(lbuf, rbuf);
-        if (i)
-            return i;
-    }
-    else if (sorting == SORT_SYMLINK)
-    {
-        const char *const lnk1 = f1->type[0] ? f1->link[0] : f1->link[1];
-        const char *const lnk2 = f2->type[0] ? f2->link[0] : f2->link[1];
-        if (lnk1 && lnk2) {
-            const int i = strcmp(lnk1, lnk2);
-            if (i)
-                return i;
-        } else if (lnk1)
-            return -1;
-        else if (lnk2)
-            return 1;
-    }
-    else if (sorting != SORTMIXED)
-    {
-		short f1_dir = IS_F_DIR(1),
-		      f2_dir = IS_F_DIR(2);
-		short dirsort = f1_dir && !f2_dir ? -1 :
-		                f2_dir && !f1_dir ?  1 : 0;
-        if (dirsort)
-        {
-            if (sorting == DIRSFIRST // TODO: better refactor to "!DIRSLAST" to simplify this condition
-                    || sorting == SORT_EXTENSION)
-            {
-				return  dirsort;
-            }
-			else
-            {
-				return -dirsort;
-            }
-		}
-        if (sorting == SORT_EXTENSION)
-        {
-            const int i = strcmp(get_filename_extension(name1), get_filename_extension(name2));
-            if (i)
-            {
-                return i;
-            }
-        }
-    }
-    int i;
-    if (sortic && (i = strcasecmp(name1, name2)))
-    {
-        return i;
-    }
-    else
-    {
-		return strcmp(name1, name2);
+	const struct sort_key *k1 = a, *k2 = b;
+
+	if (k1->cls != k2->cls) {
+		return k1->cls < k2->cls ? -1 : 1;
+	}
+
+	return key_name_cmp(k1, k2);
+}
+
+static int
+key_num_cmp(const void *a, const void *b)
+{
+	const struct sort_key *k1 = a, *k2 = b;
+
+	if (k1->cls != k2->cls) {
+		return k1->cls < k2->cls ? -1 : 1;
+	} else if (k1->n != k2->n) {
+		return k1->n < k2->n ? -1 : 1;
+	} else if (k1->ns != k2->ns) {
+		return k1->ns < k2->ns ? -1 : 1;
+	}
+
+	return key_name_cmp(k1, k2);
+}
+
+static int
+key_str_cmp(const void *a, const void *b)
+{
+	const struct sort_key *k1 = a, *k2 = b;
+	int i;
+
+	if (k1->cls != k2->cls) {
+		return k1->cls < k2->cls ? -1 : 1;
+	} else if (k1->s && k2->s && (i = strcmp(k1->s, k2->s))) {
+		return i;
 	}
+
+	return key_name_cmp(k1, k2);
+}
+
+/* The sort keys are built once for all entries, then sorted with a
+ * comparator for the type of the keys */
+
+static void
+sort_ents(struct diff_db *d)
+{
+	int (*cmp)(const void *, const void *);
+	struct sort_key *keys;
+	size_t k;
+
+	switch (sorting) {
+	case SORTMTIME:
+	case SORTSIZE:
+		cmp = key_num_cmp;
+		break;
+	case SORT_OWNER:
+	case SORT_GROUP:
+	case SORT_SYMLINK:
+	case SORT_EXTENSION:
+		cmp = key_str_cmp;
+		break;
+	default:
+		cmp = key_cmp;
+	}
+
+	keys = malloc(d->num * sizeof(struct sort_key));
+
+	for (k = 0; k < d->num; k++) {
+		set_sort_key(&keys[k], d->ent[k]);
+	}
+
+	qsort(keys, d->num, sizeof(struct sort_key), cmp);
+
+	for (k = 0; k < d->num; k++) {
+		d->ent[k] = keys[k].f;
+	}
+
+	free(keys);
+}
+
+void
+diff_db_resort(int i)
+{
+	if (diff_db[i]) {
+		diff_db[i]->sorted = FALSE;
+	}
+
+	diff_db_sort(i);
 }
 
 void
 diff_db_add(struct filediff *diff, int i)
 {
+	struct diff_db *d = diff_db_get(i);
+
 #if defined(TRACE)
 	fprintf(debug, "<>diff_db_add name(%s) ltyp 0%o rtyp 0%o\n",
 	    diff->name, diff->type[0], diff->type[1]);
 #endif
-#ifdef HAVE_LIBAVLBST
-    union bst_val k, v;
-    k.p = diff;
-    v.i = 0;
-    avl_add(&diff_db[i], k, v);
-#else
-	tsearch(diff, &diff_db[i], diff_cmp);
-#endif
-	tot_db_num[i]++;
+	/* Like tsearch(3) an entry with the same name is not added again */
+	if (ix_add(&d->ix, diff)) {
+		return;
+	}
+
+	if (d->num == d->size) {
+		d->size = d->size ? 2 * d->size : 64;
+		d->ent = realloc(d->ent, d->size * sizeof(struct filediff *));
+	}
+
+	d->ent[d->num++] = diff;
+	d->sorted = FALSE;
+	/* Is rebuilt by diff_db_sort() */
+	free(db_list[i]);
+	db_list[i] = NULL;
 }
 
 void
 diff_db_free(int i)
 {
+	struct diff_db *d;
+
 #if defined(TRACE)
 	fprintf(debug, "->diff_db_free(%d)\n", i);
 #endif
-#ifdef HAVE_LIBAVLBST
-	diff_db_delete(diff_db[i].root);
-	diff_db[i].root = NULL;
-#else
-	struct filediff *f;
+	cmpq_clear();
 
-	while (diff_db[i] != NULL) {
-		f = *(struct filediff **)diff_db[i];
-		tdelete(f, &diff_db[i], diff_cmp);
-		free_diff(f);
+	if ((d = diff_db[i])) {
+		mem_free(d->mem);
+		free(d->ent);
+		free(d->ix.tab);
+		free(d);
+		diff_db[i] = NULL;
 	}
-#endif
+
 	free(db_list[i]);
 	db_list[i] = NULL;
 	mmrkd[i] = 0;
@@ -1317,27 +1623,271 @@ diff_db_free(int i)
 #endif
 }
 
-/* In the libavlbst case the nodes are not really deleted, just the memory
- * is freed after both subtrees had been visited.  This is much faster than
- * rebalancing the tree for each delete.  It is not dangerous since the tree
- * structure does not change due to the node memory free. */
+struct filediff *
+diff_db_del(const char *name, int i)
+{
+	struct diff_db *d;
+	struct filediff *f;
+	size_t k;
+
+	if (!(d = diff_db[i]) || !(f = ix_srch(&d->ix, name)))
+		return NULL;
+
+#if defined(TRACE)
+	fprintf(debug, "<>diff_db_del(%s, %d)\n", name, i);
+#endif
+	ix_del(&d->ix, name);
+
+	for (k = 0; d->ent[k] != f; k++);
+
+	/* Keeps the sort order */
+	memmove(d->ent + k, d->ent + k + 1,
+	    (--d->num - k) * sizeof(struct filediff *));
+
+	if (f->fl & FDFL_MMRK)
+		mmrkd[i]--;
+
+	/* Is rebuilt by diff_db_sort() */
+	free(db_list[i]);
+	db_list[i] = NULL;
+	return f;
+}
+
+void *
+diff_db_mem(size_t n, int i)
+{
+	return mem_get(&diff_db_get(i)->mem, n, MEM_ALIGN);
+}
+
+char *
+diff_db_strdup(const char *s, int i)
+{
+	size_t l = strlen(s) + 1;
+
+	return memcpy(mem_get(&diff_db_get(i)->mem, l, 1), s, l);
+}
+
+static struct diff_db *
+diff_db_get(int i)
+{
+	struct diff_db *d;
+
+	if (!(d = diff_db[i])) {
+		d = diff_db[i] = calloc(1, sizeof(struct diff_db));
+		d->ix.key = diff_key;
+	}
+
+	return d;
+}
+
+/* Block sizes are doubled up to MEM_MAX, hence small directories don't
+ * use much memory */
+
+static void *
+mem_get(struct mem_blk **mem, size_t n, size_t algn)
+{
+	struct mem_blk *m = *mem;
+	size_t o, size;
+
+	if (m) {
+		o = (m->used + algn - 1) & ~(algn - 1);
+
+		if (o + n <= m->size) {
+			m->used = o + n;
+			return (char *)m + o;
+		}
+	}
+
+	size = m && m->size < MEM_MAX ? 2 * m->size : m ? MEM_MAX : MEM_MIN;
+
+	if (size < MEM_HDR + n)
+		size = MEM_HDR + n;
+
+	if (!(m = malloc(size))) {
+		printerr(strerror(errno), "malloc(%zu)", size);
+		exit(EXIT_STATUS_ERROR);
+	}
+
+	m->size = size;
+	m->used = MEM_HDR + n;
+	m->next = *mem;
+	*mem = m;
+	return (char *)m + MEM_HDR;
+}
 
-#ifdef HAVE_LIBAVLBST
 static void
-diff_db_delete(struct bst_node *n)
+mem_free(struct mem_blk *m)
 {
-	struct filediff *f;
+	struct mem_blk *n;
 
-	if (!n)
+	for (; m; m = n) {
+		n = m->next;
+		free(m);
+	}
+}
+
+/**************
+ * name index *
+ **************/
+
+void
+name_db_add(const char *name)
+{
+	char *s = strdup(name);
+
+	if (ix_add(&name_db, s))
+		free(s);
+}
+
+bool
+name_db_srch(const char *name)
+{
+	return ix_srch(&name_db, name) != NULL;
+}
+
+void
+name_db_free(void)
+{
+	size_t k;
+
+	for (k = 0; k < name_db.size; k++) {
+		free(name_db.tab[k]);
+	}
+
+	free(name_db.tab);
+	name_db.tab = NULL;
+	name_db.size = 0;
+	name_db.num = 0;
+}
+
+static const char *
+diff_key(const void *p)
+{
+	return ((const struct filediff *)p)->name;
+}
+
+static const char *
+str_key(const void *p)
+{
+	return p;
+}
+
+/* FNV-1a */
+
+static size_t
+ix_hash(const char *s)
+{
+	size_t h = 2166136261U;
+
+	while (*s) {
+		h ^= (unsigned char)*s++;
+		h *= 16777619U;
+	}
+
+	return h;
+}
+
+static void *
+ix_srch(struct name_ix *x, const char *name)
+{
+	size_t m, k;
+
+	if (!x->size)
+		return NULL;
+
+	m = x->size - 1;
+
+	for (k = ix_hash(name) & m; x->tab[k]; k = (k + 1) & m) {
+		if (!strcmp(x->key(x->tab[k]), name))
+			return x->tab[k];
+	}
+
+	return NULL;
+}
+
+/* Return value: NULL if `p` had been added, else the item with the same
+ * name which is already in the index */
+
+static void *
+ix_add(struct name_ix *x, void *p)
+{
+	const char *name = x->key(p);
+	size_t m, k;
+
+	if (2 * (x->num + 1) > x->size)
+		ix_grow(x);
+
+	m = x->size - 1;
+
+	for (k = ix_hash(name) & m; x->tab[k]; k = (k + 1) & m) {
+		if (!strcmp(x->key(x->tab[k]), name))
+			return x->tab[k];
+	}
+
+	x->tab[k] = p;
+	x->num++;
+	return NULL;
+}
+
+/* The following items of the probe sequence are moved back, hence no
+ * tombstones are needed */
+
+static void
+ix_del(struct name_ix *x, const char *name)
+{
+	size_t m, k, j, h;
+
+	if (!x->size)
 		return;
 
-	diff_db_delete(n->left);
-	diff_db_delete(n->right);
-	f = n->key.p;
-	free_diff(f);
-	free(n);
+	m = x->size - 1;
+
+	for (k = ix_hash(name) & m; x->tab[k]; k = (k + 1) & m) {
+		if (!strcmp(x->key(x->tab[k]), name))
+			break;
+	}
+
+	if (!x->tab[k])
+		return;
+
+	x->tab[k] = NULL;
+	x->num--;
+
+	for (j = (k + 1) & m; x->tab[j]; j = (j + 1) & m) {
+		h = ix_hash(x->key(x->tab[j])) & m;
+
+		/* Item can be moved if `h` is not cyclically in (k, j] */
+		if (k < j ? h <= k || h > j : h <= k && h > j) {
+			x->tab[k] = x->tab[j];
+			x->tab[j] = NULL;
+			k = j;
+		}
+	}
+}
+
+static void
+ix_grow(struct name_ix *x)
+{
+	void **tab = x->tab;
+	size_t size = x->size;
+	size_t m, k, j;
+
+	x->size = size ? 2 * size : 64;
+	x->tab = calloc(x->size, sizeof(void *));
+	m = x->size - 1;
+
+	for (j = 0; j < size; j++) {
+		if (!tab[j])
+			continue;
+
+		for (k = ix_hash(x->key(tab[j])) & m; x->tab[k];
+		    k = (k + 1) & m);
+
+		x->tab[k] = tab[j];
+	}
+
+	free(tab);
 }
-#endif
 
 /*******************************
  * Directory list DB *
@@ -1,6 +1,10 @@
 #ifndef DB_H
 #define DB_H
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 #ifdef HAVE_LIBAVLBST
 # include <avlbst.h>
 #endif
@@ -15,6 +19,15 @@ struct scan_db {
 	struct scan_db *next;
 };
 
+/* Statistics of the files in a directory tree, collected by the
+ * recursive scan.  The files in one sided directories are counted. */
+struct dir_stat {
+	unsigned long only[2]; /* Files only in the left or right tree */
+	unsigned long diff;
+	unsigned long equal;
+	off_t dsiz; /* Size of the different regular files */
+};
+
 #ifdef HAVE_LIBAVLBST
 void db_init(void);
 void *db_new(int (*)(union bst_val, union bst_val));
@@ -53,9 +66,23 @@ void free_strs(void **);
 
 void diff_db_add(struct filediff *, int);
 void diff_db_sort(int);
+/* Sorts diff DB `i` again after the sort mode had been changed */
+void diff_db_resort(int i);
 void diff_db_restore(struct ui_state *);
 void diff_db_store(struct ui_state *);
 void diff_db_free(int);
+/* Removes the entry `name` from diff DB `i` and returns it.  db_list[i]
+ * is freed and needs to be rebuilt with diff_db_sort().
+ * Return value: The entry or NULL if not found */
+struct filediff *diff_db_del(const char *name, int i);
+/* Memory for entries of diff DB `i`.  It is not freed by free_diff() but
+ * by diff_db_free() for all entries at once. */
+void *diff_db_mem(size_t, int i);
+char *diff_db_strdup(const char *, int i);
+/* Names of the left side for the right side pass of build_diff_db() */
+void name_db_add(const char *);
+bool name_db_srch(const char *);
+void name_db_free(void);
 void add_alias(char *const, char *, const tool_flags_t);
 void db_def_ext(char *const, char *, tool_flags_t);
 struct tool *db_srch_ext(char *);
@@ -74,6 +101,22 @@ void *ptr_db_get_node(void *);
 void push_scan_db(bool);
 void pop_scan_db(void);
 void free_scan_db(bool);
+/* Adds directory `path` (result of realpath(3)), which contains
+ * differences, and its parent directories to the scan DB */
+void scan_db_add(const char *path);
+/* Adds the statistics `st` of directory `path` (result of realpath(3))
+ * to the statistics of the directory and of its parent directories */
+void scan_db_stat(const char *path, const struct dir_stat *st);
+/* Returns the statistics of the tree `path` or NULL */
+const struct dir_stat *scan_db_get_stat(const char *path);
+/* Returns TRUE if the tree `path` contains differences */
+bool scan_db_srch(const char *path);
+/* Returns the number of directories with differences in the tree
+ * `path` */
+unsigned long scan_db_cnt(const char *path);
+/* Removes the differences of the tree `path` and subtracts them from
+ * the counts of its parent directories */
+void scan_db_del(const char *path);
 int db_dl_add(char *, char *, char *);
 void ddl_del(char **);
 void bdl_del(char **);
@@ -87,11 +130,6 @@ extern unsigned short bsizlen[2];
 extern unsigned short majorlen[2], minorlen[2];
 extern size_t usrlen[2], grplen[2];
 extern short noequal, real_diff;
-extern void *scan_db;
-/* Use: UI dir diff: Every file found on left side is put into name_db
- * to check if it is found on right side too or if there are supernumerary
- * files in right side. */
-extern void *name_db;
 extern void *skipext_db;
 extern void *uz_path_db;
 extern bool sortic;
@@ -101,4 +139,8 @@ extern bool nohidden;
 
 struct tool *set_ext_tool(char *_tool, tool_flags_t flags);
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif /* DB_H */
@@ -0,0 +1,137 @@
+#include <stdexcept>
+#include <cstdio>
+#include <cstring>
+#include <sys/stat.h>
+#include "compat.h"
+#include "db_test.h"
+#include "main.h"
+#include "test.h"
+#include "diff.h"
+#include "tc.h"
+#include "db.h"
+
+void DbTest::run() const
+{
+    fprintf(debug, "->db_test\n");
+    diffDb();
+    scanDb();
+    fprintf(debug, "<-db_test\n");
+}
+
+// Entries are found by name, kept in sort order and removed with
+// diff_db_del()
+
+void DbTest::diffDb() const
+{
+    fprintf(debug, "->diffDb\n");
+    const unsigned n = 500;
+
+    // FsTest had set the lists to its own arrays
+
+    for (int i = 0; i < 2; ++i) {
+        db_list[i] = nullptr;
+        db_num[i] = 0;
+    }
+
+    bmode = FALSE;
+    fmode = FALSE;
+
+    // Names in a scrambled order, each one twice
+
+    for (unsigned k = 0; k < 2 * n; ++k) {
+        char name[16];
+        snprintf(name, sizeof name, "f%03u", k * 7 % n);
+        filediff *const f = static_cast<filediff *>(
+            diff_db_mem(sizeof(filediff), 0));
+        memset(f, 0, sizeof(filediff));
+        f->name = diff_db_strdup(name, 0);
+        f->type[0] = S_IFREG | 0644;
+        f->type[1] = S_IFREG | 0644;
+        f->diff = ' ';
+        diff_db_add(f, 0);
+    }
+
+    diff_db_sort(0);
+
+    if (db_num[0] != n)
+        FATAL_ERROR;
+
+    for (unsigned k = 1; k < n; ++k) {
+        if (strcmp(db_list[0][k - 1]->name, db_list[0][k]->name) >= 0)
+            FATAL_ERROR;
+    }
+
+    const filediff *const f = diff_db_del("f123", 0);
+
+    if (!f || strcmp(f->name, "f123") || diff_db_del("f123", 0) ||
+        diff_db_del("None", 0))
+    {
+        FATAL_ERROR;
+    }
+
+    diff_db_sort(0);
+
+    if (db_num[0] != n - 1 || strcmp(db_list[0][122]->name, "f122") ||
+        strcmp(db_list[0][123]->name, "f124"))
+    {
+        FATAL_ERROR;
+    }
+
+    diff_db_free(0);
+    fprintf(debug, "<-diffDb\n");
+}
+
+// The counts of the parent directories follow scan_db_add() and
+// scan_db_del(), the statistics are summed up
+
+void DbTest::scanDb() const
+{
+    fprintf(debug, "->scanDb\n");
+    free_scan_db(FALSE);
+    scan_db_add("/a/b/c");
+    scan_db_add("/a/b/d");
+    scan_db_add("/a/b/d"); // Counted once
+    scan_db_add("/a/x");
+
+    if (scan_db_cnt("/a") != 3 || scan_db_cnt("/a/b") != 2 ||
+        !scan_db_srch("/a/b/c") || scan_db_srch("/a/y") ||
+        scan_db_srch("/a/b/cc") || scan_db_srch("/a/b/c/e"))
+    {
+        FATAL_ERROR;
+    }
+
+    scan_db_del("/a/b");
+
+    if (scan_db_cnt("/a") != 1 || scan_db_srch("/a/b") ||
+        scan_db_srch("/a/b/c") || !scan_db_srch("/a/x"))
+    {
+        FATAL_ERROR;
+    }
+
+    dir_stat st;
+    memset(&st, 0, sizeof st);
+    st.diff = 2;
+    st.dsiz = 10;
+    scan_db_stat("/a/b", &st);
+    st.diff = 0;
+    st.dsiz = 0;
+    st.equal = 1;
+    st.only[1] = 3;
+    scan_db_stat("/a/x", &st);
+
+    const dir_stat *const p = scan_db_get_stat("/a");
+
+    if (!p || p->diff != 2 || p->equal != 1 || p->only[0] ||
+        p->only[1] != 3 || p->dsiz != 10 || scan_db_get_stat("/a/y") ||
+        scan_db_get_stat("/a/b")->equal)
+    {
+        FATAL_ERROR;
+    }
+
+    free_scan_db(FALSE);
+
+    if (scan_db_srch("/a/x"))
+        FATAL_ERROR;
+
+    fprintf(debug, "<-scanDb\n");
+}
@@ -0,0 +1,14 @@
+#ifndef DB_TEST_H
+#define DB_TEST_H
+
+class DbTest
+{
+public:
+    void run() const;
+
+private:
+    void diffDb() const;
+    void scanDb() const;
+};
+
+#endif // DB_TEST_H
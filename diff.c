@@ -14,6 +14,9 @@ OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
 PERFORMANCE OF THIS SOFTWARE.
 */
 
+#if defined(HAVE_STATX) && !defined(_GNU_SOURCE)
+# define _GNU_SOURCE /* statx(2) */
+#endif
 #include <stdlib.h>
 #include <sys/param.h>
 #include <fcntl.h>
@@ -25,6 +28,12 @@ PERFORMANCE OF THIS SOFTWARE.
 #include <stdarg.h>
 #include <signal.h>
 #include <stdint.h>
+#ifdef USE_SYS_SYSMACROS_H
+# include <sys/sysmacros.h>
+#endif
+#ifdef USE_SYS_MKDEV_H
+# include <sys/mkdev.h>
+#endif
 #include "main.h"
 #include "ui.h"
 #include "diff.h"
@@ -36,6 +45,11 @@ PERFORMANCE OF THIS SOFTWARE.
 #include "tc.h"
 #include "misc.h"
 #include "fs.h"
+#include "pscan.h"
+#include "digest.h"
+#include "fcmp.h"
+#include "cmpq.h"
+#include "snap.h"
 
 struct scan_dir {
 	char *s;
@@ -43,29 +57,60 @@ struct scan_dir {
 	struct scan_dir *next;
 };
 
-static struct filediff *alloc_diff(const char *const);
+static struct filediff *alloc_diff(const char *const, int);
 static void add_diff_dir(short);
+static void add_dir_stat(void);
+static int is_diff_ent(struct filediff *, int);
+static bool scan_db_pth(struct filediff *, int, char *);
+static const char *dir_realpath(int);
+static void dir_realpath_free(void);
 static size_t pthadd(char *, size_t, const char *);
 static size_t pthcut(char *, size_t);
 static void ini_int(void);
 /* Returns file descriptor or -1 on error. */
 static int dlg_open_ro(const char *const pth);
-static ssize_t dlg_read(int fd, void *buf, size_t count,
-                        const char* const pth);
 
 static char *last_path;
+/* Statistics of the directory read by the recursive scan */
+static struct dir_stat dstat;
+/* Collect `dstat` */
+static bool dstat_scan;
+/* Displayed directories and their realpath(3), for is_diff_dir() */
+static char *dir_pth[2], *dir_rp[2];
+static struct fcmp cmp_bufs = { { lbuf, rbuf }, { NULL, NULL, NULL }, 0,
+                                FALSE, 0, -1, FALSE };
 off_t tot_cmp_byte_count;
 /* -A, -D, -F, -G, -q, -T, -x */
 long tot_cmp_file_count;
+/* -q: Number of comparisons with mmap(2) */
+long tot_mmap_count;
+long tot_same_ino_count;
+off_t cmp_diff_off;
 short followlinks;
 bool one_scan;
 bool dotdot;
 static bool stopscan;
-static bool ign_diff_errs;
+bool ign_diff_errs;
+
+/* Directory read by scan_left_dir() and scan_right_dir().  Directories
+ * in snapshot files (option -z) are read by snap.c. */
+struct scan_dh {
+    DIR *d;
+    struct snap_dir *sd;
+    size_t k;
+};
+
+static bool open_scan_dir(const char *const path, struct scan_dh *const h) {
+    h->d = NULL;
+    h->sd = NULL;
+    h->k = 0;
+
+    if (snap_sides && snap_is_pth(path))
+        h->sd = snap_opendir(path);
+    else
+        h->d = opendir(path);
 
-static DIR *open_scan_dir(const char *const path) {
-    DIR *d = opendir(path);
-    if (!d) {
+    if (!h->d && !h->sd) {
         if (!bmode && !fmode && errno == ENOENT) {
             /* We are in diff mode. Ignore error. Predent empty directory. */
         } else if (!ign_diff_errs &&
@@ -75,50 +120,325 @@ static DIR *open_scan_dir(const char *const path) {
         {
             ign_diff_errs = TRUE;
         }
+
+        return FALSE;
     }
-    return d;
+    return TRUE;
+}
+
+static void close_scan_dir(struct scan_dh *const h) {
+    if (h->sd)
+        snap_closedir(h->sd);
+    else
+        closedir(h->d);
 }
 
-static const char *get_next_file_name(DIR *d, char *path, size_t path_len)
+/* Output:
+ *   *type: File type from readdir(3) or 0 if unknown */
+static const char *get_next_file_name(struct scan_dh *h, char *path,
+                                      size_t path_len, mode_t *type)
 {
     errno = 0;
-    const struct dirent *ent = readdir(d);
+
+    if (h->sd)
+        return snap_readdir(h->sd, &h->k, type);
+
+    const struct dirent *ent = readdir(h->d);
     if (ent) {
 #if defined(TRACE) && 1
         fprintf(debug, "  get_next_file_name: \"%s\"\n", ent->d_name);
 #endif
+        *type = dirent_type(ent);
         return ent->d_name;
     } else if (errno) {
         int readdir_errno = errno;
         path[path_len] = 0;
         printerr(strerror(errno), "readdir \"%s\"", path);
-        closedir(d);
+        closedir(h->d);
         errno = readdir_errno;
     }
     return NULL;
 }
 
+mode_t dirent_type(const struct dirent *ent)
+{
+#ifdef DT_DIR
+    switch (ent->d_type) {
+    case DT_REG:  return S_IFREG;
+    case DT_DIR:  return S_IFDIR;
+    case DT_LNK:  return S_IFLNK;
+    case DT_CHR:  return S_IFCHR;
+    case DT_BLK:  return S_IFBLK;
+    case DT_FIFO: return S_IFIFO;
+    case DT_SOCK: return S_IFSOCK;
+    }
+#else
+    (void)ent;
+#endif
+    return 0;
+}
+
+unsigned long count_tree_files(char *pth, mode_t type)
+{
+    DIR *d;
+    struct dirent *ent;
+    struct stat st;
+    const size_t l = strlen(pth);
+    unsigned long n = 0;
+
+    if ((type && !S_ISDIR(type)) || !(d = opendir(pth)))
+        return 1;
+
+    while ((ent = readdir(d))) {
+        const char *name = ent->d_name;
+        const size_t ln = strlen(name);
+
+        if (*name == '.' && (!name[1] || (name[1] == '.' && !name[2])))
+            continue;
+
+        if (l + ln + 2 > PATHSIZ) {
+            n++;
+            continue;
+        }
+
+        pth[l] = '/';
+        memcpy(pth + l + 1, name, ln + 1);
+
+        if (!(type = dirent_type(ent)))
+            type = lstat(pth, &st) == -1 ? S_IFREG : st.st_mode;
+
+        n += S_ISDIR(type) ? count_tree_files(pth, type) : 1;
+    }
+
+    pth[l] = 0;
+    closedir(d);
+    return n;
+}
+
+int open_dir_fd(const char *const path)
+{
+    int fd;
+
+#ifdef O_DIRECTORY
+    if ((fd = open(path, O_RDONLY|O_DIRECTORY)) == -1)
+        fd = AT_FDCWD;
+#else
+    (void)path;
+    fd = AT_FDCWD;
+#endif
+    return fd;
+}
+
+#ifdef HAVE_STATX
+static bool no_statx;
+
+static int statx_stat(int dfd, const char *name, int flags,
+                      struct stat *st)
+{
+    struct statx stx;
+    unsigned mask = STATX_TYPE|STATX_MODE|STATX_SIZE|STATX_MTIME|
+                    STATX_CTIME|STATX_INO|STATX_BLOCKS;
+
+    /* Owner and group are shown in the file list and the status line.
+     * Not needed during the recursive scan. */
+    if (!scan)
+        mask |= STATX_UID|STATX_GID|STATX_NLINK;
+
+    if (statx(dfd, name, flags, mask, &stx) == -1)
+        return -1;
+
+    memset(st, 0, sizeof(*st));
+    st->st_dev = makedev(stx.stx_dev_major, stx.stx_dev_minor);
+    st->st_ino = stx.stx_ino;
+    st->st_mode = stx.stx_mode;
+    st->st_nlink = stx.stx_nlink;
+    st->st_uid = stx.stx_uid;
+    st->st_gid = stx.stx_gid;
+    st->st_rdev = makedev(stx.stx_rdev_major, stx.stx_rdev_minor);
+    st->st_size = (off_t)stx.stx_size;
+    st->st_blksize = stx.stx_blksize;
+    st->st_blocks = (blkcnt_t)stx.stx_blocks;
+    st->st_atim.tv_sec = stx.stx_atime.tv_sec;
+    st->st_atim.tv_nsec = stx.stx_atime.tv_nsec;
+    st->st_mtim.tv_sec = stx.stx_mtime.tv_sec;
+    st->st_mtim.tv_nsec = stx.stx_mtime.tv_nsec;
+    st->st_ctim.tv_sec = stx.stx_ctime.tv_sec;
+    st->st_ctim.tv_nsec = stx.stx_ctime.tv_nsec;
+    return 0;
+}
+#endif
+
+static int scan_fstatat(int dfd, const char *name, struct stat *st,
+                        int flags)
+{
+#ifdef HAVE_STATX
+    if (!no_statx) {
+        if (!statx_stat(dfd, name, flags, st))
+            return 0;
+
+        if (errno != ENOSYS)
+            return -1;
+
+        no_statx = TRUE;
+    }
+#endif
+    return fstatat(dfd, name, st, flags);
+}
+
+int stat_at(int dfd, const char *const name, struct stat *st, off_t *lsiz)
+{
+    int i;
+
+    if (lsiz)
+        *lsiz = -1;
+
+    if ((i = scan_fstatat(dfd, name, st, AT_SYMLINK_NOFOLLOW)) == -1 ||
+        !followlinks || !S_ISLNK(st->st_mode))
+    {
+        return i;
+    }
+
+    if (lsiz)
+        *lsiz = st->st_size;
+
+    struct stat st2;
+
+    /* Keep link itself if target does not exist */
+    if (!scan_fstatat(dfd, name, &st2, 0))
+        *st = st2;
+
+    return 0;
+}
+
+/* stat_at() for `syspth[i]`, which may be inside a snapshot file */
+static int scan_stat(const int i, const int dfd, const char *const name,
+                     off_t *lsiz)
+{
+    if (snap_sides && snap_is_pth(syspth[i])) {
+        if (lsiz)
+            *lsiz = -1;
+
+        return snap_lstat(syspth[i], &gstat[i]);
+    }
+
+    return stat_at(dfd, name, &gstat[i], lsiz);
+}
+
+/* Returns TRUE if the file type from readdir(3) is all the recursive scan
+ * needs to know about a file, i.e. stat(2) can be skipped. */
+static bool scan_type_only(const mode_t type) {
+    if (!type)
+        return FALSE;
+
+    if (S_ISDIR(type))
+        return TRUE;
+
+    /* -F without -G and -x only need the name of non-directories */
+    return (bmode || fmode) && !gq_pattern &&
+           !(followlinks && S_ISLNK(type));
+}
+
 static bool is_dot_file(const char *const name) {
     return *name == '.' && (!name[1] ||
             (!((bmode || fmode) && (dotdot && !scan)) &&
              name[1] == '.' && !name[2]));
 }
 
-static void set_diff_item(struct filediff *const diff, short i, off_t lsize) {
+/* `db`: Diff DB of `diff` or -1 */
+static void set_diff_item(struct filediff *const diff, short i, off_t lsize,
+                          int db) {
 #if defined(TRACE) && 1
     fprintf(debug, "  set_diff_item() found %d 0%o \"%s\"\n", i, gstat[i].st_mode, syspth[i]);
 #endif
     diff->uid[i] = gstat[i].st_uid;
     diff->gid[i] = gstat[i].st_gid;
-    diff->siz[i] = gstat[i].st_size;
-    diff->mtim[i] = gstat[i].st_mtim;
-    diff->rdev[i] = gstat[i].st_rdev;
+    diff->mtime[i] = gstat[i].st_mtim.tv_sec;
+    diff->mtime_ns[i] = gstat[i].st_mtim.tv_nsec;
+
+    if (S_ISCHR(gstat[i].st_mode) || S_ISBLK(gstat[i].st_mode))
+        diff->rdev[i] = gstat[i].st_rdev;
+    else
+        diff->siz[i] = gstat[i].st_size;
 
     if (S_ISLNK(gstat[i].st_mode))
         lsize = gstat[i].st_size;
 
-    if (lsize >= 0)
-        diff->link[i] = read_link(syspth[i], lsize);
+    if (lsize >= 0) {
+        char *l = read_link(syspth[i], lsize);
+
+        if (l && db >= 0) {
+            diff->link[i] = diff_db_strdup(l, db);
+            free(l);
+        } else
+            diff->link[i] = l;
+    }
+}
+
+/* Sets types and attributes of `diff` from `gstat` and compares the
+ * files `syspth[0]` and `syspth[1]`.
+ * Return value: FALSE if `diff` is not to be added to the DB */
+static bool set_diff_ent(struct filediff *const diff, const off_t lsiz[2],
+                         int db) {
+    if ((diff->type[0] = gstat[0].st_mode))
+        set_diff_item(diff, 0, lsiz[0], db);
+    if ((diff->type[1] = gstat[1].st_mode))
+        set_diff_item(diff, 1, lsiz[1], db);
+
+    if ((diff->type[0] & S_IFMT) != (diff->type[1] & S_IFMT)) {
+        return TRUE;
+
+    } else if (gstat[0].st_ino == gstat[1].st_ino &&
+               gstat[0].st_dev == gstat[1].st_dev) {
+
+        diff->diff = '=';
+        return TRUE;
+
+    } else if (S_ISREG(gstat[0].st_mode)) {
+
+        switch (cmp_file(syspth[0], gstat[0].st_size, syspth[1],
+            gstat[1].st_size, 2)) {
+        case 4:
+            diff->diff = '?';
+            cmpq_add(diff);
+            break;
+        case 1:
+            diff->diff = '!';
+            break;
+        case 0:
+            break;
+        default: /* 2 or 3 */
+            diff->diff = '-';
+        }
+
+        return TRUE;
+
+    } else if (S_ISDIR(gstat[0].st_mode)) {
+
+        return TRUE;
+
+    } else if (S_ISLNK(gstat[0].st_mode)) {
+
+        if (diff->link[0] && diff->link[1]) {
+            if (strcmp(diff->link[0], diff->link[1]))
+                diff->diff = '!';
+            return TRUE;
+        }
+    } else if ((S_ISBLK(gstat[0].st_mode) ||
+                S_ISCHR(gstat[0].st_mode)))
+    {
+        if ((gstat[0].st_rdev !=
+             gstat[1].st_rdev))
+        {
+            diff->diff = '!';
+        }
+        return TRUE;
+    } else {
+        /* Any other file type.
+         * Comparing sockets and FIFOs does not make sense. */
+        return TRUE;
+    }
+
+    return FALSE;
 }
 
 /* Return value:
@@ -218,8 +538,17 @@ inline static int left_dir_scan_mode(const char *const name,
     if (S_ISREG(gstat[0].st_mode) &&
         S_ISREG(gstat[1].st_mode))
     {
-        if (cmp_file(syspth[0], gstat[0].st_size,
-                     syspth[1], gstat[1].st_size, 0) == 1) {
+        /* Hard links are equal without reading them */
+        const int i = same_file() ? 0 :
+                      cmp_file(syspth[0], gstat[0].st_size,
+                               syspth[1], gstat[1].st_size, 0);
+
+        if (!i)
+            dstat.equal++;
+        else if (i == 1) {
+            dstat.diff++;
+            dstat.dsiz += MAX(gstat[0].st_size, gstat[1].st_size);
+
             if (qdiff) {
                 printf("Files %s and %s differ\n",
                        syspth[0], syspth[1]);
@@ -248,7 +577,11 @@ inline static int left_dir_scan_mode(const char *const name,
         const int v = cmp_symlink(&a, &b);
         retval |= v;
 
-        if (v == 1) {
+        if (!v)
+            dstat.equal++;
+        else if (v == 1) {
+            dstat.diff++;
+
             if (qdiff) {
                 printf("Symbolic links differ: %s -> %s, %s -> %s\n",
                        syspth[0], a, syspth[1], b);
@@ -275,6 +608,7 @@ inline static int left_dir_scan_mode(const char *const name,
           S_ISFIFO(gstat[1].st_mode))))
     {
         ++tot_cmp_file_count; /* FIFO, socket: -q */
+        dstat.equal++;
         retval |= 0x10;
         goto func_return;
     }
@@ -287,7 +621,9 @@ inline static int left_dir_scan_mode(const char *const name,
             gstat[1].st_rdev)
         {
             ++tot_cmp_file_count; /* BLK, CHR: -q */
+            dstat.equal++;
         } else {
+            dstat.diff++;
             retval |= 1;
             if (qdiff) {
                 printf("Special files %s and %s differ\n",
@@ -306,6 +642,9 @@ inline static int left_dir_scan_mode(const char *const name,
         retval |= 0x10;
         goto func_return;
     }
+    if (!gstat[1].st_mode && dstat_scan)
+        dstat.only[0] += count_tree_files(syspth[0], gstat[0].st_mode);
+
     if (real_diff) {
         retval |= 0x10;
         goto func_return;
@@ -314,6 +653,9 @@ inline static int left_dir_scan_mode(const char *const name,
     if ((!gstat[0].st_mode || !gstat[1].st_mode ||
           gstat[0].st_mode !=  gstat[1].st_mode))
     {
+        if (gstat[1].st_mode)
+            dstat.diff++;
+
         if (qdiff) {
             printf("Different file type: %s and %s\n",
                    syspth[0], syspth[1]);
@@ -350,20 +692,29 @@ func_return:
  *   8: Set `dir_diff` */
 inline static int scan_left_dir(const int tree, struct scan_dir **const dirs) {
     int retval = 0;
+    int rfd = AT_FDCWD;
 #if defined(TRACE) && 1
     fprintf(debug, "  opendir lp(%s)%s\n", syspth[0], scan ? " scan" : "");
 #endif
-    DIR *d = open_scan_dir(syspth[0]);
-    if (!d) {
+    struct scan_dh d;
+    if (!open_scan_dir(syspth[0], &d)) {
         if (bmode || fmode)
             retval |= 4|2;
 
         goto func_return;
     }
 
+    const int lfd = d.d ? dirfd(d.d) : AT_FDCWD;
+
+    if (tree & 2) {
+        syspth[1][pthlen[1]] = 0;
+        rfd = open_dir_fd(syspth[1]);
+    }
+
     while (1) {
+        mode_t dtype;
         const char *const name =
-                get_next_file_name(d, syspth[0], pthlen[0]);
+                get_next_file_name(&d, syspth[0], pthlen[0], &dtype);
         if (!name) {
             if (!errno)
                 break;
@@ -376,11 +727,7 @@ inline static int scan_left_dir(const int tree, struct scan_dir **const dirs) {
         if (is_dot_file(name))
             continue;
         if (!(bmode || fmode)) {
-            str_db_add(&name_db, strdup(name)
-#ifdef HAVE_LIBAVLBST
-                , 0, NULL
-#endif
-                );
+            name_db_add(name);
         }
 
         pthadd(syspth[0], pthlen[0], name);
@@ -390,17 +737,16 @@ inline static int scan_left_dir(const int tree, struct scan_dir **const dirs) {
             name, syspth[0], strlen(syspth[0]), pthlen[0]);
 #endif
         off_t lsiz[2];
-        if (followlinks && !scan && lstat(syspth[0], &gstat[0]) != -1 &&
-            S_ISLNK(gstat[0].st_mode))
-        {
-            lsiz[0] = gstat[0].st_size;
-        } else
-            lsiz[0] = -1;
         bool file_err = FALSE;
         int i;
 
-        if (!followlinks || (i = stat(syspth[0], &gstat[0])) == -1)
-            i = lstat(syspth[0], &gstat[0]);
+        if (scan && scan_type_only(dtype)) {
+            /* Type from readdir() is sufficient */
+            gstat[0].st_mode = dtype;
+            lsiz[0] = -1;
+            i = 0;
+        } else
+            i = scan_stat(0, lfd, name, scan ? NULL : &lsiz[0]);
 
         if (i == -1) {
             if (errno != ENOENT) {
@@ -429,15 +775,8 @@ inline static int scan_left_dir(const int tree, struct scan_dir **const dirs) {
         } else {
             goto no_tree2;
         }
-        if (followlinks && !scan && lstat(syspth[1], &gstat[1]) != -1 &&
-                S_ISLNK(gstat[1].st_mode))
-        {
-            lsiz[1] = gstat[1].st_size;
-        } else {
-            lsiz[1] = -1;
-        }
-        if (!followlinks || (i = stat(syspth[1], &gstat[1])) == -1)
-            i = lstat(syspth[1], &gstat[1]);
+        i = scan_stat(1, rfd, rfd == AT_FDCWD ? syspth[1] : name,
+                      scan ? NULL : &lsiz[1]);
         if (i == -1) {
             if (errno != ENOENT) {
                 if (!ign_diff_errs && dialog(ign_txt, NULL,
@@ -480,12 +819,12 @@ no_tree2:
                 break;
             }
             if (retval & 4) {
-                closedir(d);
+                close_scan_dir(&d);
                 goto func_return;
             }
         }
 
-        struct filediff *diff = alloc_diff(name);
+        struct filediff *diff = alloc_diff(name, 0);
 
         if (file_err) {
             diff->diff = '-';
@@ -493,74 +832,15 @@ no_tree2:
             continue;
         }
 
-        if ((diff->type[0] = gstat[0].st_mode))
-            set_diff_item(diff, 0, lsiz[0]);
-        if ((diff->type[1] = gstat[1].st_mode))
-            set_diff_item(diff, 1, lsiz[1]);
-
-        if ((diff->type[0] & S_IFMT) != (diff->type[1] & S_IFMT)) {
-
-            diff_db_add(diff, 0);
-            continue;
-
-        } else if (gstat[0].st_ino == gstat[1].st_ino &&
-                   gstat[0].st_dev == gstat[1].st_dev) {
-
-            diff->diff = '=';
-            diff_db_add(diff, 0);
-            continue;
-
-        } else if (S_ISREG(gstat[0].st_mode)) {
-
-            switch (cmp_file(syspth[0], gstat[0].st_size, syspth[1],
-                gstat[1].st_size, 0)) {
-            case 1:
-                diff->diff = '!';
-                /* fall through */
-            case 0:
-db_add_file:
-                diff_db_add(diff, 0);
-                continue;
-            default: /* 2 or 3 */
-                diff->diff = '-';
-                goto db_add_file;
-            }
-
-        } else if (S_ISDIR(gstat[0].st_mode)) {
-
-            diff_db_add(diff, 0);
-            continue;
-
-        } else if (S_ISLNK(gstat[0].st_mode)) {
-
-            if (diff->link[0] && diff->link[1]) {
-                if (strcmp(diff->link[0], diff->link[1]))
-                    diff->diff = '!';
-                diff_db_add(diff, 0);
-                continue;
-            }
-        } else if ((S_ISBLK(gstat[0].st_mode) ||
-                    S_ISCHR(gstat[0].st_mode)))
-        {
-            if ((gstat[0].st_rdev !=
-                 gstat[1].st_rdev))
-            {
-                diff->diff = '!';
-            }
-            diff_db_add(diff, 0);
-            continue;
-        } else {
-            /* Any other file type.
-             * Comparing sockets and FIFOs does not make sense. */
+        /* Else the memory is freed with the DB */
+        if (set_diff_ent(diff, lsiz, 0))
             diff_db_add(diff, 0);
-            continue;
-        }
-
-        free(diff);
     } /* readdir() loop */
 
-    closedir(d);
+    close_scan_dir(&d);
 func_return:
+    if (rfd != AT_FDCWD)
+        close(rfd);
     syspth[0][pthlen[0]] = 0;
     return retval;
 }
@@ -573,8 +853,8 @@ inline static int scan_right_dir(const int tree, struct scan_dir **const dirs) {
 #if defined(TRACE) && 1
     fprintf(debug, "  opendir rp(%s)%s\n", syspth[1], scan ? " scan" : "");
 #endif
-    DIR *d = open_scan_dir(syspth[1]);
-    if (!d) {
+    struct scan_dh d;
+    if (!open_scan_dir(syspth[1], &d)) {
         if (bmode || fmode)
             retval |= 4|2;
 
@@ -582,8 +862,9 @@ inline static int scan_right_dir(const int tree, struct scan_dir **const dirs) {
     }
 
     while (1) {
+        mode_t dtype;
         const char *const name =
-                get_next_file_name(d, syspth[1], pthlen[1]);
+                get_next_file_name(&d, syspth[1], pthlen[1], &dtype);
         if (!name) {
             if (!errno)
                 break;
@@ -596,7 +877,7 @@ inline static int scan_right_dir(const int tree, struct scan_dir **const dirs) {
         if (is_dot_file(name))
             continue;
         if (!(bmode || fmode) && (tree & 1) &&
-                !str_db_srch(&name_db, name, NULL))
+                name_db_srch(name))
         {
             continue;
         }
@@ -614,8 +895,19 @@ inline static int scan_right_dir(const int tree, struct scan_dir **const dirs) {
 #if defined(TRACE) && 1
             fprintf(debug, "  dir_diff: One sided: %s\n", name);
 #endif
-            retval |= 8;
-            break;
+            if (!dstat_scan) {
+                retval |= 8;
+                break;
+            }
+
+            /* All files are counted */
+            pthadd(syspth[1], pthlen[1], name);
+            dstat.only[1] += count_tree_files(syspth[1], dtype);
+
+            if (!real_diff)
+                retval |= 8;
+
+            continue;
         }
 
         pthadd(syspth[1], pthlen[1], name);
@@ -625,19 +917,17 @@ inline static int scan_right_dir(const int tree, struct scan_dir **const dirs) {
             name, syspth[1], strlen(syspth[1]), pthlen[1]);
 #endif
         off_t lsiz2;
-        if (followlinks && !scan && lstat(syspth[1], &gstat[1]) != -1 &&
-            S_ISLNK(gstat[1].st_mode))
-        {
-            lsiz2 = gstat[1].st_size;
-        } else {
-            lsiz2 = -1;
-        }
         bool file_err = FALSE;
         int i;
 
-        if (!followlinks || (i = stat(syspth[1], &gstat[1])) == -1) {
-            i = lstat(syspth[1], &gstat[1]);
-        }
+        if (scan && scan_type_only(dtype)) {
+            /* Type from readdir() is sufficient */
+            gstat[1].st_mode = dtype;
+            lsiz2 = -1;
+            i = 0;
+        } else
+            i = scan_stat(1, d.d ? dirfd(d.d) : AT_FDCWD, name,
+                          scan ? NULL : &lsiz2);
 
         if (i == -1) {
             if (errno != ENOENT) {
@@ -659,7 +949,7 @@ inline static int scan_right_dir(const int tree, struct scan_dir **const dirs) {
             if (stopscan ||
                 ((bmode || fmode) && file_pattern && getch() == '%')) {
                 stopscan = TRUE;
-                closedir(d);
+                close_scan_dir(&d);
                 retval |= 4;
                 goto func_return;
             }
@@ -692,14 +982,16 @@ inline static int scan_right_dir(const int tree, struct scan_dir **const dirs) {
             }
         }
 
-        struct filediff *diff = alloc_diff(name);
+        /* In scan mode the entry is not put into the DB */
+        const int db = scan ? -1 : fmode ? 1 : 0;
+        struct filediff *diff = alloc_diff(name, db);
         diff->type[0] = 0;
         diff->type[1] = gstat[1].st_mode;
 
         if (file_err)
             diff->diff = '-';
         else
-            set_diff_item(diff, 1, lsiz2);
+            set_diff_item(diff, 1, lsiz2, db);
 
         if (scan) {
             if (gq_pattern && !gq_proc(diff)) {
@@ -713,10 +1005,10 @@ inline static int scan_right_dir(const int tree, struct scan_dir **const dirs) {
             continue;
         }
 
-        diff_db_add(diff, fmode ? 1 : 0);
+        diff_db_add(diff, db);
     }
 
-    closedir(d);
+    close_scan_dir(&d);
 func_return:
     syspth[1][pthlen[1]] = 0;
     return retval;
@@ -748,6 +1040,12 @@ build_diff_db(
 	fprintf(debug, "->build_diff_db tree(%d)%s\n",
 	    tree, scan ? " scan" : "");
 #endif
+	if (!scan) {
+		id_cache_expire();
+		dir_realpath_free();
+	} else
+		memset(&dstat, 0, sizeof dstat);
+
 	if (one_scan) {
 		one_scan = FALSE;
 
@@ -815,7 +1113,7 @@ right_tree:
 	if (!(tree & 2) || bmode)
 		goto build_list;
 
-	if (scan && (real_diff || dir_diff))
+	if (scan && (real_diff || dir_diff) && !dstat_scan)
 		goto dir_scan_end;
 
     if (!cli_mode) {
@@ -846,11 +1144,14 @@ build_list:
 		diff_db_sort(fmode && (tree & 2) ? 1 : 0);
 
 dir_scan_end:
-	free_strs(&name_db);
+	name_db_free();
     if (!scan || (retval && exit_on_error)) {
 		goto exit;
 	}
 
+	if (dstat_scan)
+		add_dir_stat();
+
     if (dir_diff && !cli_mode) {
         add_diff_dir(1); /* right tree */
 	}
@@ -881,11 +1182,53 @@ exit:
 	return retval;
 }
 
+void
+update_diff_ent(const char *name, int i)
+{
+    const int db = fmode ? i : 0;
+    struct filediff *f;
+    off_t lsiz[2];
+    int j;
+
+#if defined(TRACE) && 1
+    fprintf(debug, "->update_diff_ent(%s, %d)\n", name, i);
+#endif
+    /* The memory of the entry is freed with the DB */
+    diff_db_del(name, db);
+
+    for (j = 0; j < 2; j++) {
+        gstat[j].st_mode = 0;
+        lsiz[j] = -1;
+
+        /* bmode: Only syspth[0], which is "." */
+        if ((bmode && j) || (fmode && j != i))
+            continue;
+
+        pthcat(syspth[j], pthlen[j], name);
+
+        if (stat_at(AT_FDCWD, syspth[j], &gstat[j], &lsiz[j]) == -1)
+            gstat[j].st_mode = 0; /* Removed */
+    }
+
+    if (gstat[0].st_mode || gstat[1].st_mode) {
+        f = alloc_diff(name, db);
+
+        if (set_diff_ent(f, lsiz, db))
+            diff_db_add(f, db);
+    }
+
+    syspth[0][pthlen[0]] = 0;
+    syspth[1][pthlen[1]] = 0;
+#if defined(TRACE) && 1
+    fprintf(debug, "<-update_diff_ent\n");
+#endif
+}
+
 int file_grep(const char *const name)
 {
     int return_value = 1;
     ++tot_cmp_file_count; /* -G */
-    struct filediff *diff = alloc_diff(name);
+    struct filediff *diff = alloc_diff(name, -1);
     diff->type[0] = gstat[0].st_mode;
     diff->type[1] = gstat[1].st_mode;
     diff->siz[0]  = gstat[0].st_size;
@@ -1022,7 +1365,7 @@ add_diff_dir(
     /* Only fmode: 0: syspth[0], 1: syspth[1] */
     short side)
 {
-	char *path, *end, *rp = NULL;
+	char *path, *rp;
 
 	/* During scan bmode uses syspth[0] */
 	syspth[0][pthlen[0]] = 0;
@@ -1034,58 +1377,45 @@ add_diff_dir(
             side ? "right" : "left", path, syspth[0], syspth[1]);
 #endif
 
-	if (!(rp = realpath(path, NULL))) {
+	if (!(rp = snap_realpath(path))) {
 		printerr(strerror(errno), LOCFMT "realpath \"%s\""
 		    LOCVAR, path);
 		goto ret0;
 	}
 
-	path = rp;
-	end = path + strlen(path);
-
-	while (1) {
-#ifdef HAVE_LIBAVLBST
-		struct bst_node *n;
-		int i;
-
-		if (!(i = str_db_srch(&scan_db, path, &n)))
-			goto ret;
-
-		str_db_add(&scan_db, strdup(path), i, n);
-#else
-		char *s, *s2;
-
-		s = strdup(path);
-		s2 = str_db_add(&scan_db, s);
-
-		if (s2 != s) {
-			free(s);
-			goto ret;
-		}
-#endif
-
+	add_diff_rpath(rp);
+ret0:
 #if defined(TRACE) && 1
-		fprintf(debug, "  \"%s\" added\n", path);
+	fprintf(debug, "<-add_diff_dir\n");
 #endif
-		do {
-			if (--end < path)
-				goto ret;
-		} while (*end != '/');
+	return;
+}
 
-		if (end == path) {
-			end[1] = 0;
-		} else {
-			*end = 0;
-		}
+static void
+add_dir_stat(void)
+{
+	char *rp;
+
+	syspth[0][pthlen[0]] = 0;
+
+	if (!(rp = snap_realpath(syspth[0]))) {
+		printerr(strerror(errno), LOCFMT "realpath \"%s\""
+		    LOCVAR, syspth[0]);
+		return;
 	}
 
-ret:
+	scan_db_stat(rp, &dstat);
 	free(rp);
-ret0:
+}
+
+void
+add_diff_rpath(char *path)
+{
 #if defined(TRACE) && 1
-	fprintf(debug, "<-add_diff_dir\n");
+	fprintf(debug, "  \"%s\" added\n", path);
 #endif
-	return;
+	scan_db_add(path);
+	free(path);
 }
 
 /*
@@ -1095,8 +1425,6 @@ ret0:
 int
 is_diff_dir(struct filediff *f)
 {
-    char *bp = NULL, *pth = NULL;
-    size_t l = (size_t)-1;
 	int v = 0;
 
 	/* E.g. for file stat called independend from 'recursive' */
@@ -1111,46 +1439,15 @@ is_diff_dir(struct filediff *f)
 	fprintf(debug, "->is_diff_dir(%s)\n", f->name);
 #endif
 	if (bmode) {
-		pth = syspth[1];
-		l = strlen(pth);
-		bp = malloc(l + strlen(f->name) + 2);
-		memcpy(bp, pth, l);
-		pth = bp;
-#if defined(TRACE) && 1
-        fprintf(debug, "  %s:%d\n", __FILE__, __LINE__);
-#endif
-        pthcat(pth, l, f->name);
-		v = is_diff_pth(pth, 0);
-		free(bp);
+		v = is_diff_ent(f, 1);
 	} else {
 		if (f->type[0]) {
-			pth = syspth[0];
-			l = pthlen[0];
-#if defined(TRACE) && 1
-            fprintf(debug, "  %s:%d\n", __FILE__, __LINE__);
-#endif
-            pthcat(pth, l, f->name);
-			v = is_diff_pth(pth, 0);
+			v = is_diff_ent(f, 0);
 		}
 
 		if (!v && f->type[1]) {
-			pth = syspth[1];
-			l = pthlen[1];
-#if defined(TRACE) && 1
-            fprintf(debug, "  %s:%d\n", __FILE__, __LINE__);
-#endif
-            pthcat(pth, l, f->name);
-			v = is_diff_pth(pth, 0);
+			v = is_diff_ent(f, 1);
 		}
-
-        if (pth && l != (size_t)-1)
-            pth[l] = 0;
-#if defined(DEBUG)
-        else {
-            fprintf(debug, LOCFMT "`pth` or `l` not set !\n" LOCVAR);
-            exit(EXIT_STATUS_ERROR);
-        }
-#endif
 	}
 
 #if defined(TRACE) && 1
@@ -1160,6 +1457,113 @@ ret0:
 	return v;
 }
 
+/* Returns 1 if directory `f` on side `i` contains differences */
+
+static int
+is_diff_ent(struct filediff *f, int i)
+{
+	char pth[PATHSIZ];
+
+	return scan_db_pth(f, i, pth) && scan_db_srch(pth);
+}
+
+const struct dir_stat *
+get_dir_stat(struct filediff *f)
+{
+	char pth[PATHSIZ];
+
+	if (!recursive || bmode || fmode || !f->type[0] ||
+	    (dotdot && f->name[0] == '.' && f->name[1] == '.' && !f->name[2]))
+	{
+		return NULL;
+	}
+
+	return scan_db_pth(f, 0, pth) ? scan_db_get_stat(pth) : NULL;
+}
+
+/* Sets `pth` to the realpath(3) of directory `f` on side `i`, the key
+ * of the scan DB.  Only the realpath of the displayed directory is
+ * needed.  Return value: FALSE on error */
+
+static bool
+scan_db_pth(struct filediff *f, int i, char *pth)
+{
+	const char *rp;
+	char *s;
+	size_t l;
+
+	/* Symlink (option -L): The directory can be anywhere */
+	if (f->link[i]) {
+		rp = bmode ? syspth[1] : syspth[i];
+		l = bmode ? strlen(rp) : pthlen[i];
+		memcpy(pth, rp, l);
+		pthcat(pth, l, f->name);
+
+		if (!(s = snap_realpath(pth))) {
+			printerr(strerror(errno), LOCFMT "realpath \"%s\""
+			    LOCVAR, pth);
+			return FALSE;
+		}
+
+		l = strlen(s);
+
+		if (l < PATHSIZ)
+			memcpy(pth, s, l + 1);
+
+		free(s);
+		return l < PATHSIZ;
+	}
+
+	if (!(rp = dir_realpath(i)) || (l = strlen(rp)) >= PATHSIZ)
+		return FALSE;
+
+	memcpy(pth, rp, l);
+	pthcat(pth, l, f->name);
+	return TRUE;
+}
+
+/* Returns the realpath(3) of the displayed directory of side `i`.  It is
+ * kept until the directory is read again. */
+
+static const char *
+dir_realpath(int i)
+{
+	const char *p = bmode ? syspth[1] : syspth[i];
+	size_t l = bmode ? strlen(p) : pthlen[i];
+
+	if (dir_pth[i] && strlen(dir_pth[i]) == l &&
+	    !memcmp(dir_pth[i], p, l))
+	{
+		return dir_rp[i];
+	}
+
+	free(dir_pth[i]);
+	free(dir_rp[i]);
+	dir_pth[i] = malloc(l + 1);
+	memcpy(dir_pth[i], p, l);
+	dir_pth[i][l] = 0;
+
+	if (!(dir_rp[i] = snap_realpath(dir_pth[i]))) {
+		printerr(strerror(errno), LOCFMT "realpath \"%s\""
+		    LOCVAR, dir_pth[i]);
+	}
+
+	return dir_rp[i];
+}
+
+static void
+dir_realpath_free(void)
+{
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		free(dir_pth[i]);
+		free(dir_rp[i]);
+		dir_pth[i] = NULL;
+		dir_rp[i] = NULL;
+	}
+}
+
 int
 is_diff_pth(const char *p,
     /* 1: Remove path */
@@ -1167,17 +1571,12 @@ is_diff_pth(const char *p,
 {
 	char *rp = NULL;
 	int v = 0;
-#ifdef HAVE_LIBAVLBST
-	struct bst_node *n;
-#else
-	char *n;
-#endif
 
 #if defined(TRACE) && 0
 	fprintf(debug, "->is_diff_pth(%s,%u)\n", p, m);
 #endif
 	/* Here since both path and name can be symlink */
-	if (!(rp = realpath(p, NULL))) {
+	if (!(rp = snap_realpath(p))) {
 		printerr(strerror(errno), LOCFMT "realpath \"%s\""
 		    LOCVAR, p);
 		goto ret;
@@ -1185,19 +1584,13 @@ is_diff_pth(const char *p,
 #if defined(TRACE) && 0
 	fprintf(debug, "  realpath: \"%s\"\n", p);
 #endif
-	v = str_db_srch(&scan_db, rp, &n) ? 0 : 1;
+	v = scan_db_srch(rp);
 
 	if (m && v) {
 #if defined(TRACE) && 0
-		fprintf(debug, "  remove \"%s\"\n",
-#ifdef HAVE_LIBAVLBST
-		    rp
-#else
-		    n
+		fprintf(debug, "  remove \"%s\"\n", rp);
 #endif
-		    );
-#endif
-		str_db_del(&scan_db, n);
+		scan_db_del(rp);
 	}
 
 	free(rp);
@@ -1211,6 +1604,9 @@ ret:
 char *
 read_link(char *path, off_t size)
 {
+    if (snap_sides && snap_is_pth(path))
+        return snap_readlink(path);
+
     char *l = malloc((size_t)size + 1);
 
     if (!l) {
@@ -1272,54 +1668,20 @@ int cmp_symlink(char **a, char **b) {
     return return_value;
 }
 
-inline static int cmp_file_loop(const int f1, const int f2,
-                                const char *const lpth,
-                                const char *const rpth)
-{
-    int rv = 0;
-    while (1) {
-        const ssize_t l1 = dlg_read(f1, lbuf, sizeof lbuf, lpth);
-        if (l1 == -1) {
-            rv |= 2;
-            break;
-        }
-        const ssize_t l2 = dlg_read(f2, rbuf, sizeof rbuf, rpth);
-        if (l2 == -1) {
-            rv |= 2;
-            break;
-        }
-
-        if (l1 != l2) {
-            rv |= 1;
-            break;
-        }
-
-        if (!l1)
-            break;
-
-        if (memcmp(lbuf, rbuf, (size_t)l1)) {
-            rv |= 1;
-            break;
-        }
-        /* Count successfully compared bytes only. */
-        if (qdiff)
-            tot_cmp_byte_count += l1;
-        if (l1 < (ssize_t)(sizeof lbuf))
-            break;
-    }
-    return rv;
-}
-
 int cmp_file(
 	const char *const lpth,
 	const off_t lsiz,
 	const char *const rpth,
 	const off_t rsiz,
-    /* !0: force compare, no getch */
+    /* 1: force compare, no getch
+     * 2: compare samples only if `fast_approx` is set, don't compare
+     *    if `bg_cmp` is set */
     const unsigned md)
 {
     int rv = 0;
 
+    cmp_diff_off = -1;
+
 #if defined(TRACE) && (defined(TEST) || 1)
     fprintf(debug, "->cmp_file(lpth=%s lsiz=%ju rpth=%s rsiz=%ju md=%u)\n",
 		lpth, (intmax_t)lsiz, rpth, (intmax_t)rsiz, md);
@@ -1334,7 +1696,7 @@ int cmp_file(
 		goto ret;
 	}
 
-	if (!md) {
+	if (!(md & 1)) {
 		if (dontcmp) {
 			goto ret;
 		}
@@ -1344,6 +1706,18 @@ int cmp_file(
 			goto ret;
 		}
 	}
+
+    /* Before the queue, which can't open paths inside snapshot files */
+    if (snap_sides && (rv = snap_cmp_file(lpth, rpth)) != -1)
+        goto ret;
+
+    rv = 0;
+
+    if ((md & 2) && bg_cmp && !cli_mode && !scan) {
+        rv = 4; /* Compared later by cmpq.c */
+        goto ret;
+    }
+
     const int f1 = dlg_open_ro(lpth);
     if (f1 == -1) {
         rv |= 2;
@@ -1354,7 +1728,49 @@ int cmp_file(
         rv |= 2;
 		goto close_f1;
 	}
-    rv |= cmp_file_loop(f1, f2, lpth, rpth);
+    const int fd[2] = { f1, f2 };
+    int err_side;
+    int v;
+
+    cmp_bufs.exact = md & 1 ? TRUE : FALSE;
+
+    if ((md & 2) && fast_approx && !cli_mode && !scan &&
+        (v = fcmp_sample(&cmp_bufs, fd, lsiz, &err_side)) != -1)
+    {
+        if (!v) {
+            rv = 4;
+            goto close_f2;
+        }
+    } else if ((v = digest_cmp(&cmp_bufs, fd, &err_side)) == -1) {
+        v = fcmp_run(&cmp_bufs, fd, lsiz, NULL, &err_side);
+    }
+
+    /* Count successfully compared bytes only. */
+    if (qdiff) {
+        tot_cmp_byte_count += cmp_bufs.nbytes;
+
+        if (cmp_bufs.mapped)
+            ++tot_mmap_count;
+    }
+
+    switch (v) {
+    case 0:
+        break;
+    case 1:
+        cmp_diff_off = cmp_bufs.diff_off;
+        rv |= 1;
+        break;
+    default:
+        if (!ign_diff_errs &&
+                dialog(ign_txt, NULL, "read \"%s\": %s",
+                       err_side ? rpth : lpth, strerror(errno))
+                == 'i')
+        {
+            ign_diff_errs = TRUE;
+        }
+
+        rv |= 2;
+    }
 
     /* Count really and successfully compared files only,
      * not zero size files, nor different files. */
@@ -1366,6 +1782,7 @@ int cmp_file(
                    syspth[0], syspth[1]);
     }
 
+close_f2:
     close(f2);
 close_f1:
 	close(f1);
@@ -1376,6 +1793,23 @@ ret:
 	return rv;
 }
 
+int
+same_file(void)
+{
+    if (gstat[0].st_ino != gstat[1].st_ino ||
+        gstat[0].st_dev != gstat[1].st_dev)
+    {
+        return 0;
+    }
+
+    ++tot_same_ino_count;
+
+    if (qdiff)
+        ++tot_cmp_file_count; /* File: -A, -q, -T */
+
+    return 1;
+}
+
 static int dlg_open_ro(const char *const pth) {
     int fd;
 
@@ -1392,29 +1826,22 @@ static int dlg_open_ro(const char *const pth) {
     return fd;
 }
 
-static ssize_t dlg_read(int fd, void *buf, size_t count,
-                        const char* const pth)
-{
-    ssize_t l;
-
-    if ((l = read(fd, buf, count)) == -1) {
-        if (!ign_diff_errs &&
-                dialog(ign_txt, NULL, "read \"%s\": %s",
-                       pth, strerror(errno))
-                == 'i')
-        {
-            ign_diff_errs = TRUE;
-        }
-    }
-
-    return l;
-}
+/* `db`: Diff DB which will get the entry.  It is allocated in the memory
+ * of the DB then.  -1: The entry is freed with free_diff(). */
 
 static struct filediff *
-alloc_diff(const char *const name)
+alloc_diff(const char *const name, int db)
 {
-	struct filediff *p = malloc(sizeof(struct filediff));
-	p->name  = strdup(name);
+	struct filediff *p;
+
+	if (db >= 0) {
+		p = diff_db_mem(sizeof(struct filediff), db);
+		p->name = diff_db_strdup(name, db);
+	} else {
+		p = malloc(sizeof(struct filediff));
+		p->name = strdup(name);
+	}
+
     p->link[0] = NULL; /* to simply use free() later */
     p->link[1] = NULL;
 	p->fl = 0;
@@ -1422,6 +1849,16 @@ alloc_diff(const char *const name)
 	return p;
 }
 
+struct timespec
+diff_mtim(const struct filediff *f, int i)
+{
+    struct timespec t;
+
+    t.tv_sec = f->mtime[i];
+    t.tv_nsec = f->mtime_ns[i];
+    return t;
+}
+
 void
 free_diff(struct filediff *f)
 {
@@ -1555,7 +1992,21 @@ do_scan(void)
 	fprintf(debug, "->do_scan lp(%s) rp(%s)\n", syspth[0], syspth[1]);
 #endif
 	scan = 1;
-    return_value |= build_diff_db(bmode ? 1 : 3);
+	dstat_scan = add_dstat && !cli_mode && !bmode && !fmode &&
+	    !file_pattern;
+
+    if (snap_usable()) {
+        ini_int();
+        return_value |= snap_scan();
+        nodelay(stdscr, FALSE);
+    } else if (pscan_usable()) {
+        ini_int();
+        return_value |= pscan_run();
+        nodelay(stdscr, FALSE);
+    } else {
+        return_value |= build_diff_db(bmode ? 1 : 3);
+    }
+
 	stopscan = FALSE;
 	scan = 0;
 #if defined(TRACE) && 1
@@ -9,27 +9,45 @@ extern "C" {
 #include <sys/stat.h>
 #include "compat.h"
 
+struct dirent;
+struct dir_stat;
+
 /* File marked (for delete, copy, etc.) */
 #define FDFL_MMRK 1
+/* Size of side `i`, 0 for devices */
+#define FD_SIZ(f, i) \
+    (S_ISCHR((f)->type[i]) || S_ISBLK((f)->type[i]) ? 0 : (f)->siz[i])
 
+/* Ordered by size to avoid padding.  On LP64 systems it has 96 bytes
+ * instead of 120 bytes with separate `siz`, `rdev` and a
+ * `struct timespec` for each side. */
 struct filediff {
     const char *name;
     char *link[2];
+    union {
+        off_t siz[2];
+        dev_t rdev[2]; /* Only for S_ISCHR() and S_ISBLK() */
+    };
+    time_t mtime[2];    /* st_mtim.tv_sec */
+    unsigned mtime_ns[2]; /* st_mtim.tv_nsec */
     mode_t type[2];
     uid_t uid[2];
     gid_t gid[2];
-    off_t siz[2];
-    struct timespec mtim[2];
-    dev_t rdev[2];
-	unsigned fl;
+	unsigned char fl;
     char diff;
 };
 
 extern off_t tot_cmp_byte_count;
 extern long tot_cmp_file_count;
+extern long tot_mmap_count;
+extern long tot_same_ino_count;
+/* Output of cmp_file(): Offset of the first different byte or -1 */
+extern off_t cmp_diff_off;
 extern short followlinks;
 extern bool one_scan;
 extern bool dotdot;
+/* Set if the user selected to ignore further scan errors */
+extern bool ign_diff_errs;
 /*
  * Returns a compination of:
  *   1 difference found
@@ -44,6 +62,11 @@ int build_diff_db(int);
  *   0 else
  */
 int scan_subdir(const char *, const char *, int);
+/* Reads file `name` of the displayed directory again and replaces or
+ * removes its entry in the diff DB.  `i` is the side which had been
+ * changed, only used in fmode.  db_list needs to be rebuilt with
+ * diff_db_sort() afterwards. */
+void update_diff_ent(const char *name, int i);
 /* Input:
  *   Parameter:
  *     `name`: File name (without path)
@@ -62,7 +85,32 @@ int scan_subdir(const char *, const char *, int);
 int file_grep(const char *const name);
 int is_diff_dir(struct filediff *);
 int is_diff_pth(const char *, unsigned);
+/* Returns the statistics of directory `f` collected by the recursive
+ * scan (option disp_dirstats) or NULL */
+const struct dir_stat *get_dir_stat(struct filediff *f);
+/* Adds `path` (result of realpath(3)) and all its parent directories to
+ * the scan DB.  Frees `path`. */
+void add_diff_rpath(char *path);
 size_t pthcat(char *, size_t, const char *);
+/* Returns file type (S_IFDIR etc.) from `d_type` or 0 if unknown */
+mode_t dirent_type(const struct dirent *);
+/* Returns 1 if `pth` is not a directory, else the number of files other
+ * than directories in the tree `pth`.  `type` is 0 if unknown.  `pth`
+ * must have size PATHSIZ and is restored on return.  Called by the scan
+ * threads too. */
+unsigned long count_tree_files(char *pth, mode_t type);
+/* Returns a file descriptor for directory `path` to be used with
+ * stat_at() or AT_FDCWD if the directory cannot be opened. */
+int open_dir_fd(const char *const path);
+/* Like lstat(2) or, if `followlinks` is set, stat(2) for `name`
+ * relative to directory `dfd`.  Uses statx(2) if available to request
+ * only the fields used by the scanner.
+ *
+ * Output:
+ *   *lsiz: Size of symbolic link `name` if it had been followed,
+ *          else -1.  May be NULL.
+ * Return value: 0 or -1 on error (`errno` set) */
+int stat_at(int dfd, const char *const name, struct stat *st, off_t *lsiz);
 
 /* WARNING: Overwrites `lbuf` and `rbuf`!
  *
@@ -70,10 +118,14 @@ size_t pthcat(char *, size_t, const char *);
  * Output: Combination of:
  *   2  Error, don't make DB entry
  *   0  No diff
- *   1  Diff */
+ *   1  Diff
+ *   4  Samples are equal or not compared (only for md & 2) */
 
 int cmp_file(const char *const, const off_t, const char *const, const off_t,
 	const unsigned);
+/* Returns 1 if `gstat[0]` and `gstat[1]` are the same file (hard links).
+ * Such files are counted as equal without reading them. */
+int same_file(void);
 /*
  * Input:
  *   syspth[0]
@@ -101,6 +153,9 @@ int cmp_file(const char *const, const off_t, const char *const, const off_t,
  *   }
  */
 int cmp_symlink(char **, char **);
+/* Modification time of side `i` */
+struct timespec diff_mtim(const struct filediff *, int i);
+/* Only for entries which are not in a diff DB (see diff_db_mem()) */
 void free_diff(struct filediff *);
 char *read_link(char *, off_t);
 
@@ -0,0 +1,445 @@
+/*
+Copyright (c) 2016-2018, Carsten Kunze <carsten.kunze@arcor.de>
+
+Permission to use, copy, modify, and/or distribute this software for any
+purpose with or without fee is hereby granted, provided that the above
+copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+PERFORMANCE OF THIS SOFTWARE.
+*/
+
+/*
+ * Persistent cache of SHA-256 digests of file contents.
+ *
+ * Entries are keyed by device and inode number.  An entry is only valid
+ * if size, mtime and ctime of the file are still the same as at the time
+ * the digest had been computed.  The cache is read from ~/.vddiffdigest
+ * on first use and written back at program exit.  Entries which had not
+ * been used for DIGEST_MAX_AGE seconds are not written back.
+ *
+ * digest_cmp() is called by the parallel scanner (pscan.c) from several
+ * threads, hence the table is protected by a mutex.  Files are read
+ * outside the lock.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifdef HAVE_PTHREAD
+# include <pthread.h>
+#endif
+#include "compat.h"
+#include "main.h"
+#include "sha256.h"
+#include "fcmp.h"
+#include "digest.h"
+
+/* Smaller files are compared directly */
+#define DIGEST_MIN_SIZE (64 * 1024)
+#define DIGEST_MAX_AGE (30 * 24 * 60 * 60)
+
+struct digest_ent {
+    dev_t dev;
+    ino_t ino; /* 0: unused entry */
+    off_t size;
+    struct timespec mtim;
+    struct timespec ctim;
+    time_t used;
+    unsigned char md[SHA256_LEN];
+};
+
+static bool digest_get(const struct stat *, unsigned char *);
+static void digest_put(const struct stat *, const unsigned char *);
+static void digest_add(const struct stat *, const unsigned char *, time_t);
+static struct digest_ent *digest_find(dev_t, ino_t);
+static int digest_grow(void);
+static bool digest_valid(const struct digest_ent *, const struct stat *);
+static void digest_load(void);
+static char *digest_path(void);
+
+static const char digest_name[] = "." BIN "digest";
+bool digest_cache;
+long tot_digest_count;
+static struct digest_ent *dg_tab;
+static size_t dg_size; /* Power of 2 */
+static size_t dg_used;
+static bool dg_loaded;
+static bool dg_changed;
+static time_t dg_now;
+#ifdef HAVE_PTHREAD
+static pthread_mutex_t dg_mtx = PTHREAD_MUTEX_INITIALIZER;
+# define DG_LOCK() pthread_mutex_lock(&dg_mtx)
+# define DG_UNLOCK() pthread_mutex_unlock(&dg_mtx)
+#else
+# define DG_LOCK()
+# define DG_UNLOCK()
+#endif
+
+int
+digest_cmp(struct fcmp *f, const int fd[2], int *err_side)
+{
+    struct stat st[2];
+    unsigned char md[2][SHA256_LEN];
+    bool have[2];
+    struct sha256 ctx;
+    int rv = -1;
+    int i;
+
+    if (!digest_cache)
+        goto ret;
+
+    for (i = 0; i < 2; i++) {
+        if (fstat(fd[i], &st[i]) == -1 || !S_ISREG(st[i].st_mode) ||
+            st[i].st_size < DIGEST_MIN_SIZE)
+        {
+            goto ret;
+        }
+    }
+
+    if (st[0].st_size != st[1].st_size)
+        goto ret;
+
+    f->nbytes = 0;
+    f->diff_off = -1;
+    f->mapped = FALSE;
+
+    for (i = 0; i < 2; i++)
+        have[i] = digest_get(&st[i], md[i]);
+
+    if (have[0] || have[1]) {
+        for (i = 0; i < 2; i++) {
+            if (have[i])
+                continue;
+
+            sha256_init(&ctx);
+
+            if (fcmp_hash(f, fd[i], st[i].st_size, &ctx) == -1) {
+                *err_side = i;
+                rv = 2;
+                goto ret;
+            }
+
+            sha256_final(&ctx, md[i]);
+
+            digest_put(&st[i], md[i]);
+        }
+
+        DG_LOCK();
+        tot_digest_count++;
+        DG_UNLOCK();
+        rv = memcmp(md[0], md[1], SHA256_LEN) ? 1 : 0;
+
+        if (!rv)
+            f->nbytes = st[0].st_size;
+
+        goto ret;
+    }
+
+    /* No digest cached: Compare and hash one side.  The other side has
+     * the same digest if the files are equal.  Nothing is cached for
+     * different files since these are not read to the end. */
+
+    sha256_init(&ctx);
+
+    if ((rv = fcmp_run(f, fd, st[0].st_size, &ctx, err_side)))
+        goto ret;
+
+    sha256_final(&ctx, md[0]);
+
+    for (i = 0; i < 2; i++)
+        digest_put(&st[i], md[0]);
+
+ret:
+#if defined(TRACE) && 1
+    fprintf(debug, "<>digest_cmp: %d\n", rv);
+#endif
+    return rv;
+}
+
+int
+digest_cached(const int fd[2])
+{
+    struct stat st;
+    unsigned char md[2][SHA256_LEN];
+    int i;
+
+    if (!digest_cache)
+        return -1;
+
+    for (i = 0; i < 2; i++) {
+        if (fstat(fd[i], &st) == -1 || !S_ISREG(st.st_mode) ||
+            st.st_size < DIGEST_MIN_SIZE || !digest_get(&st, md[i]))
+        {
+            return -1;
+        }
+    }
+
+    DG_LOCK();
+    tot_digest_count++;
+    DG_UNLOCK();
+    return memcmp(md[0], md[1], SHA256_LEN) ? 1 : 0;
+}
+
+static bool
+digest_get(const struct stat *st, unsigned char *md)
+{
+    struct digest_ent *e;
+    bool found = FALSE;
+
+    DG_LOCK();
+
+    if (!dg_loaded)
+        digest_load();
+
+    if ((e = digest_find(st->st_dev, st->st_ino)) && e->ino &&
+        digest_valid(e, st))
+    {
+        memcpy(md, e->md, SHA256_LEN);
+
+        if (e->used != dg_now) {
+            e->used = dg_now;
+            dg_changed = TRUE;
+        }
+
+        found = TRUE;
+    }
+
+    DG_UNLOCK();
+    return found;
+}
+
+static void
+digest_put(const struct stat *st, const unsigned char *md)
+{
+    DG_LOCK();
+    digest_add(st, md, dg_now);
+    DG_UNLOCK();
+}
+
+/* Must be called with `dg_mtx` locked */
+
+static void
+digest_add(const struct stat *st, const unsigned char *md, time_t used)
+{
+    struct digest_ent *e;
+
+    if (2 * (dg_used + 1) > dg_size && digest_grow() == -1)
+        return;
+
+    e = digest_find(st->st_dev, st->st_ino);
+
+    if (!e->ino)
+        dg_used++;
+
+    e->dev = st->st_dev;
+    e->ino = st->st_ino;
+    e->size = st->st_size;
+    e->mtim = st->st_mtim;
+    e->ctim = st->st_ctim;
+    e->used = used;
+    memcpy(e->md, md, SHA256_LEN);
+    dg_changed = TRUE;
+}
+
+/* Returns the entry for `dev` and `ino` or the free slot where it is to
+ * be inserted.  Returns NULL for an empty table. */
+
+static struct digest_ent *
+digest_find(dev_t dev, ino_t ino)
+{
+    size_t i;
+
+    if (!dg_size)
+        return NULL;
+
+    i = (size_t)((((uint64_t)ino ^ (uint64_t)dev << 40) *
+        0x9e3779b97f4a7c15ULL) >> 32) & (dg_size - 1);
+
+    while (dg_tab[i].ino && (dg_tab[i].ino != ino || dg_tab[i].dev != dev))
+        i = (i + 1) & (dg_size - 1);
+
+    return &dg_tab[i];
+}
+
+static int
+digest_grow(void)
+{
+    struct digest_ent *o = dg_tab;
+    size_t n = dg_size;
+    size_t i;
+
+    if (!(dg_tab = calloc(n ? 2 * n : 1024, sizeof(*dg_tab)))) {
+        dg_tab = o;
+        return -1;
+    }
+
+    dg_size = n ? 2 * n : 1024;
+
+    for (i = 0; i < n; i++) {
+        if (o[i].ino)
+            *digest_find(o[i].dev, o[i].ino) = o[i];
+    }
+
+    free(o);
+    return 0;
+}
+
+static bool
+digest_valid(const struct digest_ent *e, const struct stat *st)
+{
+    return e->size == st->st_size &&
+           e->mtim.tv_sec  == st->st_mtim.tv_sec &&
+           e->mtim.tv_nsec == st->st_mtim.tv_nsec &&
+           e->ctim.tv_sec  == st->st_ctim.tv_sec &&
+           e->ctim.tv_nsec == st->st_ctim.tv_nsec;
+}
+
+/* Line format:
+ * dev ino size mtime.nsec ctime.nsec used digest
+ * Must be called with `dg_mtx` locked. */
+
+static void
+digest_load(void)
+{
+    char *pth;
+    FILE *fh;
+    char line[256];
+
+    dg_loaded = TRUE;
+    dg_now = time(NULL);
+
+    if (!(pth = digest_path()))
+        return;
+
+    if (!(fh = fopen(pth, "r")))
+        goto free;
+
+    while (fgets(line, sizeof line, fh)) {
+        uintmax_t dev, ino;
+        intmax_t size, msec, csec, used;
+        long mnsec, cnsec;
+        char hex[2 * SHA256_LEN + 1];
+        unsigned char md[SHA256_LEN];
+        struct stat st;
+        int i;
+
+        if (sscanf(line, "%ju %ju %jd %jd.%ld %jd.%ld %jd %64s",
+                   &dev, &ino, &size, &msec, &mnsec, &csec, &cnsec,
+                   &used, hex) != 9 || strlen(hex) != 2 * SHA256_LEN)
+        {
+            continue; /* It's a cache only */
+        }
+
+        for (i = 0; i < SHA256_LEN; i++) {
+            unsigned x;
+
+            if (sscanf(hex + 2 * i, "%2x", &x) != 1)
+                break;
+
+            md[i] = (unsigned char)x;
+        }
+
+        if (i < SHA256_LEN || !ino)
+            continue;
+
+        st.st_dev = (dev_t)dev;
+        st.st_ino = (ino_t)ino;
+        st.st_size = (off_t)size;
+        st.st_mtim.tv_sec = (time_t)msec;
+        st.st_mtim.tv_nsec = mnsec;
+        st.st_ctim.tv_sec = (time_t)csec;
+        st.st_ctim.tv_nsec = cnsec;
+        digest_add(&st, md, (time_t)used);
+    }
+
+    fclose(fh);
+    dg_changed = FALSE;
+
+free:
+    free(pth);
+}
+
+void
+digest_store(void)
+{
+    char *pth, *tpth = NULL;
+    FILE *fh;
+    size_t i, l;
+
+    if (!dg_changed || !(pth = digest_path()))
+        return;
+
+#if defined(TRACE)
+    fprintf(debug, "->digest_store(%s)\n", pth);
+#endif
+
+    l = strlen(pth);
+    tpth = malloc(l + 5);
+    memcpy(tpth, pth, l);
+    memcpy(tpth + l, ".new", 5);
+
+    if (!(fh = fopen(tpth, "w"))) {
+        fprintf(stderr, "%s: fopen \"%s\": %s\n", prog, tpth,
+            strerror(errno));
+        goto free;
+    }
+
+    for (i = 0; i < dg_size; i++) {
+        struct digest_ent *e = &dg_tab[i];
+        int j;
+
+        if (!e->ino || dg_now - e->used > DIGEST_MAX_AGE)
+            continue;
+
+        fprintf(fh, "%ju %ju %jd %jd.%09ld %jd.%09ld %jd ",
+            (uintmax_t)e->dev, (uintmax_t)e->ino, (intmax_t)e->size,
+            (intmax_t)e->mtim.tv_sec, (long)e->mtim.tv_nsec,
+            (intmax_t)e->ctim.tv_sec, (long)e->ctim.tv_nsec,
+            (intmax_t)e->used);
+
+        for (j = 0; j < SHA256_LEN; j++)
+            fprintf(fh, "%02x", e->md[j]);
+
+        fputc('\n', fh);
+    }
+
+    if (fclose(fh) == EOF) {
+        fprintf(stderr, "%s: fclose \"%s\": %s\n", prog, tpth,
+            strerror(errno));
+        unlink(tpth);
+        goto free;
+    }
+
+    if (rename(tpth, pth) == -1) {
+        fprintf(stderr, "%s: rename \"%s\": %s\n", prog, tpth,
+            strerror(errno));
+        unlink(tpth);
+        goto free;
+    }
+
+    dg_changed = FALSE;
+
+free:
+    free(tpth);
+    free(pth);
+#if defined(TRACE)
+    fprintf(debug, "<-digest_store\n");
+#endif
+}
+
+static char *
+digest_path(void)
+{
+    return add_home_pth(digest_name);
+}
@@ -0,0 +1,31 @@
+#ifndef DIGEST_H
+#define DIGEST_H
+
+#include "compat.h"
+
+struct fcmp;
+
+/* RC option "digest_cache" */
+extern bool digest_cache;
+/* Number of file comparisons which used a cached digest (-s) */
+extern long tot_digest_count;
+
+/* Compares two regular files which are opened as `fd[0]` and `fd[1]`
+ * using the digest cache and the buffers `f`.  Sets the output fields
+ * of `f` like fcmp_run().  `f->diff_off` is -1 if the digests differ.
+ *
+ * Return value:
+ *   -1 The digest cache is not used for these files.  Nothing has
+ *      been read.
+ *    0 equal
+ *    1 different
+ *    2 read error, `errno` is set and `*err_side` is 0 or 1 */
+int digest_cmp(struct fcmp *f, const int fd[2], int *err_side);
+/* Compares the files opened as `fd[0]` and `fd[1]` by their cached
+ * digests only.  Nothing is read.
+ * Return value: -1 not both digests are cached, 0 equal, 1 different */
+int digest_cached(const int fd[2]);
+/* Writes the digest cache file if the cache had been changed. */
+void digest_store(void);
+
+#endif /* DIGEST_H */
@@ -0,0 +1,688 @@
+/*
+Copyright (c) 2016-2018, Carsten Kunze <carsten.kunze@arcor.de>
+
+Permission to use, copy, modify, and/or distribute this software for any
+purpose with or without fee is hereby granted, provided that the above
+copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+PERFORMANCE OF THIS SOFTWARE.
+*/
+
+/*
+ * File content comparison.
+ *
+ * Files up to BUF_SIZE bytes are compared with the user supplied small
+ * buffers.  Bigger files are read in chunks of `cmp_buf_kib` KiB into
+ * page aligned buffers.  If there are at least two chunks, the right
+ * file is read by a helper thread into two alternating buffers while
+ * the calling thread reads the left file and compares.  So both files
+ * are read at the same time and the next chunk of the right file is
+ * read while the current one is compared.
+ *
+ * Files of at least `cmp_mmap_kib` KiB are mapped into memory instead
+ * and the mappings are compared directly.  This saves copying the data
+ * from the page cache into the buffers.  If a file is truncated during
+ * the compare, the resulting SIGBUS returns to fcmp_map() and the files
+ * are read instead.
+ *
+ * Before big files are read completely, the first, the last and some
+ * blocks in between are compared (`cmp_quick`).  Most different files
+ * are detected this way after reading a few KiB.
+ *
+ * If both files are sparse, regions which are holes in both files are
+ * found with SEEK_DATA and SEEK_HOLE and not read.
+ */
+
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE /* SEEK_DATA, SEEK_HOLE */
+#endif
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifdef HAVE_MMAP
+# include <sys/mman.h>
+# include <signal.h>
+# include <setjmp.h>
+#endif
+#ifdef HAVE_PTHREAD
+# include <pthread.h>
+#endif
+#include "compat.h"
+#include "main.h"
+#include "sha256.h"
+#include "mismatch.h"
+#include "fcmp.h"
+
+#ifdef HAVE_PTHREAD
+/* Reader thread for the right file */
+struct fcmp_rd {
+    pthread_mutex_t mtx;
+    pthread_cond_t cond;
+    int fd;
+    char *buf[2];
+    size_t bufsiz;
+    ssize_t len[2];
+    int err[2]; /* errno for len == -1 */
+    bool full[2];
+    bool stop;
+};
+
+static int fcmp_ovl(struct fcmp *, const int fd[2], struct sha256 *,
+    int *);
+static void *fcmp_rd_thr(void *);
+#endif
+#ifdef HAVE_MMAP
+static int fcmp_map(struct fcmp *, const int fd[2], off_t,
+    struct sha256 *);
+#endif
+#ifdef SEEK_HOLE
+static int fcmp_sparse(struct fcmp *, const int fd[2], off_t, int *);
+#endif
+static int fcmp_loop(struct fcmp *, const int fd[2], char *const buf[2],
+    size_t, struct sha256 *, int *);
+static bool fcmp_chunk(struct fcmp *, const char *, size_t, const char *,
+    size_t);
+static ssize_t fcmp_read(int, char *, size_t);
+static bool fcmp_alloc(struct fcmp *);
+static void fcmp_advise(int);
+
+/* Compare size for mapped files */
+#define FCMP_MAP_CHUNK (1024 * 1024)
+/* Files of at least this size are sampled */
+#define FCMP_SAMPLE_MIN (1024 * 1024)
+#define FCMP_SAMPLE_SIZE 4096
+/* Number of sampled blocks including the first and the last one */
+#define FCMP_SAMPLES 8
+
+#ifdef HAVE_MMAP
+/* Set while the thread compares mappings */
+static __thread sigjmp_buf *fcmp_bus_jmp;
+#endif
+
+unsigned cmp_buf_kib = 1024;
+unsigned cmp_mmap_kib;
+bool cmp_quick = TRUE;
+
+int
+fcmp_run(struct fcmp *f, const int fd[2], off_t siz, struct sha256 *ctx,
+    int *err_side)
+{
+    char *buf[2];
+    int rv;
+
+    f->nbytes = 0;
+    f->diff_off = -1;
+    f->mapped = FALSE;
+
+    if (cmp_quick && !f->exact &&
+        (rv = fcmp_sample(f, fd, siz, err_side)) > 0)
+    {
+        return rv;
+    }
+#ifdef SEEK_HOLE
+
+    if (!ctx && (rv = fcmp_sparse(f, fd, siz, err_side)) != -1)
+        return rv;
+#endif
+#ifdef HAVE_MMAP
+
+    if (cmp_mmap_kib && siz >= (off_t)cmp_mmap_kib * 1024 &&
+        (rv = fcmp_map(f, fd, siz, ctx)) != -1)
+    {
+        return rv;
+    }
+#endif
+
+    if (siz <= BUF_SIZE || !fcmp_alloc(f)) {
+        return fcmp_loop(f, fd, f->sbuf, BUF_SIZE, ctx, err_side);
+    }
+
+    fcmp_advise(fd[0]);
+    fcmp_advise(fd[1]);
+#ifdef HAVE_PTHREAD
+
+    if (siz >= 2 * (off_t)f->bufsiz &&
+        (rv = fcmp_ovl(f, fd, ctx, err_side)) != -1)
+    {
+        return rv;
+    }
+#endif
+    buf[0] = f->buf[0];
+    buf[1] = f->buf[1];
+    rv = fcmp_loop(f, fd, buf, f->bufsiz, ctx, err_side);
+    return rv;
+}
+
+int
+fcmp_sample(struct fcmp *f, const int fd[2], off_t siz, int *err_side)
+{
+    const size_t bs = FCMP_SAMPLE_SIZE;
+    const off_t seg = (siz - (off_t)bs) / (FCMP_SAMPLES - 1);
+    unsigned long r = (unsigned long)siz;
+    int k;
+
+    f->nbytes = 0;
+    f->diff_off = -1;
+    f->mapped = FALSE;
+
+    if (siz < FCMP_SAMPLE_MIN)
+        return -1;
+
+    for (k = 0; k < FCMP_SAMPLES; k++) {
+        ssize_t n[2];
+        size_t o;
+        off_t pos;
+        int i;
+
+        if (!k) {
+            pos = 0;
+        } else if (k == FCMP_SAMPLES - 1) {
+            pos = siz - (off_t)bs;
+        } else {
+            /* Pseudo random offset in the k-th segment.  It only needs
+             * to be the same for both files. */
+            r = r * 1103515245 + 12345;
+            pos = k * seg + (off_t)(r % (unsigned long)seg);
+            pos -= pos % (off_t)bs;
+        }
+
+        for (i = 0; i < 2; i++) {
+            if ((n[i] = pread(fd[i], f->sbuf[i], bs, pos)) == -1) {
+                *err_side = i;
+                return 2;
+            }
+        }
+
+        o = mem_mismatch(f->sbuf[0], f->sbuf[1],
+            (size_t)(n[0] < n[1] ? n[0] : n[1]));
+
+        if (n[0] != n[1] || o < (size_t)n[0]) {
+            if (!k)
+                f->diff_off = (off_t)o;
+
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+int
+fcmp_hash(struct fcmp *f, int fd, off_t siz, struct sha256 *ctx)
+{
+    char *buf = f->sbuf[0];
+    size_t bufsiz = BUF_SIZE;
+    ssize_t n;
+
+    if (siz > BUF_SIZE && fcmp_alloc(f)) {
+        buf = f->buf[0];
+        bufsiz = f->bufsiz;
+        fcmp_advise(fd);
+    }
+
+    while ((n = read(fd, buf, bufsiz)) > 0)
+        sha256_update(ctx, buf, (size_t)n);
+
+    return n == -1 ? -1 : 0;
+}
+
+void
+fcmp_free(struct fcmp *f)
+{
+    int i;
+
+    for (i = 0; i < 3; i++) {
+        free(f->buf[i]);
+        f->buf[i] = NULL;
+    }
+
+    f->bufsiz = 0;
+}
+
+#ifdef HAVE_MMAP
+/* Signal handler */
+
+void
+fcmp_sig_bus(int signo)
+{
+    if (fcmp_bus_jmp)
+        siglongjmp(*fcmp_bus_jmp, 1);
+
+    /* Not caused by fcmp_map(), fault again with the default action */
+    signal(signo, SIG_DFL);
+}
+
+/* Returns -1 if the files cannot be mapped or if a file had been
+ * truncated during the compare. */
+
+static int
+fcmp_map(struct fcmp *f, const int fd[2], off_t siz, struct sha256 *ctx)
+{
+    const char *p[2];
+    struct stat st;
+    sigjmp_buf jb;
+    struct sha256 ctx0;
+    const off_t nbytes0 = f->nbytes;
+    size_t l = (size_t)siz;
+    size_t o, n;
+    int rv = 0;
+    int i;
+
+    if ((off_t)l != siz)
+        return -1;
+
+    for (i = 0; i < 2; i++) {
+        void *m;
+
+        /* Don't map beyond EOF of a meanwhile truncated file */
+        if (fstat(fd[i], &st) == -1 || st.st_size != siz ||
+            (m = mmap(NULL, l, PROT_READ, MAP_PRIVATE, fd[i], 0))
+            == MAP_FAILED)
+        {
+            if (i)
+                munmap((void *)p[0], l);
+
+            return -1;
+        }
+
+        posix_madvise(m, l, POSIX_MADV_SEQUENTIAL);
+        p[i] = m;
+    }
+
+    if (ctx)
+        ctx0 = *ctx;
+
+    if (sigsetjmp(jb, 1)) {
+        fcmp_bus_jmp = NULL;
+
+        for (i = 0; i < 2; i++)
+            munmap((void *)p[i], l);
+
+        /* Undo the partial compare, fcmp_run() reads the files */
+        if (ctx)
+            *ctx = ctx0;
+
+        f->nbytes = nbytes0;
+        return -1;
+    }
+
+    fcmp_bus_jmp = &jb;
+
+    for (o = 0; o < l; o += n) {
+        n = l - o < FCMP_MAP_CHUNK ? l - o : FCMP_MAP_CHUNK;
+
+        if (fcmp_chunk(f, p[0] + o, n, p[1] + o, n)) {
+            rv = 1;
+            break;
+        }
+
+        if (ctx)
+            sha256_update(ctx, p[0] + o, n);
+
+        f->nbytes += n;
+    }
+
+    fcmp_bus_jmp = NULL;
+
+    for (i = 0; i < 2; i++)
+        munmap((void *)p[i], l);
+
+    f->mapped = TRUE;
+    return rv;
+}
+#endif
+
+#ifdef SEEK_HOLE
+/* Compares files which both have holes.  Regions which are holes in both
+ * files are skipped.  Returns -1 with the file offsets at 0 if a file is
+ * not sparse or if the file system doesn't support SEEK_DATA. */
+
+static int
+fcmp_sparse(struct fcmp *f, const int fd[2], off_t siz, int *err_side)
+{
+    struct stat st;
+    char *buf[2];
+    size_t bs;
+    off_t off = 0;
+    int i;
+
+    for (i = 0; i < 2; i++) {
+        if (fstat(fd[i], &st) == -1 || (off_t)st.st_blocks * 512 >= siz)
+            return -1;
+    }
+
+    if (fcmp_alloc(f)) {
+        buf[0] = f->buf[0];
+        buf[1] = f->buf[1];
+        bs = f->bufsiz;
+    } else {
+        buf[0] = f->sbuf[0];
+        buf[1] = f->sbuf[1];
+        bs = BUF_SIZE;
+    }
+
+    while (off < siz) {
+        off_t end = siz;
+        bool hole = TRUE; /* in both files */
+
+        /* `end` is the next offset where one of the files changes from
+         * data to hole or vice versa */
+        for (i = 0; i < 2; i++) {
+            off_t d = lseek(fd[i], off, SEEK_DATA);
+            off_t e;
+
+            if (d == -1) {
+                if (errno != ENXIO) {
+                    if (!off) {
+                        /* SEEK_DATA had moved the offset of fd[0] and
+                         * the fallback uses read(2) */
+                        lseek(fd[0], 0, SEEK_SET);
+                        lseek(fd[1], 0, SEEK_SET);
+                        return -1;
+                    }
+
+                    *err_side = i;
+                    return 2;
+                }
+
+                d = siz; /* Hole up to EOF */
+            }
+
+            if (d > off) {
+                e = d;
+            } else {
+                hole = FALSE;
+
+                if ((e = lseek(fd[i], off, SEEK_HOLE)) == -1) {
+                    *err_side = i;
+                    return 2;
+                }
+            }
+
+            if (e < end)
+                end = e;
+        }
+
+        if (hole) {
+            f->nbytes += end - off;
+            off = end;
+            continue;
+        }
+
+        while (off < end) {
+            size_t l = end - off < (off_t)bs ? (size_t)(end - off) : bs;
+            ssize_t n[2];
+
+            for (i = 0; i < 2; i++) {
+                if ((n[i] = pread(fd[i], buf[i], l, off)) == -1) {
+                    *err_side = i;
+                    return 2;
+                }
+            }
+
+            if (fcmp_chunk(f, buf[0], (size_t)n[0], buf[1], (size_t)n[1]))
+                return 1;
+
+            if (!n[0]) /* File truncated */
+                return 0;
+
+            f->nbytes += n[0];
+            off += n[0];
+        }
+    }
+
+    return 0;
+}
+#endif
+
+static int
+fcmp_loop(struct fcmp *f, const int fd[2], char *const buf[2],
+    size_t bufsiz, struct sha256 *ctx, int *err_side)
+{
+    while (1) {
+        ssize_t n[2];
+        int i;
+
+        for (i = 0; i < 2; i++) {
+            if ((n[i] = fcmp_read(fd[i], buf[i], bufsiz)) == -1) {
+                *err_side = i;
+                return 2;
+            }
+        }
+
+        if (fcmp_chunk(f, buf[0], (size_t)n[0], buf[1], (size_t)n[1]))
+            return 1;
+
+        if (ctx && n[0])
+            sha256_update(ctx, buf[0], (size_t)n[0]);
+
+        /* Count successfully compared bytes only. */
+        f->nbytes += n[0];
+
+        if ((size_t)n[0] < bufsiz)
+            return 0;
+    }
+}
+
+#ifdef HAVE_PTHREAD
+/* Returns -1 if the thread could not be created.  Nothing has been
+ * read in this case. */
+
+static int
+fcmp_ovl(struct fcmp *f, const int fd[2], struct sha256 *ctx,
+    int *err_side)
+{
+    struct fcmp_rd rd;
+    pthread_t tid;
+    int i = 0;
+    int rv = -1;
+    int e;
+
+    memset(&rd, 0, sizeof rd);
+    pthread_mutex_init(&rd.mtx, NULL);
+    pthread_cond_init(&rd.cond, NULL);
+    rd.fd = fd[1];
+    rd.buf[0] = f->buf[1];
+    rd.buf[1] = f->buf[2];
+    rd.bufsiz = f->bufsiz;
+
+    if (pthread_create(&tid, NULL, fcmp_rd_thr, &rd))
+        goto destroy;
+
+    while (1) {
+        ssize_t n[2];
+
+        if ((n[0] = fcmp_read(fd[0], f->buf[0], f->bufsiz)) == -1) {
+            *err_side = 0;
+            rv = 2;
+            break;
+        }
+
+        pthread_mutex_lock(&rd.mtx);
+
+        while (!rd.full[i])
+            pthread_cond_wait(&rd.cond, &rd.mtx);
+
+        n[1] = rd.len[i];
+        errno = rd.err[i];
+        pthread_mutex_unlock(&rd.mtx);
+
+        if (n[1] == -1) {
+            *err_side = 1;
+            rv = 2;
+            break;
+        }
+
+        if (fcmp_chunk(f, f->buf[0], (size_t)n[0], rd.buf[i],
+            (size_t)n[1]))
+        {
+            rv = 1;
+            break;
+        }
+
+        if (ctx && n[0])
+            sha256_update(ctx, f->buf[0], (size_t)n[0]);
+
+        f->nbytes += n[0];
+
+        if ((size_t)n[0] < f->bufsiz) {
+            rv = 0;
+            break;
+        }
+
+        pthread_mutex_lock(&rd.mtx);
+        rd.full[i] = FALSE;
+        pthread_cond_broadcast(&rd.cond);
+        pthread_mutex_unlock(&rd.mtx);
+        i ^= 1;
+    }
+
+    e = errno;
+    pthread_mutex_lock(&rd.mtx);
+    rd.stop = TRUE;
+    pthread_cond_broadcast(&rd.cond);
+    pthread_mutex_unlock(&rd.mtx);
+    pthread_join(tid, NULL);
+    errno = e;
+
+destroy:
+    pthread_cond_destroy(&rd.cond);
+    pthread_mutex_destroy(&rd.mtx);
+    return rv;
+}
+
+static void *
+fcmp_rd_thr(void *arg)
+{
+    struct fcmp_rd *rd = arg;
+    int i = 0;
+
+    while (1) {
+        ssize_t n;
+
+        pthread_mutex_lock(&rd->mtx);
+
+        while (rd->full[i] && !rd->stop)
+            pthread_cond_wait(&rd->cond, &rd->mtx);
+
+        if (rd->stop) {
+            pthread_mutex_unlock(&rd->mtx);
+            break;
+        }
+
+        pthread_mutex_unlock(&rd->mtx);
+        n = fcmp_read(rd->fd, rd->buf[i], rd->bufsiz);
+        pthread_mutex_lock(&rd->mtx);
+        rd->len[i] = n;
+        rd->err[i] = errno;
+        rd->full[i] = TRUE;
+        pthread_cond_broadcast(&rd->cond);
+        pthread_mutex_unlock(&rd->mtx);
+
+        if (n < (ssize_t)rd->bufsiz) /* EOF or error */
+            break;
+
+        i ^= 1;
+    }
+
+    return NULL;
+}
+#endif
+
+/* Compares the chunks at file offset `f->nbytes`.  Returns TRUE and
+ * sets `f->diff_off` if they differ. */
+
+static bool
+fcmp_chunk(struct fcmp *f, const char *a, size_t na, const char *b,
+    size_t nb)
+{
+    size_t n = na < nb ? na : nb;
+    size_t o = mem_mismatch(a, b, n);
+
+    if (o == n && na == nb)
+        return FALSE;
+
+    f->diff_off = f->nbytes + (off_t)o;
+    return TRUE;
+}
+
+/* Reads until `count` bytes or EOF */
+
+static ssize_t
+fcmp_read(int fd, char *buf, size_t count)
+{
+    size_t l = 0;
+
+    while (l < count) {
+        ssize_t n = read(fd, buf + l, count - l);
+
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+
+            return -1;
+        }
+
+        if (!n)
+            break;
+
+        l += (size_t)n;
+    }
+
+    return (ssize_t)l;
+}
+
+static bool
+fcmp_alloc(struct fcmp *f)
+{
+    size_t pg, siz;
+    int i;
+
+    if (!cmp_buf_kib)
+        return FALSE;
+
+    if ((pg = (size_t)sysconf(_SC_PAGESIZE)) == (size_t)-1 || !pg)
+        pg = 4096;
+
+    siz = (size_t)cmp_buf_kib * 1024;
+    siz = (siz + pg - 1) / pg * pg;
+
+    if (f->bufsiz == siz)
+        return TRUE;
+
+    fcmp_free(f);
+
+    for (i = 0; i < 3; i++) {
+        void *p;
+
+        if (posix_memalign(&p, pg, siz)) {
+            fcmp_free(f);
+            return FALSE;
+        }
+
+        f->buf[i] = p;
+    }
+
+    f->bufsiz = siz;
+    return TRUE;
+}
+
+static void
+fcmp_advise(int fd)
+{
+#ifdef HAVE_POSIX_FADVISE
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#else
+    (void)fd;
+#endif
+}
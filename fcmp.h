@@ -0,0 +1,62 @@
+#ifndef FCMP_H
+#define FCMP_H
+
+#include <sys/types.h>
+#include "compat.h"
+
+struct sha256;
+
+/* Compare buffers of one thread */
+struct fcmp {
+    /* Buffers of size BUF_SIZE, supplied by the user */
+    char *sbuf[2];
+    /* Page aligned buffers of size `bufsiz`, allocated on demand:
+     * [0] left file, [1] and [2] right file */
+    char *buf[3];
+    size_t bufsiz;
+    /* Input: No sampling, `diff_off` is needed */
+    bool exact;
+    /* Output: Number of equal bytes compared by fcmp_run() */
+    off_t nbytes;
+    /* Output: Offset of the first different byte if fcmp_run() returned
+     * 1, else -1.  Also -1 if a sample other than the first block
+     * differs. */
+    off_t diff_off;
+    /* Output: fcmp_run() had compared memory mappings */
+    bool mapped;
+};
+
+/* RC option "cmp_buffer_size" in KiB. 0 disables the large buffers. */
+extern unsigned cmp_buf_kib;
+/* Compare sampled blocks first, RC option "noquick_cmp" */
+extern bool cmp_quick;
+/* RC option "cmp_mmap" in KiB. Files of at least this size are compared
+ * with mmap(2). 0 disables mmap(2). */
+extern unsigned cmp_mmap_kib;
+
+/* Compares the contents of the files opened as `fd[0]` and `fd[1]` with
+ * size `siz`.  If `ctx` is not NULL the data of `fd[0]` is added to it.
+ * Return value:
+ *   0 equal
+ *   1 different
+ *   2 read error, `errno` is set and `*err_side` is 0 or 1 */
+int fcmp_run(struct fcmp *, const int fd[2], off_t siz,
+    struct sha256 *ctx, int *err_side);
+/* Compares the first, the last and some blocks in between only.
+ * Return value:
+ *   -1 File too small for sampling
+ *    0 Samples are equal
+ *    1 different
+ *    2 read error as for fcmp_run() */
+int fcmp_sample(struct fcmp *, const int fd[2], off_t siz, int *err_side);
+/* Adds the contents of file `fd` with size `siz` to `ctx`.
+ * Returns -1 on read error. */
+int fcmp_hash(struct fcmp *, int fd, off_t siz, struct sha256 *ctx);
+/* Frees the large buffers. */
+void fcmp_free(struct fcmp *);
+#ifdef HAVE_MMAP
+/* SIGBUS handler, installed at start */
+void fcmp_sig_bus(int);
+#endif
+
+#endif /* FCMP_H */
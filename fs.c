@@ -14,6 +14,9 @@ OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
 PERFORMANCE OF THIS SOFTWARE.
 */
 
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE /* copy_file_range(2), SEEK_DATA */
+#endif
 #include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
@@ -27,6 +30,13 @@ PERFORMANCE OF THIS SOFTWARE.
 #include <time.h>
 #include <signal.h>
 #include <stdint.h>
+#ifdef HAVE_FICLONE
+# include <sys/ioctl.h>
+# include <linux/fs.h>
+#endif
+#ifdef HAVE_SENDFILE
+# include <sys/sendfile.h>
+#endif
 #ifndef HAVE_FUTIMENS
 # include <utime.h>
 #endif
@@ -45,6 +55,9 @@ PERFORMANCE OF THIS SOFTWARE.
 #include "format_time.h"
 #include "unit_prefix.h"
 #include "abs2relPath.h"
+#include "pcopy.h"
+#include "rmtree.h"
+#include "watch.h"
 
 struct str_list {
 	char *s;
@@ -56,13 +69,16 @@ static int proc_dir(void);
 /* Return value:
  *   -1: error */
 static int rm_dir(void);
+static int rm_tree(void);
 /* Return value:
  *   !0: error */
 static int cp_file(void);
 /* Return value:
  *    1: User response: "Don't overwrite"
  *   -1: error */
-static int creatdir(void);
+/* `*st` is set to the status of the source directory if the target
+ * directory is created, else `st->st_mode` is set to 0 */
+static int creatdir(struct stat *st);
 /* Return value:
  *    1: User response: "Don't overwrite"
  *   -1: error */
@@ -85,6 +101,10 @@ static int fs_deldialog(const char *menu, const char *op, const char *typ,
     const char *nam);
 /* Changes `lbuf` and `rbuf` */
 static int fs_testBreak(void);
+static void fs_pcopy_reap(void);
+static int cp_delta(void);
+static int cp_delta_wr(int *);
+static int cp_delta_tmp(void);
 
 time_t fs_t1, fs_t2;
 time_t fs_start_time;
@@ -113,6 +133,15 @@ bool fs_none;
 bool fs_abort;
 bool preserve_mtim;
 bool preserve_all;
+enum copy_method copy_method;
+long tot_clone_count;
+long tot_kcopy_count;
+long tot_delta_count;
+off_t tot_delta_byte_count;
+off_t tot_delta_wr_count;
+/* Set by fs_cp() in update mode ('U', -U): Existing files are updated
+ * by cp_delta() */
+static bool fs_delta;
 
 void
 clr_fs_err(void) {
@@ -149,7 +178,7 @@ fs_mkdir(short tree)
 		goto exit;
 	}
 
-	rebuild_db(0);
+	rebuild_db(8);
 
 exit:
 	pth1[len1] = 0;
@@ -244,7 +273,7 @@ ntr: /* next tree */
 	}
 
 	if (!(md & 2)) {
-		rebuild_db(0);
+		rebuild_db(8);
 	}
 exit:
     free(const_cast_ptr(s));
@@ -346,7 +375,7 @@ ntr:
 	}
 
 	if (!(md & 2)) {
-		rebuild_db(0);
+		rebuild_db(8);
 	}
 exit:
 	syspth[0][pthlen[0]] = 0;
@@ -516,7 +545,7 @@ ntr:
 	}
 
 	if (!(md & 2)) {
-		rebuild_db(0);
+		rebuild_db(8);
 	}
 exit:
 	syspth[0][pthlen[0]] = 0;
@@ -731,8 +760,10 @@ ntr:
 		if (empty_dir_) {
 			rm_dir();
 		} else if (S_ISDIR(gstat[0].st_mode)) {
-			tree_op = TREE_RM;
-			proc_dir();
+			if (rm_tree()) {
+				tree_op = TREE_RM;
+				proc_dir();
+			}
 		} else {
 			rm_file();
 		}
@@ -756,7 +787,7 @@ ntr:
     }
 
 	if (!(md & 2)) {
-		rebuild_db(0);
+		rebuild_db(8);
 	}
 
 	if (gl_mark) {
@@ -803,6 +834,7 @@ int fs_cp(int to, long u, int n, unsigned md, unsigned *sto_res_)
 	fprintf(debug, "->fs_cp(to=%d u=%ld n=%d md=0x%x)\n",
 	    to, u, n, md);
 #endif
+	fs_delta = md & 8 ? TRUE : FALSE;
 
 	if (fs_ro() || !db_num[right_col]) {
 #if defined(TRACE)
@@ -979,8 +1011,14 @@ tpth:
             else
             {
                 tree_op = TREE_CP;
+                pcopy_start();
             }
 			proc_dir();
+
+            if (pcopy_on) {
+                pcopy_end(fs_error || fs_abort);
+                fs_pcopy_reap();
+            }
 		} else {
 			if (cp_file()) {
 				continue;
@@ -1024,7 +1062,7 @@ next:
 #endif
 		rebuild_db(
 		    !fmode || !sto || sto == 3 || (md & (16 | 32))
-            ? 0 : (short)(sto << 1));
+            ? 8 : (short)(sto << 1 | 8));
 	}
 
 	r = (fs_error    ? 1 : 0) |
@@ -1038,6 +1076,8 @@ ret:
 	}
 
 ret0:
+	fs_delta = FALSE;
+
 	if (sto_res_) {
 		*sto_res_ = sto;
 	}
@@ -1101,7 +1141,7 @@ fs_cat(
 
 	cp_reg(1);
 	/* in fmode both sides can show same directory */
-	rebuild_db(0);
+	rebuild_db(8);
 
 ret:
 #if defined(TRACE)
@@ -1130,11 +1170,22 @@ rebuild_db(
      * 1: keep selected name unchanged
      *    (for changing the list sort mode) */
     /* 2: rebuild left side only
-     * 4: rebuild right side only */
+     * 4: rebuild right side only
+     * 8: after file system operations: only read the files reported
+     *    by watch.c if possible
+     * 16: only the sort mode had been changed: sort the entries again
+     *     without reading the directories */
     short mode)
 {
     char *name = NULL;
 
+    if (mode & 8) {
+        if (!watch_sync())
+            return;
+
+        mode &= ~8;
+    }
+
 #   if defined(TRACE)
     fprintf(debug, "->rebuild_db(%d) curs[right_col]=%u\n", mode, curs[right_col]);
     TRCVPTH;
@@ -1155,13 +1206,21 @@ rebuild_db(
 	}
     if (!(mode & 4))
     {
-		diff_db_free(0);
-		build_diff_db(bmode || fmode ? 1 : subtree);
+        if (mode & 16)
+            diff_db_resort(0);
+        else {
+            diff_db_free(0);
+            build_diff_db(bmode || fmode ? 1 : subtree);
+        }
 	}
     if (fmode && !(mode & 2))
     {
-		diff_db_free(1);
-		build_diff_db(2);
+        if (mode & 16)
+            diff_db_resort(1);
+        else {
+            diff_db_free(1);
+            build_diff_db(2);
+        }
 	}
     if (mode && name)
     {
@@ -1186,20 +1245,22 @@ static int proc_dir(void)
     int rv = 0;
     long dir_count = 0;
     void *dir_db = NULL;
+    struct stat dst;
 #if defined (TRACE)
     fprintf(debug, "->proc_dir(%s)\n", pth1);
 #endif
 #ifdef HAVE_LIBAVLBST
     dir_db = db_new(name_cmp);
 #endif
-    if ((tree_op == TREE_CP || CREATE_EMPTY == tree_op) && creatdir())
+    dst.st_mode = 0;
+    if ((tree_op == TREE_CP || CREATE_EMPTY == tree_op) && creatdir(&dst))
     {
         rv = -1;
         goto ret;
     }
     if (CREATE_EMPTY == tree_op)
     {
-        goto ret;
+        goto dir_attr;
     }
     if (tree_op == TREE_RM)
         chmod(pth1, 0777); /* Just try it, don't check for errors */
@@ -1320,6 +1381,11 @@ static int proc_dir(void)
     free_strs(&dir_db);
     if (tree_op == TREE_RM && rm_dir() < 0)
         rv = -1;
+dir_attr:
+    /* The target directory is complete.  With threads pcopy_end() does
+     * it after all files had been copied. */
+    if (dst.st_mode && !pcopy_on && !fs_error && !fs_abort)
+        cp_dir_attr(pth2, &dst);
 ret:
 #ifdef HAVE_LIBAVLBST
     free(dir_db);
@@ -1329,6 +1395,53 @@ ret:
     return rv;
 }
 
+/* Removes directory tree `pth1` with the threads of rmtree.c.
+ * Return value:
+ *   1: Not done, to be done by proc_dir()
+ *   0: Done (errors had been reported) */
+
+static int rm_tree(void)
+{
+    const bool count = fs_op != fs_op_cp; /* not cli_cp overwrite */
+    char *msg;
+
+    if (fs_error)
+        return 0;
+
+    pth1[len1] = 0;
+
+    /* Bytes only for the summary, the UI shows the number of files */
+    if (rmtree_start(pth1, (count ? 1 : 0) |
+                           (count && summary ? 2 : 0)) == -1)
+    {
+        return 1;
+    }
+
+    while (!rmtree_wait(&tot_cmp_byte_count, &tot_cmp_file_count)) {
+        while ((msg = rmtree_err())) {
+            fs_fwrap("%s", msg);
+            free(msg);
+
+            if (exit_on_error)
+                fs_abort = TRUE;
+        }
+
+        if (wstat && (fs_t2 = time(NULL)) - fs_t1) {
+            printerr(NULL, "Delete \"%s\"", pth1);
+            fs_t1 = fs_t2;
+
+            /* Test for ESC once a second */
+            fs_testBreak();
+        }
+
+        if (fs_error || fs_abort)
+            rmtree_stop();
+    }
+
+    rmtree_end();
+    return 0;
+}
+
 static int rm_dir(void)
 {
 #if defined(TRACE)
@@ -1484,8 +1597,13 @@ fs_testBreak(void)
                                           time(NULL) - fs_start_time);
         UnitPrefix.unit_prefix(lbuf, BUF_SIZE / 2, NULL, tot_cmp_file_count,
                                UnitPrefix.decimal);
-        UnitPrefix.unit_prefix(rbuf, BUF_SIZE, NULL, tot_cmp_byte_count, 0);
-        wprintw(wstat, " %s %s files %sB done.", time_buf, lbuf, rbuf);
+        wprintw(wstat, " %s %s files", time_buf, lbuf);
+        if (tot_cmp_byte_count) {
+            UnitPrefix.unit_prefix(rbuf, BUF_SIZE, NULL, tot_cmp_byte_count,
+                                   0);
+            wprintw(wstat, " %sB", rbuf);
+        }
+        waddstr(wstat, " done.");
     }
     wrefresh(wstat);
     nodelay(stdscr, TRUE);
@@ -1501,10 +1619,12 @@ fs_testBreak(void)
 }
 
 static int
-creatdir(void)
+creatdir(struct stat *st)
 {
     int return_value = 0;
 
+    st->st_mode = 0;
+
     if (fs_stat(pth1, &gstat[0], 0) == -1) {
         return_value = -1;
         goto func_return;
@@ -1537,8 +1657,8 @@ creatdir(void)
             fprintf(debug, "  lchown(%s): %s\n", pth2, strerror(errno));
 #           endif
         }
+        /* The actual permissions are set by cp_dir_attr() */
         if (chmod(pth2, (gstat[0].st_mode & 07777)
-                  /* TODO: Restore actual permissions before closing this directory. */
                   | 0700 /* make sure that target directory is usable. */
                   ) == -1)
         {
@@ -1547,6 +1667,10 @@ creatdir(void)
 #           endif
         }
     }
+    if (pcopy_on)
+        pcopy_dir(pth2, &gstat[0]);
+    else
+        *st = gstat[0];
     if (!wstat && verbose) {
         printf("Directory \"%s\" created\n", pth2);
     }
@@ -1676,11 +1800,24 @@ exit:
 inline static int cp_reg_check_overwrite(const unsigned mode)
 {
     int rv = 0;
-    if (overwrite_if_old &&
+    if (!(mode & 1) && /* Same file, don't truncate it */
+            gstat[0].st_ino == gstat[1].st_ino &&
+            gstat[0].st_dev == gstat[1].st_dev)
+    {
+#if defined(TRACE)
+        fprintf(debug, "  Same file: %s and %s\n", pth1, pth2);
+#endif
+        ++tot_same_ino_count;
+        rv = 1;
+    } else if (overwrite_if_old &&
             /* gstat[0].st_mtim < gstat[1].st_mtim -> dest is newer */
             cmp_timespec(gstat[0].st_mtim, gstat[1].st_mtim) < 0)
     {
         rv = 2;
+    } else if (fs_delta && !mode) {
+        /* cp_delta() compares the files while it updates the target and
+         * asks before the first write.  Hence changed files are read only
+         * once. */
     } else if (!(mode & 1) && /* file contents are not relevant in append mode */
             !cmp_file(pth1, gstat[0].st_size,
                       pth2, gstat[1].st_size, 1))
@@ -1697,6 +1834,11 @@ inline static int cp_reg_check_overwrite(const unsigned mode)
     return rv;
 }
 
+/* Return value:
+ *    3: Target is a running program (ETXTBSY), see cp_delta_tmp()
+ *    0: Target can be overwritten or had been removed
+ *   -1: Error */
+
 inline static int cp_reg_prepare_overwrite(void)
 {
     int rv = 0;
@@ -1707,6 +1849,10 @@ test:
         rv = 0; /* Could have been set to -1 by errors below. */
         goto ret;
     }
+    if (errno == ETXTBSY) {
+        rv = 3;
+        goto ret;
+    }
     if (errno != EACCES) {
         /* Unexpected system call error */
         rv = -1;
@@ -1734,8 +1880,14 @@ ret:
 inline static int cp_reg_over_reg(const unsigned mode)
 {
     int rv = cp_reg_check_overwrite(mode);
-    if (!rv)
+    /* cp_delta() prepares the target before the first write */
+    if (!rv && !(fs_delta && !mode))
         rv = cp_reg_prepare_overwrite();
+    if (rv == 3 && (mode & 1)) {
+        /* Can't append to a copy */
+        printerr(strerror(ETXTBSY), "open \"%s\"", pth2);
+        rv = -1;
+    }
     return rv;
 }
 
@@ -1769,6 +1921,190 @@ inline static int cp_reg_to_existing(const unsigned mode)
     return rv;
 }
 
+#ifdef SEEK_HOLE
+/* Copies the data regions of sparse file `f1` to the empty file `f2`.
+ * Holes are skipped and recreated by ftruncate(2) at the end.  On error
+ * the file offsets are set to the start of the failed region.  The read
+ * loop continues there and reports the error.
+ *
+ * Return value:
+ *   -1: SEEK_DATA not supported, nothing done
+ *    3: Done, file offsets are set to `siz`
+ *    0: Error */
+
+static int cp_sparse(const int f1, const int f2, const off_t siz,
+                     char *buf, off_t *n)
+{
+    off_t data, hole = 0, o = 0;
+
+    while (hole < siz) {
+        if ((data = lseek(f1, hole, SEEK_DATA)) == -1) {
+            if (errno == ENXIO) /* Hole up to EOF */
+                break;
+
+            if (!hole)
+                return -1;
+
+            o = hole;
+            goto err;
+        }
+
+        if ((hole = lseek(f1, data, SEEK_HOLE)) == -1) {
+            o = data;
+            goto err;
+        }
+
+        for (o = data; o < hole; ) {
+            ssize_t l;
+#ifdef HAVE_COPY_FILE_RANGE
+            if (copy_method <= cpm_range) {
+                loff_t i = o, j = o;
+
+                if ((l = copy_file_range(f1, &i, f2, &j, (size_t)(hole - o),
+                                         0)) > 0) {
+                    o += l;
+                    *n += l;
+                    continue;
+                }
+            }
+#endif
+            l = pread(f1, buf, hole - o < BUF_SIZE ? (size_t)(hole - o) :
+                                                     BUF_SIZE, o);
+
+            if (l <= 0 || pwrite(f2, buf, (size_t)l, o) != l)
+                goto err;
+
+            o += l;
+            *n += l;
+        }
+    }
+
+    if (ftruncate(f2, siz) == -1)
+        goto err; /* Let the read loop write the zeros */
+
+    lseek(f1, siz, SEEK_SET);
+    lseek(f2, siz, SEEK_SET);
+    return 3;
+
+err:
+#if defined(TRACE)
+    fprintf(debug, "  cp_sparse: error at %jd: %s\n", (intmax_t)o,
+            strerror(errno));
+#endif
+    lseek(f1, o, SEEK_SET);
+    lseek(f2, o, SEEK_SET);
+    return 0;
+}
+#endif
+
+/* Copies `f1` to `f2` with the methods done by the kernel, starting with
+ * `copy_method`.  If a method fails, the next one continues at the
+ * current file offsets.  Errors are not reported, cp_reg_copy_loop()
+ * does this when it copies the rest.  Sparse files are copied with
+ * their holes.  Uses no global buffers, hence it is called by the
+ * threads of pcopy.c too.
+ *
+ * Input:
+ *   st: stat data of `f1`
+ *   buf: Buffer of size BUF_SIZE
+ * Output:
+ *   *n: Number of copied bytes
+ * Return value:
+ *   3: Sparse file had been copied, the file offsets are at the end
+ *   2: File had been cloned, nothing left to copy
+ *   1: `siz` bytes had been copied
+ *   0: Rest (if any) to be copied by the read loop */
+
+int cp_kernel(const int f1, const int f2, const struct stat *st, char *buf,
+              off_t *n)
+{
+    const off_t siz = st->st_size;
+    int m = copy_method;
+#ifdef SEEK_HOLE
+    int rv;
+#endif
+
+    *n = 0;
+
+#ifdef HAVE_FICLONE
+    if (m <= cpm_clone) {
+        if (ioctl(f2, FICLONE, f1) != -1) {
+            *n = siz;
+            return 2;
+        }
+# if defined(TRACE)
+        fprintf(debug, "  FICLONE: %s\n", strerror(errno));
+# endif
+    }
+#endif
+#ifdef SEEK_HOLE
+    /* Copies of sparse files by the kernel methods below or the read loop
+     * would write all holes. */
+    if ((off_t)st->st_blocks * 512 < siz &&
+        (rv = cp_sparse(f1, f2, siz, buf, n)) != -1)
+    {
+        return rv;
+    }
+#endif
+#ifdef HAVE_COPY_FILE_RANGE
+    if (m <= cpm_range) {
+        while (*n < siz) {
+            const ssize_t l = copy_file_range(f1, NULL, f2, NULL,
+                                              (size_t)(siz - *n), 0);
+            if (l <= 0)
+                break;
+
+            *n += l;
+        }
+    }
+#endif
+#ifdef HAVE_SENDFILE
+    if (m <= cpm_sendfile) {
+        while (*n < siz) {
+            const ssize_t l = sendfile(f2, f1, NULL, (size_t)(siz - *n));
+            if (l <= 0)
+                break;
+
+            *n += l;
+        }
+    }
+#endif
+    (void)m;
+    return *n && *n == siz ? 1 : 0;
+}
+
+/* Adds the result of cp_kernel() to the summary */
+
+static void cp_count(const int how, const off_t n)
+{
+    tot_cmp_byte_count += n;
+
+    if (how == 2)
+        ++tot_clone_count;
+    else if (how == 1)
+        ++tot_kcopy_count;
+}
+
+void
+set_copy_method(char *s)
+{
+    static const char *const names[] = {
+        "clone", "copy_file_range", "sendfile", "read" };
+    int i;
+
+    for (i = 0; i < (int)(sizeof names / sizeof *names); i++) {
+        if (!strcmp(s, names[i])) {
+            copy_method = i;
+            break;
+        }
+    }
+
+    if (i == (int)(sizeof names / sizeof *names))
+        printf("copy_method \"%s\" unknown\n", s);
+
+    free(s);
+}
+
 inline static int cp_reg_copy_loop(const int f1, const int f2) {
     int rv = 0;
     while (1) {
@@ -1806,33 +2142,63 @@ inline static int cp_reg_copy_loop(const int f1, const int f2) {
     return rv;
 }
 
-inline static void cp_reg_set_attr(const int f2) {
+void cp_dir_attr(const char *pth, const struct stat *st)
+{
+    if (preserve_all && chmod(pth, st->st_mode & 07777) == -1) {
+#if defined(TRACE)
+        fprintf(debug, "  chmod(%s): %s\n", pth, strerror(errno));
+#endif
+    }
+    if (preserve_all || preserve_mtim) {
+#ifdef HAVE_FUTIMENS
+        struct timespec ts[2];
+        ts[0] = st->st_atim;
+        ts[1] = st->st_mtim;
+        if (utimensat(AT_FDCWD, pth, ts, 0) == -1) {
+#if defined(TRACE)
+            fprintf(debug, "  utimensat(%s): %s\n", pth, strerror(errno));
+#endif
+        }
+#else
+        struct utimbuf tb;
+        tb.actime  = st->st_atime;
+        tb.modtime = st->st_mtime;
+        utime(pth, &tb); /* error not checked */
+#endif
+    }
+}
+
+/* Sets the attributes of `st` for file `f2` with path `pth`.
+ * Thread-safe, used by pcopy.c too. */
+
+void cp_set_attr(const int f2, const struct stat *st, const char *pth) {
+    (void)pth; /* Only used without futimens(2) */
     if (preserve_all || preserve_mtim) {
 #ifdef HAVE_FUTIMENS
         struct timespec ts[2];
-        ts[0] = gstat[0].st_atim;
-        ts[1] = gstat[0].st_mtim;
+        ts[0] = st->st_atim;
+        ts[1] = st->st_mtim;
         if (futimens(f2, ts) == -1) {
 #if defined(TRACE)
-            fprintf(debug, "  futimes(%s): %s\n", pth2, strerror(errno));
+            fprintf(debug, "  futimes(%s): %s\n", pth, strerror(errno));
 #endif
         }
 #else
         struct utimbuf tb;
-        tb.actime  = gstat[0].st_atime;
-        tb.modtime = gstat[0].st_mtime;
-        utime(pth2, &tb); /* error not checked */
+        tb.actime  = st->st_atime;
+        tb.modtime = st->st_mtime;
+        utime(pth, &tb); /* error not checked */
 #endif
     }
     if (preserve_all) {
-        if (fchown(f2, gstat[0].st_uid, gstat[0].st_gid) == -1) {
+        if (fchown(f2, st->st_uid, st->st_gid) == -1) {
 #if defined(TRACE)
-            fprintf(debug, "  fchown(%s): %s\n", pth2, strerror(errno));
+            fprintf(debug, "  fchown(%s): %s\n", pth, strerror(errno));
 #endif
         }
-        if (fchmod(f2, gstat[0].st_mode & 07777) == -1) {
+        if (fchmod(f2, st->st_mode & 07777) == -1) {
 #if defined(TRACE)
-            fprintf(debug, "  fchmod(%s): %s\n", pth2, strerror(errno));
+            fprintf(debug, "  fchmod(%s): %s\n", pth, strerror(errno));
 #endif
         }
     }
@@ -1854,10 +2220,26 @@ int cp_reg(const unsigned mode) {
         if (dont_overwrite)
             goto ret;
         if ((rv = cp_reg_to_existing(mode))) {
+            if (rv == 3) /* Running program */
+                rv = cp_delta_tmp();
             goto ret;
         }
+        /* cp_delta() returns 3 if the target had been removed by
+         * cp_reg_prepare_overwrite() */
+        if (fs_delta && !mode && S_ISREG(gstat[1].st_mode) &&
+            (rv = cp_delta()) != 3)
+        {
+            goto ret;
+        }
+        rv = 0;
 	} /* if (!fs_stat(pth2)) */
 
+    if (pcopy_on && !mode) {
+        pcopy_add(pth1, pth2, &gstat[0]);
+        fs_pcopy_reap();
+        goto ret;
+    }
+
 open_pth2:
     ; /* C bug? */
     const int fl = mode & 1 ? O_APPEND | O_WRONLY :
@@ -1898,11 +2280,17 @@ open_pth2:
             rv = -1;
             goto close2;
         }
-        cp_reg_copy_loop(f1, f2);
+        off_t n = 0;
+        /* Append mode is done by the read loop only.  FICLONE would
+         * replace the target. */
+        const int how = mode & 1 ? 0 : cp_kernel(f1, f2, &gstat[0], lbuf, &n);
+        cp_count(how, n);
+        if (how != 2)
+            cp_reg_copy_loop(f1, f2);
         close(f1);
         ++tot_cmp_file_count; /* -A, -T */
     }
-    cp_reg_set_attr(f2);
+    cp_set_attr(f2, &gstat[0], pth2);
 close2:
 	close(f2);
     if (!rv && !wstat && verbose) {
@@ -1919,6 +2307,279 @@ ret:
     return rv;
 }
 
+/* Update mode: Compares the existing target file `pth2` with `pth1` in
+ * blocks of `sizeof lbuf` bytes and only writes the blocks which differ.
+ * The target is opened for writing at the first difference, see
+ * cp_delta_wr().
+ *
+ * Return value:
+ *    3: Target does not exist anymore, to be copied by cp_reg()
+ *    1: Files are equal, nothing written
+ *    0: Ok
+ *   -1: Error
+ *   -2: Overwrite canceled */
+
+static int cp_delta(void)
+{
+    int f1, f2;
+    int rv = 0;
+    off_t o = 0, w = 0;
+    bool wr = FALSE; /* `f2` is opened for writing */
+
+    if ((f2 = open(pth2, O_RDONLY)) == -1) {
+        if (errno == ENOENT)
+            return 3;
+
+        printerr(strerror(errno), "open \"%s\"", pth2);
+        return -1;
+    }
+
+    if ((f1 = open(pth1, O_RDONLY)) == -1) {
+        printerr(strerror(errno), "open \"%s\"", pth1);
+        rv = -1;
+        goto close2;
+    }
+
+    while (1) {
+        const ssize_t l1 = read(f1, lbuf, sizeof lbuf);
+
+        if (l1 == -1) {
+            printerr(strerror(errno), "read \"%s\"", pth1);
+            rv = -1;
+            break;
+        }
+
+        if (!l1)
+            break;
+
+        const ssize_t l2 = pread(f2, rbuf, (size_t)l1, o);
+
+        if (l2 == -1) {
+            printerr(strerror(errno), "read \"%s\"", pth2);
+            rv = -1;
+            break;
+        }
+
+        if (l2 != l1 || memcmp(lbuf, rbuf, (size_t)l1)) {
+            if (!wr && (rv = cp_delta_wr(&f2))) {
+                close(f1);
+
+                if (rv == 4) { /* `f2` is closed */
+                    rv = cp_delta_tmp();
+                    goto ret;
+                }
+
+                goto close2;
+            }
+
+            wr = TRUE;
+            errno = 0;
+
+            if (pwrite(f2, lbuf, (size_t)l1, o) != l1) {
+                fs_fwrap("write \"%s\": %s", pth2,
+                         strerror(errno ? errno : ENOSPC));
+                rv = -1;
+                break;
+            }
+
+            w += l1;
+        }
+
+        o += l1;
+    }
+
+    close(f1);
+
+    if (!rv && gstat[1].st_size > o) {
+        if (!wr && (rv = cp_delta_wr(&f2))) {
+            if (rv == 4) {
+                rv = cp_delta_tmp();
+                goto ret;
+            }
+
+            goto close2;
+        }
+
+        wr = TRUE;
+
+        if (ftruncate(f2, o) == -1) {
+            fs_fwrap("truncate \"%s\": %s", pth2, strerror(errno));
+            rv = -1;
+        }
+    }
+
+    if (!wr) {
+#if defined(TRACE)
+        fprintf(debug, "  cp_delta: Equal: %s and %s\n", pth1, pth2);
+#endif
+        if (!rv)
+            rv = 1;
+
+        goto close2;
+    }
+
+    tot_delta_byte_count += o;
+    tot_delta_wr_count += w;
+    tot_cmp_byte_count += w;
+
+    if (!rv) {
+        ++tot_delta_count;
+        ++tot_cmp_file_count; /* -A */
+        cp_set_attr(f2, &gstat[0], pth2);
+    }
+#if defined(TRACE)
+    fprintf(debug, "  cp_delta(%s): %jd of %jd bytes written\n", pth2,
+            (intmax_t)w, (intmax_t)o);
+#endif
+close2:
+    close(f2);
+
+    if (!rv && !wstat && verbose)
+        printf("File update \"%s\" -> \"%s\" done\n", pth1, pth2);
+ret:
+    return rv;
+}
+
+/* Called by cp_delta() at the first difference.  Asks for overwrite and
+ * reopens `*f2` for writing.
+ *
+ * Return value:
+ *    4: Target can't be opened for writing (e.g. ETXTBSY for a running
+ *       program), `*f2` is closed
+ *    3: Target had been removed
+ *    0: Ok
+ *   -1: Error
+ *   -2: Overwrite canceled */
+
+static int cp_delta_wr(int *f2)
+{
+    int fd;
+    int rv;
+
+    if (fs_deldialog(y_a_n_txt, "overwrite", "file ", pth2))
+        return -2;
+
+    if ((rv = cp_reg_prepare_overwrite()) == 3) {
+        close(*f2);
+        return 4;
+    }
+
+    if (rv)
+        return rv;
+
+    if ((fd = open(pth2, O_RDWR)) == -1) {
+        if (errno == ENOENT)
+            return 3;
+#if defined(TRACE)
+        fprintf(debug, "  cp_delta open(%s): %s\n", pth2, strerror(errno));
+#endif
+        close(*f2);
+        return 4;
+    }
+
+    close(*f2);
+    *f2 = fd;
+    return 0;
+}
+
+/* Copies `pth1` to a temporary file in the directory of `pth2` and renames
+ * it to `pth2`.  Hence `pth2` is either the old or the new file.  Used if
+ * `pth2` can't be written, e.g. since it is a running program (ETXTBSY).
+ * As for an overwrite the mode and owner of the old file are kept (as
+ * far as permitted), but other hard links still refer to the old file. */
+
+static int cp_delta_tmp(void)
+{
+    const size_t l = strlen(pth2);
+    char *tmp = malloc(l + 8);
+    int f1, f2;
+    int rv = -1;
+
+    memcpy(tmp, pth2, l);
+    memcpy(tmp + l, ".XXXXXX", 8);
+
+    if ((f2 = mkstemp(tmp)) == -1) {
+        printerr(strerror(errno), "create \"%s\"", tmp);
+        goto free;
+    }
+
+    if ((f1 = open(pth1, O_RDONLY)) == -1) {
+        printerr(strerror(errno), "open \"%s\"", pth1);
+        close(f2);
+        goto unlink;
+    }
+
+    off_t n = 0;
+    const int how = cp_kernel(f1, f2, &gstat[0], lbuf, &n);
+    cp_count(how, n);
+    rv = how == 2 ? 0 : cp_reg_copy_loop(f1, f2);
+    close(f1);
+
+    if (fchown(f2, gstat[1].st_uid, gstat[1].st_gid) == -1) {
+#if defined(TRACE)
+        fprintf(debug, "  fchown(%s): %s\n", tmp, strerror(errno));
+#endif
+    }
+
+    if (fchmod(f2, gstat[1].st_mode & 07777) == -1) {
+#if defined(TRACE)
+        fprintf(debug, "  fchmod(%s): %s\n", tmp, strerror(errno));
+#endif
+    }
+
+    cp_set_attr(f2, &gstat[0], tmp);
+    close(f2);
+
+    if (!rv) {
+        if (rename(tmp, pth2) == -1) {
+            printerr(strerror(errno), "rename \"%s\" -> \"%s\"", tmp, pth2);
+            rv = -1;
+        } else {
+            ++tot_cmp_file_count; /* -A */
+
+            if (!wstat && verbose)
+                printf("File copy \"%s\" -> \"%s\" done\n", pth1, pth2);
+
+            goto free;
+        }
+    }
+
+unlink:
+    unlink(tmp);
+    rv = -1;
+free:
+    free(tmp);
+    return rv;
+}
+
+/* Reports the results of the copy threads */
+
+static void fs_pcopy_reap(void)
+{
+    struct pcopy_job *j;
+
+    while ((j = pcopy_result())) {
+        cp_count(j->how, j->nbytes);
+
+        if (j->how != -1)
+            ++tot_cmp_file_count; /* -A, -T */
+
+        if (j->msg) {
+            if (j->wr)
+                fs_fwrap("%s", j->msg);
+            else
+                printerr(NULL, "%s", j->msg);
+
+            if (exit_on_error)
+                fs_abort = TRUE;
+        } else if (!wstat && verbose) {
+            printf("File copy \"%s\" -> \"%s\" done\n", j->src, j->dst);
+        }
+
+        pcopy_free(j);
+    }
+}
+
 static void fs_fwrap(const char *f, ...)
 {
     if (fs_ign_errs)
@@ -2021,7 +2682,7 @@ fs_get_dst(long u,
 			dst = f->diff == '!' ? 3 : 0;
 		} else if (f->type[0]) {
 			if (f->type[1]) {
-                const int i = cmp_timespec(f->mtim[0], f->mtim[1]);
+                const int i = cmp_timespec(diff_mtim(f, 0), diff_mtim(f, 1));
 				if (!m || !S_ISREG(f->type[0]) ||
 				          !S_ISREG(f->type[1])) {
 
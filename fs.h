@@ -78,6 +78,21 @@ extern bool fs_none; /* Don't delete or overwrite any file */
 extern bool fs_abort; /* Abort operation */
 extern bool preserve_mtim;
 extern bool preserve_all;
+/* RC option "copy_method": First method used by cp_reg(). If a method
+ * is not supported, the next one is used. */
+enum copy_method { cpm_clone, cpm_range, cpm_sendfile, cpm_read };
+extern enum copy_method copy_method;
+extern long tot_clone_count; /* FICLONE */
+extern long tot_kcopy_count; /* copy_file_range(2), sendfile(2) */
+extern long tot_delta_count; /* Files updated in place */
+extern off_t tot_delta_byte_count; /* Compared by update */
+extern off_t tot_delta_wr_count; /* Written by update */
+void set_copy_method(char *);
+int cp_kernel(const int, const int, const struct stat *, char *, off_t *);
+void cp_set_attr(const int, const struct stat *, const char *);
+/* Sets the permissions and times of `st` for the copied directory `pth`
+ * after its contents had been copied */
+void cp_dir_attr(const char *pth, const struct stat *st);
 
 /* global for software test: */
 
@@ -3,6 +3,9 @@
 #include <cstdlib>
 #include <cstring>
 #include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <vector>
 #include "compat.h"
 #include "fs_test.h"
 #include "main.h"
@@ -13,11 +16,70 @@
 #include "exec.h"
 #include "uzp.h"
 #include "db.h"
+#include "pscan.h"
+
+// Writes `siz` bytes of a pattern depending on `seed` to `path` at `off`
+static void writePattern(const char *const path, const off_t off,
+                         const size_t siz, const int seed, const int flags)
+{
+    const int fd = open(path, O_WRONLY | O_CREAT | flags, 0644);
+
+    if (fd == -1)
+        FATAL_ERROR;
+
+    std::vector<char> buf(siz);
+
+    for (size_t i = 0; i < siz; ++i)
+        buf[i] = (char)((off_t)i * 7 + seed);
+
+    const ssize_t n = pwrite(fd, buf.data(), siz, off);
+    close(fd);
+
+    if (n != (ssize_t)siz)
+        FATAL_ERROR;
+}
+
+static bool sameContents(const char *const a, const char *const b)
+{
+    struct stat st[2];
+
+    if (stat(a, &st[0]) || stat(b, &st[1]))
+        FATAL_ERROR;
+
+    return !cmp_file(a, st[0].st_size, b, st[1].st_size, 1);
+}
+
+// Sets up the diff DB of fs_cp() for file `name` in directories `src`
+// and `dst` (fmode)
+
+static void setFsCpArgs(const char *const src, const char *const dst,
+                        filediff *const f, filediff **const fl)
+{
+    pthlen[0] = strlen(src);
+    memcpy(syspth[0], src, pthlen[0] + 1);
+    pthlen[1] = strlen(dst);
+    memcpy(syspth[1], dst, pthlen[1] + 1);
+
+    fl[0] = f;
+    db_list[0] = fl;
+    db_list[1] = fl;
+    db_num[0] = 1;
+    db_num[1] = 1;
+
+    followlinks = 0;
+    right_col = 0;
+    bmode = FALSE;
+    fmode = TRUE;
+}
 
 void FsTest::run() const {
 	fprintf(debug, "->fs_test\n");
 	fsStatTest();
 	cpRegTest();
+    copyKernelMethods();
+    copyTreeParallel();
+    copySparseFile();
+    updateInPlace();
     //copyTree();
 	fprintf(debug, "<-fs_test\n");
 }
@@ -153,6 +215,190 @@ void FsTest::appendFile() const {
     fprintf(debug, "<-appendFile\n");
 }
 
+void FsTest::copyKernelMethods() const {
+    fprintf(debug, "->copyKernelMethods\n");
+    const char src[] { TEST_DIR "/Kernel copy source" };
+    const char dst[] { TEST_DIR "/Kernel copy target" };
+    writePattern(src, 0, 100000, 5, O_TRUNC);
+
+    for (int m = cpm_clone; m <= cpm_read; ++m) {
+        fprintf(debug, "  copy_method %d\n", m);
+        copy_method = (enum copy_method)m;
+        unlink(dst);
+        const long n = tot_kcopy_count;
+
+        memcpy(lbuf, src, sizeof src);
+        pth1 = lbuf;
+        memcpy(rbuf, dst, sizeof dst);
+        pth2 = rbuf;
+
+        if (fs_stat(pth1, &gstat[0], 0))
+            FATAL_ERROR;
+        if (cp_reg(0)) // Copy file
+            FATAL_ERROR;
+
+        if (!sameContents(src, dst))
+            FATAL_ERROR;
+
+        // The read loop is not counted as kernel copy
+        if (m == cpm_read && tot_kcopy_count != n)
+            FATAL_ERROR;
+    }
+
+    copy_method = cpm_clone;
+    fprintf(debug, "<-copyKernelMethods\n");
+}
+
+void FsTest::copyTreeParallel() const {
+    fprintf(debug, "->copyTreeParallel\n");
+    const char tree[] { TEST_DIR "/Tree" };
+    const char dst[] { TEST_DIR "/Tree copy" };
+
+    if (mkdir(tree, 0777) || mkdir(TEST_DIR "/Tree/Sub", 0777) ||
+        mkdir(dst, 0777))
+    {
+        FATAL_ERROR;
+    }
+
+    for (int i = 0; i < 20; ++i) {
+        char pth[64];
+        snprintf(pth, sizeof pth, "%s/%s%d", tree, i & 1 ? "Sub/" : "", i);
+        writePattern(pth, 0, (size_t)i * 10000 + 1, i, O_TRUNC);
+    }
+
+    filediff f;
+    f.name = "Tree";
+    filediff *fl[1];
+    setFsCpArgs(TEST_DIR, dst, &f, fl);
+    scan_threads = 4;
+    unsigned sto;
+
+    if (fs_cp(2, // to right side
+              0, // u
+              1, // n
+              1|4, // !rebuild|force
+              &sto))
+    {
+        FATAL_ERROR;
+    }
+
+    scan_threads = 1;
+
+    if (system("diff -r '" TEST_DIR "/Tree' '" TEST_DIR "/Tree copy/Tree'"))
+        FATAL_ERROR;
+
+    fprintf(debug, "<-copyTreeParallel\n");
+}
+
+void FsTest::copySparseFile() const {
+    fprintf(debug, "->copySparseFile\n");
+
+    // 16 MiB file with data at 4 MiB and at the end
+
+    writePattern(sparse, 4 << 20, 100000, 1, O_TRUNC);
+    writePattern(sparse, (16 << 20) - 10, 10, 2, 0);
+
+    struct stat st[2];
+
+    if (stat(sparse, &st[0]))
+        FATAL_ERROR;
+
+    if ((off_t)st[0].st_blocks * 512 >= st[0].st_size) {
+        fprintf(debug, "  File system doesn't support holes\n");
+        fprintf(debug, "<-copySparseFile\n");
+        return;
+    }
+
+    memcpy(lbuf, sparse, strlen(sparse) + 1);
+    pth1 = lbuf;
+    memcpy(rbuf, sparsecopy, strlen(sparsecopy) + 1);
+    pth2 = rbuf;
+
+    if (fs_stat(pth1, &gstat[0], 0))
+        FATAL_ERROR;
+    if (cp_reg(0)) // Copy file
+        FATAL_ERROR;
+
+    if (!sameContents(sparse, sparsecopy))
+        FATAL_ERROR;
+
+    // Holes must not have been written
+
+    if (stat(sparsecopy, &st[1]))
+        FATAL_ERROR;
+    if (st[1].st_size != st[0].st_size ||
+        st[1].st_blocks > 2 * st[0].st_blocks)
+    {
+        FATAL_ERROR;
+    }
+
+    fprintf(debug, "<-copySparseFile\n");
+}
+
+void FsTest::updateInPlace() const {
+    fprintf(debug, "->updateInPlace\n");
+
+    // The second of 4 blocks differs, the target is longer
+
+    const char src[] { TEST_DIR "/Update source" };
+    const char dst[] { TEST_DIR "/Update target" };
+    const char srcFile[] { TEST_DIR "/Update source/File" };
+    const char dstFile[] { TEST_DIR "/Update target/File" };
+
+    if (mkdir(src, 0777) || mkdir(dst, 0777))
+        FATAL_ERROR;
+
+    writePattern(srcFile, 0, 4 * BUF_SIZE, 3, O_TRUNC);
+    writePattern(dstFile, 0, 4 * BUF_SIZE + 100, 3, O_TRUNC);
+    writePattern(dstFile, BUF_SIZE + 10, 1, 4, 0);
+
+    struct stat st[2];
+
+    if (stat(dstFile, &st[0]))
+        FATAL_ERROR;
+
+    filediff f;
+    f.name = "File";
+    filediff *fl[1];
+    setFsCpArgs(src, dst, &f, fl);
+    force_fs = TRUE; // No overwrite dialog
+    unsigned sto;
+    const long n = tot_delta_count;
+    const off_t w = tot_delta_wr_count;
+
+    if (fs_cp(2, // to right side
+              0, // u
+              1, // n
+              1|4|8, // !rebuild|force|update
+              &sto))
+    {
+        FATAL_ERROR;
+    }
+
+    // Only the different block is written, the file is not replaced
+
+    if (tot_delta_count != n + 1 || tot_delta_wr_count != w + BUF_SIZE)
+        FATAL_ERROR;
+    if (stat(dstFile, &st[1]))
+        FATAL_ERROR;
+    if (st[1].st_ino != st[0].st_ino || st[1].st_size != 4 * BUF_SIZE)
+        FATAL_ERROR;
+    if (!sameContents(srcFile, dstFile))
+        FATAL_ERROR;
+
+    // Equal files are not written
+
+    setFsCpArgs(src, dst, &f, fl);
+
+    if (fs_cp(2, 0, 1, 1|4|8, &sto))
+        FATAL_ERROR;
+    if (tot_delta_count != n + 1 || tot_delta_wr_count != w + BUF_SIZE)
+        FATAL_ERROR;
+
+    force_fs = FALSE;
+    fprintf(debug, "<-updateInPlace\n");
+}
+
 void FsTest::copyTree() const {
     fprintf(debug, "->copyTree\n");
 
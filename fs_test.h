@@ -15,6 +15,10 @@ private:
     void copyLargeFile() const;
     void copy2FollowLink() const;
     void appendFile() const;
+    void copyKernelMethods() const;
+    void copyTreeParallel() const;
+    void copySparseFile() const;
+    void updateInPlace() const;
     void copyTree() const;
 
 	const char *const enoent { "Non-existing file" };
@@ -25,6 +29,8 @@ private:
     const char *const file1 { TEST_DIR "/File 1" };
     const char *const file2 { TEST_DIR "/File 2" };
     const char *const file1copy { TEST_DIR "/Copy of file 1" };
+    const char *const sparse { TEST_DIR "/Sparse file" };
+    const char *const sparsecopy { TEST_DIR "/Copy of sparse file" };
 };
 
 #endif
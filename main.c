@@ -43,6 +43,11 @@ PERFORMANCE OF THIS SOFTWARE.
 #include "misc.h"
 #include "fs.h"
 #include "MoveCursorToFile.h"
+#include "pscan.h"
+#include "digest.h"
+#include "snap.h"
+#include "fcmp.h"
+#include "mismatch.h"
 #ifdef TEST
 # include "test.h"
 #endif
@@ -223,8 +228,7 @@ main(int argc, char **argv)
 
     while ((opt =
             getopt(argc, argv,
-                   /* jz */
-                   "AaBbCcDdEeF:fG:gH:hIiJK:kLlMmNnOoP:pQqRrSsTt:UuVv:WwXx:Yy"
+                   "AaBbCcDdEeF:fG:gH:hIiJj:K:kLlMmNnOoP:pQqRrSsTt:UuVv:WwXx:Yyz"
 #if defined (DEBUG)
                    "Z"
 #endif
@@ -312,6 +316,21 @@ main(int argc, char **argv)
             moveCursorToFile = TRUE;
             break;
 
+        case 'j':
+        {
+            char *endptr;
+            long l;
+            errno = 0;
+            l = strtol(optarg, &endptr, 10);
+            if (errno || *endptr || l < 0 || l > 1024)
+            {
+                fprintf(stderr, "%s: Invalid argument \"%s\" to -j\n", prog, optarg);
+                exit(EXIT_STATUS_ERROR);
+            }
+            scan_threads = (unsigned)l;
+            break;
+        }
+
         case 'K':
         {
             moveCursorToFile = TRUE;
@@ -470,6 +489,9 @@ main(int argc, char **argv)
 		case 'y':
 			twocols = TRUE;
 			break;
+        case 'z':
+            snap_arg = TRUE;
+            break;
 
 		default:
             if (opt != '?')
@@ -535,9 +557,13 @@ main(int argc, char **argv)
 		fmode = TRUE;
 	}
 
+	mismatch_init();
 	inst_sighdl(SIGCHLD, sig_child);
 	inst_sighdl(SIGINT , sig_term);
 	inst_sighdl(SIGTERM, sig_term);
+#ifdef HAVE_MMAP
+	inst_sighdl(SIGBUS , fcmp_sig_bus);
+#endif
 	ttcharoff();
 
     if ((argc || fmode) &&
@@ -669,6 +695,14 @@ main(int argc, char **argv)
         if (cli_rm) {
             if (do_cli_rm(argc, argv))
                 exit_status = EXIT_STATUS_ERROR;
+        } else if (cli_cp && snap_arg) {
+            if (argc != 2 || cli_mv) {
+                fprintf(stderr, "%s: Option -A -z expects a directory and "
+                        "a snapshot file\n", prog);
+                exit_status = EXIT_STATUS_ERROR;
+            } else if (snap_dump(argv[0], argv[1])) {
+                exit_status = EXIT_STATUS_ERROR;
+            }
         } else if (cli_cp) {
             if (do_cli_cp(argc, argv, cli_mv ? 1 : 0))
                 exit_status = EXIT_STATUS_ERROR;
@@ -712,7 +746,32 @@ main(int argc, char **argv)
                                cli_cp ? "copied" :
                                cli_rm ? "removed" :
                                gq_pattern ? "processed" : "");
+
+                if (tot_mmap_count)
+                    printf("%'ld comparisons with mmap(2)\n",
+                           tot_mmap_count);
+
+                if (tot_digest_count)
+                    printf("%'ld comparisons by cached digest\n",
+                           tot_digest_count);
             }
+
+            if (tot_same_ino_count)
+                printf("%'ld hard linked files not read\n",
+                       tot_same_ino_count);
+
+            if (tot_clone_count)
+                printf("%'ld files cloned\n", tot_clone_count);
+
+            if (tot_kcopy_count)
+                printf("%'ld files copied by the kernel\n",
+                       tot_kcopy_count);
+
+            if (tot_delta_count)
+                printf("%'ld files updated in place "
+                       "(%'jd of %'jd bytes written)\n", tot_delta_count,
+                       (intmax_t)tot_delta_wr_count,
+                       (intmax_t)tot_delta_byte_count);
         }
     } else {
 		remove_tmp_dirs();
@@ -722,6 +781,8 @@ main(int argc, char **argv)
 		endwin();
 	}
 
+	digest_store();
+
 	if (printwd) {
 		wr_last_path();
 	}
@@ -949,6 +1010,12 @@ stat:
             exit(EXIT_STATUS_ERROR);
 		}
 
+        if (snap_arg && !cli_cp && !cli_rm && !bmode && !fmode &&
+            !snap_side_open(i, s, &gstat[i]))
+        {
+            goto set_path;
+        }
+
         if (!cli_cp && !cli_rm
                 && !zipfile[i] /* break "goto stat" loop */
                 && !check_ext_tool(s) /* Configured tool has higher priority */)
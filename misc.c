@@ -7,6 +7,7 @@
 #include <sys/types.h>
 #include <pwd.h>
 #include <grp.h>
+#include <time.h>
 #include "compat.h"
 #include "tc.h"
 #include "ui.h"
@@ -18,8 +19,31 @@
 #include "db.h"
 #include "fs.h"
 
+/* Names of user and group IDs.  getpwuid(3) and getgrgid(3) may be slow
+ * with a network name service, hence the names are kept.  IDs without
+ * name are kept too.  Names older than ID_TTL seconds are looked up
+ * again after the next id_cache_expire(). */
+
+#define ID_TTL 600
+
+struct id_name {
+    unsigned long id;
+    char *name; /* NULL: slot unused */
+    time_t t;
+    bool stale;
+};
+
+struct id_cache {
+    struct id_name *tab;
+    size_t size, num; /* `size` is a power of 2 or 0 */
+};
+
+static const char *id_name(struct id_cache *, unsigned long, bool);
+static struct id_name *id_slot(struct id_cache *, unsigned long);
+
 const char oom_msg[] = "Out of memory\n";
 bool override_prev;
+static struct id_cache uid_cache, gid_cache;
 
 int
 getuwidth(unsigned long u)
@@ -153,6 +177,8 @@ int do_cli_cp(int argc, char **argv, const unsigned opt) {
 
     if (opt & 1) {
         md |= 16; /* move instead of copy (remove source) */
+    } else if (overwrite_if_old) {
+        md |= 8; /* update existing files in place */
     }
     get_arg(target, 1); /* set gstat[1] */
 
@@ -232,20 +258,108 @@ int cmp_timespec(const struct timespec a, const struct timespec b)
 
 void get_uid_name(const uid_t uid, char *const buf, const size_t buf_size)
 {
-    const struct passwd *const pw = getpwuid(uid);
-    if (pw)
-        memcpy(buf, pw->pw_name, strlen(pw->pw_name) + 1);
-    else
-        snprintf(buf, buf_size, "%u", uid);
+    snprintf(buf, buf_size, "%s", uid_name(uid));
 }
 
 void get_gid_name(const gid_t gid, char *const buf, const size_t buf_size)
 {
-    const struct group *const gr = getgrgid(gid);
-    if (gr)
-        memcpy(buf, gr->gr_name, strlen(gr->gr_name) + 1);
-    else
-        snprintf(buf, buf_size, "%u", gid);
+    snprintf(buf, buf_size, "%s", gid_name(gid));
+}
+
+const char *uid_name(const uid_t uid)
+{
+    return id_name(&uid_cache, uid, FALSE);
+}
+
+const char *gid_name(const gid_t gid)
+{
+    return id_name(&gid_cache, gid, TRUE);
+}
+
+static const char *id_name(struct id_cache *c, unsigned long id, bool grp)
+{
+    struct id_name *e = id_slot(c, id);
+
+    if (e->name && !e->stale)
+        return e->name;
+
+    const char *s = NULL;
+
+    if (grp) {
+        const struct group *const gr = getgrgid((gid_t)id);
+        if (gr)
+            s = gr->gr_name;
+    } else {
+        const struct passwd *const pw = getpwuid((uid_t)id);
+        if (pw)
+            s = pw->pw_name;
+    }
+
+    free(e->name);
+
+    if (s)
+        e->name = strdup(s);
+    else {
+        char buf[24];
+        snprintf(buf, sizeof buf, "%lu", id);
+        e->name = strdup(buf);
+    }
+
+    e->t = time(NULL);
+    e->stale = FALSE;
+    return e->name;
+}
+
+void id_cache_expire(void)
+{
+    struct id_cache *const c[2] = { &uid_cache, &gid_cache };
+    const time_t now = time(NULL);
+
+    for (int i = 0; i < 2; i++) {
+        for (size_t k = 0; k < c[i]->size; k++) {
+            struct id_name *const e = &c[i]->tab[k];
+
+            if (e->name && now - e->t >= ID_TTL)
+                e->stale = TRUE;
+        }
+    }
+}
+
+/* Returns the slot of `id`, a new slot has `name` NULL */
+
+static struct id_name *id_slot(struct id_cache *c, unsigned long id)
+{
+    size_t m, k;
+
+    if (2 * (c->num + 1) > c->size) {
+        struct id_name *tab = c->tab;
+        const size_t size = c->size;
+
+        c->size = size ? 2 * size : 32;
+        c->tab = calloc(c->size, sizeof(struct id_name));
+        m = c->size - 1;
+
+        for (size_t j = 0; j < size; j++) {
+            if (!tab[j].name)
+                continue;
+            for (k = (tab[j].id * 2654435761UL) & m; c->tab[k].name;
+                 k = (k + 1) & m);
+            c->tab[k] = tab[j];
+        }
+
+        free(tab);
+    }
+
+    m = c->size - 1;
+
+    for (k = (id * 2654435761UL) & m; c->tab[k].name; k = (k + 1) & m) {
+        if (c->tab[k].id == id)
+            return &c->tab[k];
+    }
+
+    c->tab[k].id = id;
+    c->num++;
+    return &c->tab[k];
 }
 
 void add_skip_ext(char *const ext)
@@ -42,6 +42,13 @@ int do_cli_cp(int argc, char **argv, const unsigned opt);
 int cmp_timespec(const struct timespec a, const struct timespec b);
 void get_uid_name(const uid_t uid, char *const buf, const size_t buf_size);
 void get_gid_name(const gid_t gid, char *const buf, const size_t buf_size);
+/* Name of a user or group ID, the ID as string if it has no name.
+ * The names are cached, the returned string is valid until the next
+ * id_cache_expire() call. */
+const char *uid_name(const uid_t uid);
+const char *gid_name(const gid_t gid);
+/* Marks old names to be looked up again.  Called when a list is read. */
+void id_cache_expire(void);
 void add_skip_ext(char *const ext);
 /**
  * @brief get_filename_extension
@@ -0,0 +1,136 @@
+/*
+Copyright (c) 2016-2018, Carsten Kunze <carsten.kunze@arcor.de>
+
+Permission to use, copy, modify, and/or distribute this software for any
+purpose with or without fee is hereby granted, provided that the above
+copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+PERFORMANCE OF THIS SOFTWARE.
+*/
+
+/*
+ * First mismatch search.  Unlike memcmp(3) it returns the position of
+ * the first difference.  On x86 SSE2 or, if the CPU supports it, AVX2
+ * is used.  Else the buffers are compared word by word.
+ */
+
+#include <string.h>
+#include <stdint.h>
+#include "mismatch.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || \
+    (defined(__i386__) && defined(__SSE2__)))
+# define MISMATCH_X86
+# include <immintrin.h>
+#endif
+
+static size_t mismatch_word(const unsigned char *, const unsigned char *,
+    size_t);
+#ifdef MISMATCH_X86
+static size_t mismatch_sse2(const unsigned char *, const unsigned char *,
+    size_t);
+static size_t mismatch_avx2(const unsigned char *, const unsigned char *,
+    size_t);
+#endif
+
+/* Set by mismatch_init() before threads are started.  The default is
+ * supported by all CPUs of the architecture. */
+static size_t (*mismatch_fn)(const unsigned char *, const unsigned char *,
+    size_t) =
+#ifdef MISMATCH_X86
+    mismatch_sse2;
+#else
+    mismatch_word;
+#endif
+
+void
+mismatch_init(void)
+{
+#ifdef MISMATCH_X86
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2"))
+        mismatch_fn = mismatch_avx2;
+#endif
+}
+
+size_t
+mem_mismatch(const void *a, const void *b, size_t n)
+{
+    return mismatch_fn(a, b, n);
+}
+
+static size_t
+mismatch_word(const unsigned char *a, const unsigned char *b, size_t n)
+{
+    size_t i = 0;
+
+    for (; i + sizeof(uint64_t) <= n; i += sizeof(uint64_t)) {
+        uint64_t x, y;
+
+        memcpy(&x, a + i, sizeof x);
+        memcpy(&y, b + i, sizeof y);
+
+        if (x != y)
+            break;
+    }
+
+    for (; i < n && a[i] == b[i]; i++);
+
+    return i;
+}
+
+#ifdef MISMATCH_X86
+static size_t
+mismatch_sse2(const unsigned char *a, const unsigned char *b, size_t n)
+{
+    size_t i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(a + i));
+        __m128i y = _mm_loadu_si128((const __m128i *)(b + i));
+        unsigned m = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(x, y));
+
+        if (m != 0xffff)
+            return i + (size_t)__builtin_ctz(~m);
+    }
+
+    return i + mismatch_word(a + i, b + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static size_t
+mismatch_avx2(const unsigned char *a, const unsigned char *b, size_t n)
+{
+    size_t i = 0;
+
+    /* Two vectors per iteration to have less branches */
+    for (; i + 64 <= n; i += 64) {
+        __m256i x0 = _mm256_loadu_si256((const __m256i *)(a + i));
+        __m256i y0 = _mm256_loadu_si256((const __m256i *)(b + i));
+        __m256i x1 = _mm256_loadu_si256((const __m256i *)(a + i + 32));
+        __m256i y1 = _mm256_loadu_si256((const __m256i *)(b + i + 32));
+        __m256i e = _mm256_and_si256(_mm256_cmpeq_epi8(x0, y0),
+                                     _mm256_cmpeq_epi8(x1, y1));
+
+        if ((unsigned)_mm256_movemask_epi8(e) != 0xffffffff) {
+            unsigned m = (unsigned)_mm256_movemask_epi8(
+                _mm256_cmpeq_epi8(x0, y0));
+
+            if (m != 0xffffffff)
+                return i + (size_t)__builtin_ctz(~m);
+
+            m = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x1, y1));
+            return i + 32 + (size_t)__builtin_ctz(~m);
+        }
+    }
+
+    return i + mismatch_sse2(a + i, b + i, n - i);
+}
+#endif
@@ -0,0 +1,13 @@
+#ifndef MISMATCH_H
+#define MISMATCH_H
+
+#include <stddef.h>
+
+/* Returns the index of the first byte which differs in `a` and `b` or
+ * `n` if the first `n` bytes are equal. */
+size_t mem_mismatch(const void *a, const void *b, size_t n);
+/* Selects the fastest implementation the CPU supports.  Called at start
+ * before any thread is created. */
+void mismatch_init(void);
+
+#endif /* MISMATCH_H */
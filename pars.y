@@ -36,6 +36,12 @@ PERFORMANCE OF THIS SOFTWARE.
 #include "pars.h"
 #include "fs.h"
 #include "misc.h"
+#include "pscan.h"
+#include "digest.h"
+#include "fcmp.h"
+#include "cmpq.h"
+#include "snap.h"
+#include "watch.h"
 
 int yylex(void);
 extern char *yytext;
@@ -52,8 +58,9 @@ extern char *yytext;
 %token DISP_MTIME MMRK_COLOR LOCALE FILE_EXEC UZ_ADD UZ_DEL WAIT NOBOLD DOTDOT
 %token SORTIC PRESERVE_ALL PRESERVE_MTIM DISP_ALL NO_DOTDOT HIDDEN NO_HIDDEN
 %token NO_DISP_PERM NO_DISP_OWNER NO_DISP_GROUP NO_DISP_HSIZE NO_DISP_MTIME
-%token NO_PRESERVE FKEY_SET OVERRIDE
-%token VI_CURSOR_KEYS
+%token NO_PRESERVE FKEY_SET OVERRIDE DISP_DSTAT NO_DISP_DSTAT
+%token VI_CURSOR_KEYS THREADS DIGEST_CACHE CMP_BUFFER_SIZE
+%token CMP_MMAP NO_QUICK_CMP FAST_APPROX BG_CMP COPY_METHOD SNAPSHOT WATCH
 %token <str>     STRING
 %token <integer> INTEGER
 %%
@@ -128,11 +135,13 @@ option:
 	| DISP_GROUP                   { add_group = TRUE                 ; }
 	| DISP_HSIZE                   { add_hsize = TRUE                 ; }
 	| DISP_MTIME                   { add_mtime = TRUE                 ; }
+    | DISP_DSTAT                   { add_dstat = TRUE                 ; }
     | NO_DISP_PERM                 { add_mode  = FALSE                ; }
     | NO_DISP_OWNER                { add_owner = FALSE                ; }
     | NO_DISP_GROUP                { add_group = FALSE                ; }
     | NO_DISP_HSIZE                { add_hsize = FALSE                ; }
     | NO_DISP_MTIME                { add_mtime = FALSE                ; }
+    | NO_DISP_DSTAT                { add_dstat = FALSE                ; }
     | FILE_EXEC                    { file_exec = TRUE                 ; }
 	| DOTDOT                       { dotdot = TRUE                    ; }
     | NO_DOTDOT                    { dotdot = FALSE                   ; }
@@ -145,6 +154,46 @@ option:
     | NO_HIDDEN { nohidden = TRUE; }
     | OVERRIDE { override_prev = TRUE; }
     | VI_CURSOR_KEYS { vi_cursor_keys = TRUE; }
+    | THREADS INTEGER {
+			/* Same limits as -j */
+			if ($2 < 0 || $2 > 1024) {
+				fprintf(stderr,
+				    "%s: Invalid argument \"%d\" to threads\n",
+				    prog, $2);
+				exit(EXIT_STATUS_ERROR);
+			}
+
+			scan_threads = (unsigned)$2;
+		}
+    | DIGEST_CACHE { digest_cache = TRUE; }
+    | CMP_BUFFER_SIZE INTEGER {
+			/* Two buffers are allocated, keep them below 2 GiB */
+			if ($2 < 0 || $2 > 1048576) {
+				fprintf(stderr,
+				    "%s: Invalid argument \"%d\" to "
+				    "cmp_buffer_size\n", prog, $2);
+				exit(EXIT_STATUS_ERROR);
+			}
+
+			cmp_buf_kib = (unsigned)$2;
+		}
+    | CMP_MMAP INTEGER {
+			/* 1 TiB, bigger files are not mapped anyway */
+			if ($2 < 0 || $2 > 1073741824) {
+				fprintf(stderr,
+				    "%s: Invalid argument \"%d\" to "
+				    "cmp_mmap\n", prog, $2);
+				exit(EXIT_STATUS_ERROR);
+			}
+
+			cmp_mmap_kib = (unsigned)$2;
+		}
+    | NO_QUICK_CMP { cmp_quick = FALSE; }
+    | FAST_APPROX { fast_approx = TRUE; }
+    | BG_CMP { bg_cmp = TRUE; }
+    | COPY_METHOD STRING { set_copy_method($2); }
+    | SNAPSHOT { snapshot = TRUE; }
+    | WATCH { watch_dirs = TRUE; }
     | LOCALE STRING {
 			if (!setlocale(LC_ALL, $2)) {
 				printf("locale LC_ALL=%s cannot be set\n",
@@ -0,0 +1,364 @@
+/*
+Copyright (c) 2016-2018, Carsten Kunze <carsten.kunze@arcor.de>
+
+Permission to use, copy, modify, and/or distribute this software for any
+purpose with or without fee is hereby granted, provided that the above
+copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+PERFORMANCE OF THIS SOFTWARE.
+*/
+
+/*
+ * Parallel copy of regular files for tree copies.
+ *
+ * proc_dir() still reads the source tree, creates the directories and
+ * handles existing targets (dialogs) in the main thread.  cp_reg() only
+ * queues the data copy of regular files here.  Worker threads create
+ * the target files, copy the data and set the attributes.  Finished
+ * jobs are returned to the main thread, which reports errors with the
+ * usual dialogs and updates the summary counters.
+ *
+ * Since files are created in the target directories after these had
+ * been left by proc_dir(), the permissions and times of the directories
+ * are set by pcopy_end() when all files are copied.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/stat.h>
+#ifdef HAVE_PTHREAD
+# include <pthread.h>
+#endif
+#include "compat.h"
+#include "main.h"
+#include "ui.h"
+#include "fs.h"
+#include "pscan.h"
+#include "pcopy.h"
+
+/* Queued jobs per thread */
+#define PC_QUEUE 64
+
+struct pc_dir {
+    char *pth;
+    struct stat st;
+};
+
+bool pcopy_on;
+
+#ifdef HAVE_PTHREAD
+
+static void *pc_worker(void *);
+static void pc_copy(struct pcopy_job *, char *);
+static void pc_err(struct pcopy_job *, const char *, const char *, int,
+                   bool);
+
+static pthread_t *pc_tid;
+static unsigned pc_nthreads;
+static pthread_mutex_t pc_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pc_cv = PTHREAD_COND_INITIALIZER; /* to workers */
+static pthread_cond_t pc_full_cv = PTHREAD_COND_INITIALIZER; /* to main */
+static struct pcopy_job *pc_head, **pc_tail = &pc_head;
+static struct pcopy_job *pc_res_head, **pc_res_tail = &pc_res_head;
+static unsigned pc_queued;
+static bool pc_stop;
+static bool pc_cancel;
+static struct pc_dir *pc_dirs;
+static size_t pc_ndirs;
+static size_t pc_dirs_size;
+
+void
+pcopy_start(void)
+{
+    unsigned n;
+
+    if (pcopy_on || scan_threads == 1)
+        return;
+
+    if (!(n = scan_threads)) {
+        long l = sysconf(_SC_NPROCESSORS_ONLN);
+        n = l > 1 ? (unsigned)l : 1;
+    }
+#if defined(TRACE)
+    fprintf(debug, "->pcopy_start(%u threads)\n", n);
+#endif
+    pc_tid = malloc(n * sizeof(*pc_tid));
+    pc_stop = FALSE;
+    pc_cancel = FALSE;
+
+    for (pc_nthreads = 0; pc_nthreads < n; pc_nthreads++) {
+        if ((errno = pthread_create(pc_tid + pc_nthreads, NULL, pc_worker,
+                                    NULL))) {
+            printerr(strerror(errno), "pthread_create");
+            break;
+        }
+    }
+
+    if (!pc_nthreads) {
+        /* cp_reg() copies the files */
+        free(pc_tid);
+        pc_tid = NULL;
+        return;
+    }
+
+    pcopy_on = TRUE;
+}
+
+void
+pcopy_add(const char *src, const char *dst, const struct stat *st)
+{
+    struct pcopy_job *j = malloc(sizeof(struct pcopy_job));
+
+    j->src = strdup(src);
+    j->dst = strdup(dst);
+    j->st = *st;
+    j->nbytes = 0;
+    j->how = -1;
+    j->wr = FALSE;
+    j->msg = NULL;
+    j->next = NULL;
+    pthread_mutex_lock(&pc_mtx);
+
+    while (pc_queued >= PC_QUEUE * pc_nthreads)
+        pthread_cond_wait(&pc_full_cv, &pc_mtx);
+
+    *pc_tail = j;
+    pc_tail = &j->next;
+    pc_queued++;
+    pthread_cond_signal(&pc_cv);
+    pthread_mutex_unlock(&pc_mtx);
+}
+
+void
+pcopy_dir(const char *dst, const struct stat *st)
+{
+    if (pc_ndirs == pc_dirs_size) {
+        pc_dirs_size = pc_dirs_size ? 2 * pc_dirs_size : 64;
+        pc_dirs = realloc(pc_dirs, pc_dirs_size * sizeof(*pc_dirs));
+    }
+
+    pc_dirs[pc_ndirs].pth = strdup(dst);
+    pc_dirs[pc_ndirs++].st = *st;
+}
+
+struct pcopy_job *
+pcopy_result(void)
+{
+    struct pcopy_job *j;
+
+    pthread_mutex_lock(&pc_mtx);
+
+    if ((j = pc_res_head) && !(pc_res_head = j->next))
+        pc_res_tail = &pc_res_head;
+
+    pthread_mutex_unlock(&pc_mtx);
+    return j;
+}
+
+void
+pcopy_free(struct pcopy_job *j)
+{
+    free(j->src);
+    free(j->dst);
+    free(j->msg);
+    free(j);
+}
+
+void
+pcopy_end(bool cancel)
+{
+    unsigned i;
+
+    if (!pcopy_on)
+        return;
+
+    pthread_mutex_lock(&pc_mtx);
+    pc_stop = TRUE;
+    pc_cancel = cancel;
+    pthread_cond_broadcast(&pc_cv);
+    pthread_mutex_unlock(&pc_mtx);
+
+    for (i = 0; i < pc_nthreads; i++)
+        pthread_join(pc_tid[i], NULL);
+
+    free(pc_tid);
+    pc_tid = NULL;
+    pcopy_on = FALSE;
+
+    /* Dropped jobs */
+    while (pc_head) {
+        struct pcopy_job *j = pc_head;
+
+        pc_head = j->next;
+        pcopy_free(j);
+    }
+
+    pc_tail = &pc_head;
+    pc_queued = 0;
+
+    /* Children first, a directory may be made read-only */
+    while (pc_ndirs) {
+        struct pc_dir *d = &pc_dirs[--pc_ndirs];
+
+        if (!cancel)
+            cp_dir_attr(d->pth, &d->st);
+
+        free(d->pth);
+    }
+#if defined(TRACE)
+    fprintf(debug, "<-pcopy_end\n");
+#endif
+}
+
+static void *
+pc_worker(void *arg)
+{
+    char *buf = malloc(BUF_SIZE);
+
+    (void)arg;
+    pthread_mutex_lock(&pc_mtx);
+
+    while (1) {
+        struct pcopy_job *j;
+
+        while (!pc_head && !pc_stop)
+            pthread_cond_wait(&pc_cv, &pc_mtx);
+
+        if (!pc_head || pc_cancel)
+            break;
+
+        j = pc_head;
+
+        if (!(pc_head = j->next))
+            pc_tail = &pc_head;
+
+        pc_queued--;
+        pthread_cond_signal(&pc_full_cv);
+        pthread_mutex_unlock(&pc_mtx);
+
+        pc_copy(j, buf);
+
+        pthread_mutex_lock(&pc_mtx);
+        j->next = NULL;
+        *pc_res_tail = j;
+        pc_res_tail = &j->next;
+    }
+
+    pthread_mutex_unlock(&pc_mtx);
+    free(buf);
+    return NULL;
+}
+
+/* cp_reg() without dialogs and global buffers */
+
+static void
+pc_copy(struct pcopy_job *j, char *buf)
+{
+    int f1, f2;
+
+    if ((f2 = open(j->dst, O_CREAT | O_TRUNC | O_WRONLY,
+                   j->st.st_mode & 07777)) == -1) {
+        pc_err(j, "create", j->dst, errno, FALSE);
+        return;
+    }
+
+    if (j->st.st_size) {
+        if ((f1 = open(j->src, O_RDONLY)) == -1) {
+            pc_err(j, "open", j->src, errno, FALSE);
+            goto close2;
+        }
+
+        if ((j->how = cp_kernel(f1, f2, &j->st, buf, &j->nbytes)) != 2) {
+            while (1) {
+                const ssize_t l1 = read(f1, buf, BUF_SIZE);
+
+                if (l1 == -1) {
+                    pc_err(j, "read", j->src, errno, FALSE);
+                    break;
+                }
+
+                if (!l1)
+                    break;
+
+                errno = 0;
+                const ssize_t l2 = write(f2, buf, (size_t)l1);
+
+                if (l2 != l1) {
+                    pc_err(j, "write", j->dst, errno ? errno : ENOSPC, TRUE);
+                    break;
+                }
+
+                j->nbytes += l1;
+            }
+        }
+
+        close(f1);
+    }
+
+    cp_set_attr(f2, &j->st, j->dst);
+close2:
+    close(f2);
+}
+
+static void
+pc_err(struct pcopy_job *j, const char *op, const char *pth, int e, bool wr)
+{
+    size_t l = strlen(op) + strlen(pth) + strlen(strerror(e)) + 8;
+
+    j->msg = malloc(l);
+    snprintf(j->msg, l, "%s \"%s\": %s", op, pth, strerror(e));
+    j->wr = wr;
+}
+
+#else /* HAVE_PTHREAD */
+
+void
+pcopy_start(void)
+{
+}
+
+void
+pcopy_add(const char *src, const char *dst, const struct stat *st)
+{
+    (void)src;
+    (void)dst;
+    (void)st;
+}
+
+void
+pcopy_dir(const char *dst, const struct stat *st)
+{
+    (void)dst;
+    (void)st;
+}
+
+struct pcopy_job *
+pcopy_result(void)
+{
+    return NULL;
+}
+
+void
+pcopy_free(struct pcopy_job *j)
+{
+    (void)j;
+}
+
+void
+pcopy_end(bool cancel)
+{
+    (void)cancel;
+}
+
+#endif /* HAVE_PTHREAD */
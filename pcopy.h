@@ -0,0 +1,39 @@
+#ifndef PCOPY_H
+#define PCOPY_H
+
+#include <sys/stat.h>
+#include "compat.h"
+
+struct pcopy_job {
+    char *src;
+    char *dst;
+    struct stat st; /* of `src` */
+    off_t nbytes; /* Copied bytes */
+    int how; /* Return value of cp_kernel(), -1 if `src` was not read */
+    bool wr; /* `msg` is a write error */
+    char *msg; /* Error message or NULL */
+    struct pcopy_job *next;
+};
+
+/* TRUE while copy jobs are queued by cp_reg() */
+extern bool pcopy_on;
+
+/* Starts the copy threads for a tree copy if `scan_threads` (-j) is
+ * not 1.  Sets `pcopy_on`. */
+void pcopy_start(void);
+/* Queues copying regular file `src` to `dst`.  The target must not
+ * exist or must be prepared for O_TRUNC.  Blocks while the queue is
+ * full. */
+void pcopy_add(const char *src, const char *dst, const struct stat *st);
+/* Remembers directory `dst` created for `st`.  Its permissions and times
+ * are set by pcopy_end() after all files had been copied. */
+void pcopy_dir(const char *dst, const struct stat *st);
+/* Returns a finished job or NULL.  To be freed by pcopy_free(). */
+struct pcopy_job *pcopy_result(void);
+void pcopy_free(struct pcopy_job *);
+/* Waits for all queued copies (or drops them if `cancel` is set), stops
+ * the threads and sets the attributes of the directories.  Results are
+ * still to be taken with pcopy_result(). */
+void pcopy_end(bool cancel);
+
+#endif /* PCOPY_H */
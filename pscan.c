@@ -0,0 +1,874 @@
+/*
+Copyright (c) 2016-2018, Carsten Kunze <carsten.kunze@arcor.de>
+
+Permission to use, copy, modify, and/or distribute this software for any
+purpose with or without fee is hereby granted, provided that the above
+copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+PERFORMANCE OF THIS SOFTWARE.
+*/
+
+/*
+ * Parallel scanner for the recursive scan pass (do_scan()).
+ *
+ * The serial scanner uses the global buffers `syspth[]`, `gstat[]`,
+ * `lbuf` and `rbuf` and may open dialogs for each error.  Here each
+ * worker thread has its own path and compare buffers.  Directories are
+ * queued as paths relative to the scan roots in one deque per worker.
+ * A worker takes work from the end of its own deque (depth first) and
+ * steals from the start of the deques of other workers when its own
+ * deque is empty.  Only the main thread calls curses functions and
+ * modifies `scan_db`.  Workers send the realpath of directories which
+ * contain differences, the directory statistics (option disp_dirstats)
+ * and error messages to the main thread.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/param.h>
+#ifdef HAVE_PTHREAD
+# include <pthread.h>
+#endif
+#include "compat.h"
+#include "main.h"
+#include "ui.h"
+#include "ui2.h"
+#include "diff.h"
+#include "db.h"
+#include "gq.h"
+#include "tc.h"
+#include "pscan.h"
+#include "snap.h"
+#include "digest.h"
+#include "fcmp.h"
+
+unsigned scan_threads = 1;
+
+#ifdef HAVE_PTHREAD
+
+struct ps_deque {
+    pthread_mutex_t mtx;
+    char **v;
+    size_t head; /* Index of first element */
+    size_t tail; /* Index after last element */
+    size_t size;
+};
+
+struct ps_worker {
+    pthread_t tid;
+    struct ps_deque dq;
+    char *buf[2];
+    struct fcmp cmp;
+    char pth[2][PATHSIZ];
+};
+
+struct ps_result {
+    char *pth; /* realpath of a directory with differences */
+    struct dir_stat *st; /* If set: statistics of directory `pth` */
+    char *msg; /* Error message */
+    struct ps_result *next;
+};
+
+static void *ps_worker_main(void *);
+static char *ps_take(struct ps_worker *);
+static void ps_push(struct ps_worker *, char *);
+static int ps_scan_dir(struct ps_worker *, const char *);
+static int ps_scan_right(struct ps_worker *, size_t, char **, size_t,
+                         struct dir_stat *);
+static int ps_cmp(struct ps_worker *, struct stat *);
+static int ps_cmp_reg(struct ps_worker *, off_t);
+static int ps_cmp_link(struct ps_worker *, off_t);
+static size_t ps_set_pth(struct ps_worker *, int, const char *);
+static void ps_add_diff(struct ps_worker *, int, size_t);
+static void ps_add_stat(struct ps_worker *, size_t, const struct dir_stat *);
+static void ps_err(const char *, const char *, int);
+static void ps_send(struct ps_result *);
+static int ps_names_cmp(const void *, const void *);
+static void *ps_mem(void *);
+
+static struct ps_worker *ps_workers;
+static unsigned ps_nworkers;
+static unsigned ps_ndeques;
+static char *ps_root[2];
+static size_t ps_root_len[2];
+
+/* Protects `ps_queued` and `ps_active` */
+static pthread_mutex_t ps_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ps_cv = PTHREAD_COND_INITIALIZER;
+/* Number of directories in all deques */
+static size_t ps_queued;
+/* Number of workers currently processing a directory */
+static unsigned ps_active;
+
+/* Protects the result list and `ps_done` */
+static pthread_mutex_t ps_res_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ps_res_cv = PTHREAD_COND_INITIALIZER;
+static struct ps_result *ps_res_head, **ps_res_tail = &ps_res_head;
+static unsigned ps_done;
+/* Number of read directories, for the progress message only */
+static volatile unsigned long ps_ndirs;
+
+/* For ps_mem() */
+static pthread_t ps_main_tid;
+
+/* Copy of `dontcmp`, set by the main thread on key '%' */
+static volatile int ps_nocmp;
+
+bool
+pscan_usable(void)
+{
+    return scan_threads != 1 && scan && !cli_mode && !bmode && !fmode &&
+           !file_pattern && !find_dir_name && !snap_sides;
+}
+
+int
+pscan_run(void)
+{
+    int rv = 0;
+    unsigned i, n;
+    time_t lpt = 0, t;
+
+    if (!(n = scan_threads)) {
+        long l = sysconf(_SC_NPROCESSORS_ONLN);
+        n = l > 1 ? (unsigned)l : 1;
+    }
+#if defined(TRACE)
+    fprintf(debug, "->pscan_run(%u threads) lp(%s) rp(%s)\n",
+            n, syspth[0], syspth[1]);
+#endif
+    for (i = 0; i < 2; i++) {
+        syspth[i][pthlen[i]] = 0;
+        ps_root[i] = syspth[i];
+        ps_root_len[i] = pthlen[i];
+    }
+
+    ps_main_tid = pthread_self();
+    ps_nocmp = dontcmp;
+    ps_queued = 0;
+    ps_active = 0;
+    ps_done = 0;
+    ps_ndirs = 0;
+    ps_workers = ps_mem(calloc(n, sizeof(struct ps_worker)));
+    ps_ndeques = n;
+
+    for (i = 0; i < n; i++) {
+        struct ps_worker *w = ps_workers + i;
+
+        pthread_mutex_init(&w->dq.mtx, NULL);
+        w->buf[0] = ps_mem(malloc(BUF_SIZE));
+        w->buf[1] = ps_mem(malloc(BUF_SIZE));
+        w->cmp.sbuf[0] = w->buf[0];
+        w->cmp.sbuf[1] = w->buf[1];
+    }
+
+    ps_push(ps_workers, ps_mem(strdup("")));
+
+    for (ps_nworkers = 0; ps_nworkers < n; ps_nworkers++) {
+        if ((errno = pthread_create(&ps_workers[ps_nworkers].tid, NULL,
+                                    ps_worker_main,
+                                    ps_workers + ps_nworkers))) {
+            printerr(strerror(errno), "pthread_create");
+            break;
+        }
+    }
+
+    if (!ps_nworkers) {
+        /* Not a single thread: Process queue in main thread */
+        ps_worker_main(ps_workers);
+    }
+
+    pthread_mutex_lock(&ps_res_mtx);
+
+    while (1) {
+        struct ps_result *r;
+        struct timespec ts;
+
+        while ((r = ps_res_head)) {
+            if (!(ps_res_head = r->next))
+                ps_res_tail = &ps_res_head;
+            pthread_mutex_unlock(&ps_res_mtx);
+
+            if (r->st) {
+                scan_db_stat(r->pth, r->st);
+                free(r->st);
+                free(r->pth);
+            } else if (r->pth) {
+                add_diff_rpath(r->pth); /* frees r->pth */
+                rv |= 1;
+            } else {
+                rv |= 2;
+
+                if (!ign_diff_errs &&
+                    dialog(ign_txt, NULL, "%s", r->msg) == 'i')
+                {
+                    ign_diff_errs = TRUE;
+                }
+
+                free(r->msg);
+            }
+
+            free(r);
+            pthread_mutex_lock(&ps_res_mtx);
+        }
+
+        if (ps_done)
+            break;
+
+        pthread_mutex_unlock(&ps_res_mtx);
+
+        if (!ps_nocmp && getch() == '%') {
+            ps_nocmp = 1;
+            dontcmp = TRUE;
+        }
+
+        if ((t = time(NULL)) - lpt) {
+            printerr(NULL, "%lu directories read (%u threads)", ps_ndirs, n);
+            lpt = t;
+        }
+
+        clock_gettime(CLOCK_REALTIME, &ts);
+
+        if ((ts.tv_nsec += 100000000) >= 1000000000) {
+            ts.tv_nsec -= 1000000000;
+            ts.tv_sec++;
+        }
+
+        pthread_mutex_lock(&ps_res_mtx);
+
+        if (!ps_res_head && !ps_done)
+            pthread_cond_timedwait(&ps_res_cv, &ps_res_mtx, &ts);
+    }
+
+    pthread_mutex_unlock(&ps_res_mtx);
+
+    for (i = 0; i < ps_nworkers; i++)
+        pthread_join(ps_workers[i].tid, NULL);
+
+    for (i = 0; i < n; i++) {
+        struct ps_worker *w = ps_workers + i;
+
+        pthread_mutex_destroy(&w->dq.mtx);
+        free(w->dq.v);
+        free(w->buf[0]);
+        free(w->buf[1]);
+        fcmp_free(&w->cmp);
+    }
+
+    free(ps_workers);
+    ps_workers = NULL;
+#if defined(TRACE)
+    fprintf(debug, "<-pscan_run: %d\n", rv);
+#endif
+    return rv;
+}
+
+static void *
+ps_worker_main(void *arg)
+{
+    struct ps_worker *w = arg;
+
+    pthread_mutex_lock(&ps_mtx);
+
+    while (1) {
+        char *rel;
+
+        while (!ps_queued && ps_active)
+            pthread_cond_wait(&ps_cv, &ps_mtx);
+
+        if (!ps_queued) /* and !ps_active */
+            break;
+
+        /* Reserve one directory.  It is taken from any deque below. */
+        ps_queued--;
+        ps_active++;
+        pthread_mutex_unlock(&ps_mtx);
+
+        rel = ps_take(w);
+        ps_scan_dir(w, rel);
+        free(rel);
+
+        pthread_mutex_lock(&ps_mtx);
+        ps_ndirs++;
+        ps_active--;
+    }
+
+    pthread_cond_broadcast(&ps_cv);
+    pthread_mutex_unlock(&ps_mtx);
+
+    pthread_mutex_lock(&ps_res_mtx);
+    ps_done = 1;
+    pthread_cond_signal(&ps_res_cv);
+    pthread_mutex_unlock(&ps_res_mtx);
+    return NULL;
+}
+
+/* Must only be called after a directory had been reserved. */
+
+static char *
+ps_take(struct ps_worker *w)
+{
+    char *s = NULL;
+    unsigned i;
+
+    pthread_mutex_lock(&w->dq.mtx);
+
+    if (w->dq.tail > w->dq.head)
+        s = w->dq.v[--w->dq.tail];
+
+    pthread_mutex_unlock(&w->dq.mtx);
+
+    for (i = (unsigned)(w - ps_workers); !s; ) {
+        struct ps_deque *q;
+
+        if (++i >= ps_ndeques)
+            i = 0;
+
+        q = &ps_workers[i].dq;
+        pthread_mutex_lock(&q->mtx);
+
+        if (q->tail > q->head)
+            s = q->v[q->head++];
+
+        pthread_mutex_unlock(&q->mtx);
+    }
+
+    return s;
+}
+
+static void
+ps_push(struct ps_worker *w, char *s)
+{
+    struct ps_deque *q = &w->dq;
+
+    pthread_mutex_lock(&q->mtx);
+
+    if (q->head == q->tail) {
+        q->head = q->tail = 0;
+    } else if (q->tail == q->size && q->head) {
+        memmove(q->v, q->v + q->head, (q->tail - q->head) * sizeof(char *));
+        q->tail -= q->head;
+        q->head = 0;
+    }
+
+    if (q->tail == q->size) {
+        q->size = q->size ? q->size * 2 : 64;
+        q->v = ps_mem(realloc(q->v, q->size * sizeof(char *)));
+    }
+
+    q->v[q->tail++] = s;
+    pthread_mutex_unlock(&q->mtx);
+
+    pthread_mutex_lock(&ps_mtx);
+    ps_queued++;
+    pthread_cond_signal(&ps_cv);
+    pthread_mutex_unlock(&ps_mtx);
+}
+
+/* Same checks as scan_left_dir(), left_dir_scan_mode() and
+ * scan_right_dir() for diff mode. */
+
+static int
+ps_scan_dir(struct ps_worker *w, const char *rel)
+{
+    DIR *d;
+    struct dirent *ent;
+    char **names = NULL;
+    size_t nnames = 0, names_size = 0, i;
+    size_t l[2];
+    int fd[2];
+    int dir_diff = 0;
+    int rv = 0;
+    struct dir_stat st2;
+    bool ldir = FALSE;
+
+    memset(&st2, 0, sizeof st2);
+
+    l[0] = ps_set_pth(w, 0, rel);
+    l[1] = ps_set_pth(w, 1, rel);
+#if defined(TRACE) && 1
+    fprintf(debug, "  ps_scan_dir lp(%s) rp(%s)\n", w->pth[0], w->pth[1]);
+#endif
+
+    if (!(d = opendir(w->pth[0]))) {
+        if (errno != ENOENT) {
+            ps_err("opendir", w->pth[0], errno);
+            rv |= 2;
+        }
+
+        goto right_tree;
+    }
+
+    ldir = TRUE;
+    fd[0] = dirfd(d);
+    fd[1] = open_dir_fd(w->pth[1]);
+
+    while (1) {
+        struct stat st[2];
+        const char *name;
+        mode_t dtype;
+        char *s;
+
+        errno = 0;
+
+        if (!(ent = readdir(d))) {
+            if (errno) {
+                w->pth[0][l[0]] = 0;
+                ps_err("readdir", w->pth[0], errno);
+                rv |= 2;
+            }
+
+            break;
+        }
+
+        name = ent->d_name;
+
+        if (*name == '.' && (!name[1] || (name[1] == '.' && !name[2])))
+            continue;
+
+        dtype = dirent_type(ent);
+
+        if (nnames == names_size) {
+            names_size = names_size ? names_size * 2 : 64;
+            names = ps_mem(realloc(names, names_size * sizeof(char *)));
+        }
+
+        names[nnames++] = s = ps_mem(strdup(name));
+
+        for (i = 0; i < 2; i++) {
+            if (l[i] + strlen(s) + 2 > PATHSIZ) {
+                ps_err("Path buffer overflow", w->pth[i], 0);
+                rv |= 2;
+                break;
+            }
+
+            w->pth[i][l[i]] = '/';
+            strcpy(w->pth[i] + l[i] + 1, s);
+
+            if (!i && S_ISDIR(dtype)) {
+                /* Type from readdir() is sufficient */
+                st[0].st_mode = dtype;
+                continue;
+            }
+
+            if (stat_at(fd[i], fd[i] == AT_FDCWD ? w->pth[i] : s, &st[i],
+                        NULL) == -1)
+            {
+                if (errno != ENOENT) {
+                    ps_err("stat", w->pth[i], errno);
+                    rv |= 2;
+                    break;
+                }
+
+                st[i].st_mode = 0;
+            }
+        }
+
+        if (i < 2)
+            continue;
+
+        if (S_ISDIR(st[0].st_mode) && S_ISDIR(st[1].st_mode)) {
+            size_t lr = strlen(rel);
+            char *p = ps_mem(malloc(lr + strlen(s) + 2));
+
+            if (lr) {
+                memcpy(p, rel, lr);
+                p[lr++] = '/';
+            }
+
+            strcpy(p + lr, s);
+            ps_push(w, p);
+            continue;
+        }
+
+        /* The directory is already known as different.  Only its
+         * subdirectories are still of interest, if no statistics are
+         * collected. */
+        if (dir_diff && !add_dstat)
+            continue;
+
+        if (!st[1].st_mode)
+            st2.only[0] += add_dstat ?
+                count_tree_files(w->pth[0], st[0].st_mode) : 1;
+
+        switch (ps_cmp(w, st)) {
+        case 0:
+            if ((st[0].st_mode & S_IFMT) == (st[1].st_mode & S_IFMT))
+                st2.equal++;
+
+            break;
+        case 1:
+            dir_diff = 1;
+
+            if (!st[1].st_mode)
+                break;
+
+            st2.diff++;
+
+            if (S_ISREG(st[0].st_mode) && S_ISREG(st[1].st_mode))
+                st2.dsiz += MAX(st[0].st_size, st[1].st_size);
+
+            break;
+        default:
+            rv |= 2;
+        }
+    }
+
+    closedir(d);
+
+    if (fd[1] != AT_FDCWD)
+        close(fd[1]);
+
+    if (dir_diff)
+        ps_add_diff(w, 0, l[0]);
+
+right_tree:
+    if (!real_diff || add_dstat) {
+        qsort(names, nnames, sizeof(char *), ps_names_cmp);
+        rv |= ps_scan_right(w, l[1], names, nnames,
+                            add_dstat ? &st2 : NULL);
+    }
+
+    /* The statistics are stored for the left directory */
+    if (add_dstat && ldir)
+        ps_add_stat(w, l[0], &st2);
+
+    for (i = 0; i < nnames; i++)
+        free(names[i]);
+
+    free(names);
+    return rv;
+}
+
+/* `st`: If set, all one sided files are counted */
+
+static int
+ps_scan_right(struct ps_worker *w, size_t l, char **names, size_t nnames,
+              struct dir_stat *st)
+{
+    DIR *d;
+    struct dirent *ent;
+    int rv = 0;
+    bool one_sided = FALSE;
+
+    w->pth[1][l] = 0;
+
+    if (!(d = opendir(w->pth[1]))) {
+        if (errno != ENOENT) {
+            ps_err("opendir", w->pth[1], errno);
+            rv |= 2;
+        }
+
+        return rv;
+    }
+
+    while (1) {
+        const char *name;
+
+        errno = 0;
+
+        if (!(ent = readdir(d))) {
+            if (errno) {
+                ps_err("readdir", w->pth[1], errno);
+                rv |= 2;
+            }
+
+            break;
+        }
+
+        name = ent->d_name;
+
+        if (*name == '.' && (!name[1] || (name[1] == '.' && !name[2])))
+            continue;
+
+        if (bsearch(&name, names, nnames, sizeof(char *), ps_names_cmp))
+            continue;
+
+#if defined(TRACE) && 1
+        fprintf(debug, "  ps_scan_right: One sided: %s\n", name);
+#endif
+        if (st) {
+            if (!one_sided && !real_diff)
+                ps_add_diff(w, 1, l);
+
+            one_sided = TRUE;
+
+            if (l + strlen(name) + 2 > PATHSIZ) {
+                st->only[1]++;
+                continue;
+            }
+
+            w->pth[1][l] = '/';
+            strcpy(w->pth[1] + l + 1, name);
+            st->only[1] += count_tree_files(w->pth[1], dirent_type(ent));
+            w->pth[1][l] = 0;
+            continue;
+        }
+
+        ps_add_diff(w, 1, l);
+        break;
+    }
+
+    closedir(d);
+    return rv;
+}
+
+/* Compares left and right directory entry which are not both directories.
+ * Return value as for cmp_file(). */
+
+static int
+ps_cmp(struct ps_worker *w, struct stat *st)
+{
+    mode_t m0 = st[0].st_mode;
+    mode_t m1 = st[1].st_mode;
+
+    if (S_ISREG(m0) && S_ISREG(m1)) {
+        if (st[0].st_size != st[1].st_size)
+            return 1;
+
+        if (st[0].st_ino == st[1].st_ino && st[0].st_dev == st[1].st_dev)
+            return 0;
+
+        return ps_cmp_reg(w, st[0].st_size);
+    }
+
+    if (S_ISLNK(m0) && S_ISLNK(m1)) {
+        if (st[0].st_size != st[1].st_size)
+            return 1;
+
+        return ps_cmp_link(w, st[0].st_size);
+    }
+
+    if ((S_ISSOCK(m0) && S_ISSOCK(m1)) || (S_ISFIFO(m0) && S_ISFIFO(m1)))
+        return 0;
+
+    if ((S_ISBLK(m0) && S_ISBLK(m1)) || (S_ISCHR(m0) && S_ISCHR(m1)))
+        return st[0].st_rdev != st[1].st_rdev ? 1 : 0;
+
+    if (real_diff)
+        return 0;
+
+    return !m0 || !m1 || m0 != m1 ? 1 : 0;
+}
+
+static int
+ps_cmp_reg(struct ps_worker *w, off_t siz)
+{
+    int f[2] = { -1, -1 };
+    int rv = 0;
+    int i;
+
+    if (!siz || ps_nocmp)
+        return 0;
+
+    for (i = 0; i < 2; i++) {
+        if ((f[i] = open(w->pth[i], O_RDONLY)) == -1) {
+            ps_err("open", w->pth[i], errno);
+            rv |= 2;
+            goto close;
+        }
+    }
+
+    if ((rv = digest_cmp(&w->cmp, f, &i)) == -1)
+        rv = fcmp_run(&w->cmp, f, siz, NULL, &i);
+
+    if (rv == 2)
+        ps_err("read", w->pth[i], errno);
+
+close:
+    for (i = 0; i < 2; i++) {
+        if (f[i] != -1)
+            close(f[i]);
+    }
+
+    return rv;
+}
+
+static int
+ps_cmp_link(struct ps_worker *w, off_t siz)
+{
+    char *buf[2];
+    size_t bufsiz = BUF_SIZE;
+    ssize_t n[2];
+    int i;
+    int rv = 0;
+
+    if (!siz || ps_nocmp)
+        return 0;
+
+    if (siz < BUF_SIZE) {
+        buf[0] = w->buf[0];
+        buf[1] = w->buf[1];
+    } else {
+        /* Long targets like read_link() does */
+        bufsiz = (size_t)siz + 1;
+        buf[0] = ps_mem(malloc(bufsiz));
+        buf[1] = ps_mem(malloc(bufsiz));
+    }
+
+    for (i = 0; i < 2; i++) {
+        if ((n[i] = readlink(w->pth[i], buf[i], bufsiz)) == -1) {
+            ps_err("readlink", w->pth[i], errno);
+            rv = 2;
+            goto ret;
+        }
+    }
+
+    if (n[0] != n[1] || memcmp(buf[0], buf[1], (size_t)n[0]))
+        rv = 1;
+
+ret:
+    if (buf[0] != w->buf[0]) {
+        free(buf[1]);
+        free(buf[0]);
+    }
+
+    return rv;
+}
+
+static size_t
+ps_set_pth(struct ps_worker *w, int i, const char *rel)
+{
+    size_t l = ps_root_len[i];
+    size_t lr = strlen(rel);
+
+    memcpy(w->pth[i], ps_root[i], l);
+
+    if (lr && l + lr + 2 <= PATHSIZ) {
+        if (!l || w->pth[i][l - 1] != '/')
+            w->pth[i][l++] = '/';
+
+        memcpy(w->pth[i] + l, rel, lr);
+        l += lr;
+    }
+
+    w->pth[i][l] = 0;
+    return l;
+}
+
+static void
+ps_add_diff(struct ps_worker *w, int i, size_t l)
+{
+    struct ps_result *r;
+    char *rp;
+
+    w->pth[i][l] = 0;
+
+    if (!(rp = realpath(w->pth[i], NULL))) {
+        ps_err("realpath", w->pth[i], errno);
+        return;
+    }
+
+    r = ps_mem(malloc(sizeof(struct ps_result)));
+    r->pth = rp;
+    r->st = NULL;
+    r->msg = NULL;
+    ps_send(r);
+}
+
+static void
+ps_add_stat(struct ps_worker *w, size_t l, const struct dir_stat *st)
+{
+    struct ps_result *r;
+    char *rp;
+
+    w->pth[0][l] = 0;
+
+    if (!(rp = realpath(w->pth[0], NULL))) {
+        ps_err("realpath", w->pth[0], errno);
+        return;
+    }
+
+    r = ps_mem(malloc(sizeof(struct ps_result)));
+    r->pth = rp;
+    r->st = ps_mem(malloc(sizeof(struct dir_stat)));
+    *r->st = *st;
+    r->msg = NULL;
+    ps_send(r);
+}
+
+static void
+ps_err(const char *op, const char *pth, int e)
+{
+    struct ps_result *r;
+    char *s;
+    size_t l = strlen(op) + strlen(pth) + 8;
+
+    if (e)
+        l += strlen(strerror(e));
+
+    s = ps_mem(malloc(l));
+
+    if (e)
+        snprintf(s, l, "%s \"%s\": %s", op, pth, strerror(e));
+    else
+        snprintf(s, l, "%s \"%s\"", op, pth);
+
+    r = ps_mem(malloc(sizeof(struct ps_result)));
+    r->pth = NULL;
+    r->st = NULL;
+    r->msg = s;
+    ps_send(r);
+}
+
+static void
+ps_send(struct ps_result *r)
+{
+    r->next = NULL;
+    pthread_mutex_lock(&ps_res_mtx);
+    *ps_res_tail = r;
+    ps_res_tail = &r->next;
+    pthread_cond_signal(&ps_res_cv);
+    pthread_mutex_unlock(&ps_res_mtx);
+}
+
+static int
+ps_names_cmp(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/* Exits if an allocation failed.  Workers can't use the curses dialog
+ * of printerr(). */
+
+static void *
+ps_mem(void *p)
+{
+    if (p)
+        return p;
+
+    if (pthread_equal(pthread_self(), ps_main_tid))
+        printerr(strerror(errno), "malloc");
+    else
+        fprintf(stderr, "%s: malloc: %s\n", prog, strerror(errno));
+
+    exit(EXIT_STATUS_ERROR);
+}
+
+#else /* HAVE_PTHREAD */
+
+bool
+pscan_usable(void)
+{
+    return FALSE;
+}
+
+int
+pscan_run(void)
+{
+    return 0;
+}
+
+#endif /* HAVE_PTHREAD */
@@ -0,0 +1,33 @@
+#ifndef PSCAN_H
+#define PSCAN_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "compat.h"
+
+/* Number of scanner threads (-j, RC option "threads").
+ * 1 selects the serial scanner, 0 the number of online CPUs. */
+extern unsigned scan_threads;
+
+/* Returns TRUE if the recursive scan (do_scan()) can be done by
+ * pscan_run() with the current options. */
+bool pscan_usable(void);
+
+/* Parallel version of the recursive build_diff_db() scan pass.
+ *
+ * Input:
+ *   syspth[0], syspth[1], pthlen[0], pthlen[1]
+ * Output:
+ *   scan_db
+ *   Return value: Combination of
+ *     1 difference found
+ *     2 on error */
+int pscan_run(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PSCAN_H */
@@ -0,0 +1,148 @@
+#include <stdexcept>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "compat.h"
+#include "pscan_test.h"
+#include "main.h"
+#include "test.h"
+#include "diff.h"
+#include "tc.h"
+#include "db.h"
+#include "pscan.h"
+
+static void writeFile(const std::string &path, const char *const dat)
+{
+    FILE *const fh = fopen(path.c_str(), "w");
+
+    if (!fh)
+        FATAL_ERROR;
+
+    fputs(dat, fh);
+
+    if (fclose(fh))
+        FATAL_ERROR;
+}
+
+static void makeDir(const std::string &path)
+{
+    if (mkdir(path.c_str(), 0777))
+        FATAL_ERROR;
+}
+
+static void setScanArgs(const char *const left, const char *const right)
+{
+    pthlen[0] = strlen(left);
+    memcpy(syspth[0], left, pthlen[0] + 1);
+    pthlen[1] = strlen(right);
+    memcpy(syspth[1], right, pthlen[1] + 1);
+
+    followlinks = 0;
+    bmode = FALSE;
+    fmode = FALSE;
+    scan = 1;
+}
+
+void PscanTest::run() const
+{
+    fprintf(debug, "->pscan_test\n");
+    sameScanDb();
+    fprintf(debug, "<-pscan_test\n");
+}
+
+// The parallel scan must find the same directories with differences as
+// the serial scan of build_diff_db()
+
+void PscanTest::sameScanDb() const
+{
+    fprintf(debug, "->sameScanDb\n");
+    const std::string side[2] { left, right };
+    std::vector<std::string> dirs { "", "/Same", "/Diff", "/Diff/Deep",
+                                    "/Links", "/Only", "/Many" };
+
+    for (int i = 0; i < 2; ++i) {
+        makeDir(side[i]);
+        makeDir(side[i] + "/Same");
+        writeFile(side[i] + "/Same/f", "same\n");
+        makeDir(side[i] + "/Diff");
+        writeFile(side[i] + "/Diff/g", "same\n");
+        makeDir(side[i] + "/Diff/Deep");
+        writeFile(side[i] + "/Diff/Deep/f", i ? "right\n" : "left\n");
+        makeDir(side[i] + "/Links");
+
+        if (symlink(i ? "y" : "x", (side[i] + "/Links/l").c_str()))
+            FATAL_ERROR;
+
+        makeDir(side[i] + "/Many");
+
+        // Enough directories for all threads, one differs
+
+        for (int k = 0; k < 40; ++k) {
+            const std::string d { "/Many/" + std::to_string(k) };
+            makeDir(side[i] + d);
+            writeFile(side[i] + d + "/f", k == 23 && i ? "23\n" : "same\n");
+
+            if (!i)
+                dirs.push_back(d);
+        }
+    }
+
+    makeDir(side[0] + "/Only");
+    writeFile(side[0] + "/Only/f", "left\n");
+
+    setScanArgs(left, right);
+    free_scan_db(FALSE);
+    scan_threads = 1;
+    const int serialRv = build_diff_db(3);
+    const std::vector<unsigned long> serial { scanDbCounts(dirs) };
+
+    free_scan_db(FALSE);
+    setScanArgs(left, right);
+    scan_threads = 4;
+    const int parallelRv = pscan_run();
+    const std::vector<unsigned long> parallel { scanDbCounts(dirs) };
+
+    scan_threads = 1;
+    scan = 0;
+    free_scan_db(FALSE);
+
+    if (serialRv != parallelRv || serial != parallel)
+        FATAL_ERROR;
+
+    // Check that the trees had been scanned at all
+
+    if (!serial[0] || serial[1] || !serial[3])
+        FATAL_ERROR;
+
+    fprintf(debug, "<-sameScanDb\n");
+}
+
+// Returns the number of directories with differences of each directory
+// `dirs` of both trees
+
+std::vector<unsigned long> PscanTest::scanDbCounts(
+    const std::vector<std::string> &dirs) const
+{
+    std::vector<unsigned long> v;
+
+    for (const char *const root : { left, right }) {
+        for (const std::string &d : dirs) {
+            char *const rp = realpath((root + d).c_str(), nullptr);
+
+            if (!rp) {
+                v.push_back(-1UL); // Only left
+                continue;
+            }
+
+            v.push_back(scan_db_cnt(rp));
+            fprintf(debug, "  %s: %lu\n", rp, v.back());
+            free(rp);
+        }
+    }
+
+    return v;
+}
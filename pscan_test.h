@@ -0,0 +1,21 @@
+#ifndef PSCAN_TEST_H
+#define PSCAN_TEST_H
+
+#include <string>
+#include <vector>
+
+class PscanTest
+{
+public:
+    void run() const;
+
+private:
+    void sameScanDb() const;
+    std::vector<unsigned long> scanDbCounts(
+        const std::vector<std::string> &dirs) const;
+
+    const char *const left { TEST_DIR "/Scan left" };
+    const char *const right { TEST_DIR "/Scan right" };
+};
+
+#endif // PSCAN_TEST_H
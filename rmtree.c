@@ -0,0 +1,491 @@
+/*
+Copyright (c) 2016-2018, Carsten Kunze <carsten.kunze@arcor.de>
+
+Permission to use, copy, modify, and/or distribute this software for any
+purpose with or without fee is hereby granted, provided that the above
+copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+PERFORMANCE OF THIS SOFTWARE.
+*/
+
+/*
+ * Removal of directory trees by threads.
+ *
+ * Directories to be read are kept on one stack shared by all threads.
+ * A thread opens a directory, removes its files with unlinkat(2)
+ * relative to the directory descriptor and pushes the subdirectories,
+ * hence sibling directories are processed by different threads.  Each
+ * directory counts its pending subdirectories.  When the last one had
+ * been removed, the thread which removed it removes the parent
+ * directory too.
+ *
+ * Subdirectories are opened and removed relative to the descriptor of
+ * their parent, which stays open until all of them had been removed.
+ * Only the last path component is followed, so a directory which is
+ * replaced by a symbolic link during the removal is not left.
+ *
+ * Only the main thread calls curses functions.  It takes the error
+ * messages with rmtree_err() and shows them with the usual dialogs.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <time.h>
+#include <sys/stat.h>
+#ifdef HAVE_PTHREAD
+# include <pthread.h>
+#endif
+#include "compat.h"
+#include "main.h"
+#include "ui.h"
+#include "pscan.h"
+#include "rmtree.h"
+
+#ifdef HAVE_PTHREAD
+
+struct rt_dir {
+    char *pth;
+    const char *name; /* Last component of `pth` */
+    int fd; /* -1 if not open */
+    struct rt_dir *parent;
+    /* Reading this directory and subdirectories not yet removed */
+    unsigned pending;
+    struct rt_dir *next; /* Stack */
+    struct rt_dir *all; /* All entries, for rmtree_end() */
+};
+
+struct rt_err {
+    char *msg;
+    struct rt_err *next;
+};
+
+static void *rt_worker(void *);
+static void rt_scan(struct rt_dir *);
+static struct rt_dir *rt_new(char *, const char *, struct rt_dir *);
+static int rt_open(struct rt_dir *);
+static void rt_release(struct rt_dir *);
+static void rt_err(const char *, const char *, const char *, int);
+
+/* Protects all data below */
+static pthread_mutex_t rt_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t rt_cv = PTHREAD_COND_INITIALIZER; /* to workers */
+static pthread_cond_t rt_main_cv = PTHREAD_COND_INITIALIZER;
+static pthread_t *rt_tid;
+static unsigned rt_nthreads;
+static unsigned rt_running;
+static unsigned rt_busy; /* Threads reading a directory */
+static struct rt_dir *rt_stack;
+static struct rt_dir *rt_all;
+static struct rt_err *rt_err_head, **rt_err_tail = &rt_err_head;
+static off_t rt_nbytes;
+static long rt_nfiles;
+static unsigned rt_md;
+static volatile bool rt_stop;
+
+int
+rmtree_start(const char *pth, unsigned md)
+{
+    unsigned n;
+
+    if (!(n = scan_threads)) {
+        long l = sysconf(_SC_NPROCESSORS_ONLN);
+        n = l > 1 ? (unsigned)l : 1;
+    }
+#if defined(TRACE)
+    fprintf(debug, "->rmtree_start(%s, %u threads)\n", pth, n);
+#endif
+    rt_md = md;
+    rt_stop = FALSE;
+    rt_busy = 0;
+    rt_nbytes = 0;
+    rt_nfiles = 0;
+    rt_tid = malloc(n * sizeof(*rt_tid));
+    pthread_mutex_lock(&rt_mtx);
+    rt_new(strdup(pth), NULL, NULL);
+
+    for (rt_nthreads = 0; rt_nthreads < n; rt_nthreads++) {
+        if ((errno = pthread_create(rt_tid + rt_nthreads, NULL, rt_worker,
+                                    NULL))) {
+            break;
+        }
+    }
+
+    rt_running = rt_nthreads;
+    pthread_mutex_unlock(&rt_mtx);
+
+    if (!rt_nthreads) {
+        rmtree_end();
+        return -1;
+    }
+
+    return 0;
+}
+
+bool
+rmtree_wait(off_t *nbytes, long *nfiles)
+{
+    bool done;
+
+    pthread_mutex_lock(&rt_mtx);
+
+    if (rt_running && !rt_err_head) {
+        struct timespec ts;
+
+        clock_gettime(CLOCK_REALTIME, &ts);
+
+        if ((ts.tv_nsec += 100000000) >= 1000000000) {
+            ts.tv_nsec -= 1000000000;
+            ts.tv_sec++;
+        }
+
+        pthread_cond_timedwait(&rt_main_cv, &rt_mtx, &ts);
+    }
+
+    *nbytes += rt_nbytes;
+    *nfiles += rt_nfiles;
+    rt_nbytes = 0;
+    rt_nfiles = 0;
+    done = !rt_running && !rt_err_head;
+    pthread_mutex_unlock(&rt_mtx);
+    return done;
+}
+
+char *
+rmtree_err(void)
+{
+    struct rt_err *e;
+    char *s = NULL;
+
+    pthread_mutex_lock(&rt_mtx);
+
+    if ((e = rt_err_head)) {
+        if (!(rt_err_head = e->next))
+            rt_err_tail = &rt_err_head;
+
+        s = e->msg;
+        free(e);
+    }
+
+    pthread_mutex_unlock(&rt_mtx);
+    return s;
+}
+
+void
+rmtree_stop(void)
+{
+    pthread_mutex_lock(&rt_mtx);
+    rt_stop = TRUE;
+    pthread_cond_broadcast(&rt_cv);
+    pthread_mutex_unlock(&rt_mtx);
+}
+
+void
+rmtree_end(void)
+{
+    unsigned i;
+
+    for (i = 0; i < rt_nthreads; i++)
+        pthread_join(rt_tid[i], NULL);
+
+    free(rt_tid);
+    rt_tid = NULL;
+    rt_nthreads = 0;
+
+    while (rt_all) {
+        struct rt_dir *d = rt_all;
+
+        rt_all = d->all;
+
+        if (d->fd != -1)
+            close(d->fd); /* Stopped */
+
+        free(d->pth);
+        free(d);
+    }
+
+    rt_stack = NULL;
+#if defined(TRACE)
+    fprintf(debug, "<-rmtree_end\n");
+#endif
+}
+
+static void *
+rt_worker(void *arg)
+{
+    (void)arg;
+    pthread_mutex_lock(&rt_mtx);
+
+    while (1) {
+        struct rt_dir *d;
+
+        while (!rt_stack && rt_busy && !rt_stop)
+            pthread_cond_wait(&rt_cv, &rt_mtx);
+
+        if (!rt_stack || rt_stop)
+            break;
+
+        d = rt_stack;
+        rt_stack = d->next;
+        rt_busy++;
+        pthread_mutex_unlock(&rt_mtx);
+
+        rt_scan(d);
+
+        pthread_mutex_lock(&rt_mtx);
+        rt_release(d);
+
+        if (!--rt_busy && !rt_stack)
+            pthread_cond_broadcast(&rt_cv);
+    }
+
+    rt_running--;
+    pthread_cond_signal(&rt_main_cv);
+    pthread_mutex_unlock(&rt_mtx);
+    return NULL;
+}
+
+/* Removes the files of directory `d` and pushes the subdirectories */
+
+static void
+rt_scan(struct rt_dir *d)
+{
+    DIR *dp;
+    struct dirent *ent;
+    off_t nbytes = 0;
+    long nfiles = 0;
+    int fd;
+
+    if ((fd = rt_open(d)) == -1 || (fd = dup(fd)) == -1 ||
+        !(dp = fdopendir(fd)))
+    {
+        rt_err("opendir", d->pth, NULL, errno);
+
+        if (fd != -1 && fd != d->fd)
+            close(fd);
+
+        return;
+    }
+
+    while (!rt_stop) {
+        const char *name;
+        struct stat st;
+        bool isdir;
+
+        errno = 0;
+
+        if (!(ent = readdir(dp))) {
+            if (errno)
+                rt_err("readdir", d->pth, NULL, errno);
+
+            break;
+        }
+
+        name = ent->d_name;
+
+        if (*name == '.' && (!name[1] || (name[1] == '.' && !name[2])))
+            continue;
+
+        st.st_size = 0;
+
+        if (ent->d_type == DT_UNKNOWN ||
+            ((rt_md & 2) && ent->d_type != DT_DIR))
+        {
+            if (fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) == -1) {
+                if (errno != ENOENT)
+                    rt_err("stat", d->pth, name, errno);
+
+                continue; /* deleted after readdir */
+            }
+
+            isdir = S_ISDIR(st.st_mode) ? TRUE : FALSE;
+        } else {
+            isdir = ent->d_type == DT_DIR ? TRUE : FALSE;
+        }
+
+        if (isdir) {
+            size_t l = strlen(d->pth);
+            size_t l2 = strlen(name);
+            char *s = malloc(l + l2 + 2);
+
+            memcpy(s, d->pth, l);
+            s[l] = '/';
+            memcpy(s + l + 1, name, l2 + 1);
+
+            pthread_mutex_lock(&rt_mtx);
+            rt_new(s, s + l + 1, d);
+            pthread_cond_signal(&rt_cv);
+            pthread_mutex_unlock(&rt_mtx);
+        } else if (unlinkat(d->fd, name, 0) == -1) {
+            rt_err("unlink", d->pth, name, errno);
+        } else {
+            if (!wstat && verbose)
+                printf("File \"%s/%s\" removed\n", d->pth, name);
+
+            nbytes += st.st_size;
+            nfiles++;
+        }
+    }
+
+    closedir(dp);
+
+    if (rt_md & 1) {
+        pthread_mutex_lock(&rt_mtx);
+        rt_nbytes += nbytes;
+        rt_nfiles += nfiles;
+        pthread_mutex_unlock(&rt_mtx);
+    }
+}
+
+/* Opens directory `d` relative to its parent and makes it writable.
+ * Returns `d->fd` or -1 with `errno` set. */
+
+static int
+rt_open(struct rt_dir *d)
+{
+    const int pfd = d->parent ? d->parent->fd : AT_FDCWD;
+    const char *const name = d->parent ? d->name : d->pth;
+
+    if ((d->fd = openat(pfd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW))
+        == -1)
+    {
+        if (errno != EACCES)
+            return -1;
+
+        /* Just try it, openat(2) reports the error */
+        fchmodat(pfd, name, 0777, 0);
+
+        if ((d->fd = openat(pfd, name,
+                            O_RDONLY | O_DIRECTORY | O_NOFOLLOW)) == -1)
+        {
+            return -1;
+        }
+    }
+
+    fchmod(d->fd, 0777); /* Just try it, don't check for errors */
+    return d->fd;
+}
+
+/* Must be called with `rt_mtx` locked */
+
+static struct rt_dir *
+rt_new(char *pth, const char *name, struct rt_dir *parent)
+{
+    struct rt_dir *d = malloc(sizeof(struct rt_dir));
+
+    d->pth = pth;
+    d->name = name;
+    d->fd = -1;
+    d->parent = parent;
+    d->pending = 1;
+    d->next = rt_stack;
+    rt_stack = d;
+    d->all = rt_all;
+    rt_all = d;
+
+    if (parent)
+        parent->pending++;
+
+    return d;
+}
+
+/* Called with `rt_mtx` locked when `d` had been read or a subdirectory
+ * of `d` had been removed.  Removes `d` and then its parents if nothing
+ * is pending anymore. */
+
+static void
+rt_release(struct rt_dir *d)
+{
+    while (d && !--d->pending) {
+        if (rt_stop)
+            break;
+
+        pthread_mutex_unlock(&rt_mtx);
+
+        if (d->fd != -1) {
+            close(d->fd);
+            d->fd = -1;
+        }
+
+        if (unlinkat(d->parent ? d->parent->fd : AT_FDCWD,
+                     d->parent ? d->name : d->pth, AT_REMOVEDIR) == -1)
+        {
+            rt_err("rmdir", d->pth, NULL, errno);
+        }
+        else if (!wstat && verbose)
+            printf("Directory \"%s\" removed\n", d->pth);
+
+        pthread_mutex_lock(&rt_mtx);
+        d = d->parent;
+    }
+}
+
+static void
+rt_err(const char *op, const char *pth, const char *name, int e)
+{
+    struct rt_err *r = malloc(sizeof(struct rt_err));
+    size_t l = strlen(op) + strlen(pth) + strlen(strerror(e)) + 8;
+
+    if (name)
+        l += strlen(name) + 1;
+
+    r->msg = malloc(l);
+
+    if (name)
+        snprintf(r->msg, l, "%s \"%s/%s\": %s", op, pth, name, strerror(e));
+    else
+        snprintf(r->msg, l, "%s \"%s\": %s", op, pth, strerror(e));
+
+    r->next = NULL;
+    pthread_mutex_lock(&rt_mtx);
+    *rt_err_tail = r;
+    rt_err_tail = &r->next;
+    pthread_cond_signal(&rt_main_cv);
+    pthread_mutex_unlock(&rt_mtx);
+}
+
+#else /* HAVE_PTHREAD */
+
+int
+rmtree_start(const char *pth, unsigned md)
+{
+    (void)pth;
+    (void)md;
+    return -1;
+}
+
+bool
+rmtree_wait(off_t *nbytes, long *nfiles)
+{
+    (void)nbytes;
+    (void)nfiles;
+    return TRUE;
+}
+
+char *
+rmtree_err(void)
+{
+    return NULL;
+}
+
+void
+rmtree_stop(void)
+{
+}
+
+void
+rmtree_end(void)
+{
+}
+
+#endif /* HAVE_PTHREAD */
@@ -0,0 +1,35 @@
+#ifndef RMTREE_H
+#define RMTREE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <sys/types.h>
+#include "compat.h"
+
+/* Starts removing directory tree `pth` with `scan_threads` (-j) threads.
+ * md:
+ *   1: Count removed files
+ *   2: Count bytes of removed files (needs fstatat(2) for each file,
+ *      hence only set when the bytes are reported)
+ * Return value:
+ *   0: Ok
+ *   -1: No thread could be started, nothing done */
+int rmtree_start(const char *pth, unsigned md);
+/* Waits up to 100 ms for the threads.  Adds the counts since the last
+ * call to `*nbytes` and `*nfiles`.  Returns TRUE when all threads had
+ * finished. */
+bool rmtree_wait(off_t *nbytes, long *nfiles);
+/* Returns the next error message or NULL.  Must be freed. */
+char *rmtree_err(void);
+/* Stops the threads after the current directory */
+void rmtree_stop(void);
+/* Frees the data after rmtree_wait() had returned TRUE */
+void rmtree_end(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RMTREE_H */
@@ -0,0 +1,111 @@
+#include <stdexcept>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "compat.h"
+#include "rmtree_test.h"
+#include "main.h"
+#include "test.h"
+#include "pscan.h"
+#include "rmtree.h"
+
+static void writeFile(const std::string &path, const char *const dat)
+{
+    FILE *const fh = fopen(path.c_str(), "w");
+
+    if (!fh)
+        FATAL_ERROR;
+
+    fputs(dat, fh);
+
+    if (fclose(fh))
+        FATAL_ERROR;
+}
+
+void RmtreeTest::run() const
+{
+    fprintf(debug, "->rmtree_test\n");
+    removeNestedTree();
+    fprintf(debug, "<-rmtree_test\n");
+}
+
+// Removes a tree with several levels, a read-only directory and links to
+// a file and a directory outside the tree.  The link targets are kept.
+
+void RmtreeTest::removeNestedTree() const
+{
+    fprintf(debug, "->removeNestedTree\n");
+    std::string d { tree };
+
+    if (mkdir(tree, 0777) || mkdir(target, 0777))
+        FATAL_ERROR;
+
+    writeFile(std::string(target) + "/f", "keep\n");
+
+    // 4 levels of 2 directories with 3 files each
+
+    for (int level = 0; level < 4; ++level) {
+        for (int k = 0; k < 2; ++k) {
+            const std::string sub { d + "/" + std::to_string(k) };
+
+            if (mkdir(sub.c_str(), 0777))
+                FATAL_ERROR;
+
+            for (int i = 0; i < 3; ++i)
+                writeFile(sub + "/f" + std::to_string(i), "x");
+        }
+
+        d += "/0";
+    }
+
+    if (symlink("../../Remove link target/f", (d + "/File link").c_str()) ||
+        symlink("../../Remove link target", (d + "/Dir link").c_str()))
+    {
+        FATAL_ERROR;
+    }
+
+    if (chmod((std::string(tree) + "/1").c_str(), 0555))
+        FATAL_ERROR;
+
+    scan_threads = 4;
+    off_t nbytes = 0;
+    long nfiles = 0;
+
+    if (rmtree_start(tree, 1 | 2))
+        FATAL_ERROR;
+
+    while (!rmtree_wait(&nbytes, &nfiles));
+
+    char *const err = rmtree_err();
+    rmtree_end();
+    scan_threads = 1;
+
+    if (err) {
+        fprintf(debug, "  %s\n", err);
+        free(err);
+        FATAL_ERROR;
+    }
+
+    struct stat st;
+
+    if (lstat(tree, &st) != -1 || errno != ENOENT)
+        FATAL_ERROR;
+
+    // 24 files of 1 byte and the links
+
+    if (nfiles != 26 ||
+        nbytes != 24 + (off_t)(strlen("../../Remove link target/f") +
+                               strlen("../../Remove link target")))
+    {
+        FATAL_ERROR;
+    }
+
+    if (stat((std::string(target) + "/f").c_str(), &st) || st.st_size != 5)
+        FATAL_ERROR;
+
+    fprintf(debug, "<-removeNestedTree\n");
+}
@@ -0,0 +1,16 @@
+#ifndef RMTREE_TEST_H
+#define RMTREE_TEST_H
+
+class RmtreeTest
+{
+public:
+    void run() const;
+
+private:
+    void removeNestedTree() const;
+
+    const char *const tree { TEST_DIR "/Remove" };
+    const char *const target { TEST_DIR "/Remove link target" };
+};
+
+#endif // RMTREE_TEST_H
@@ -0,0 +1,174 @@
+/*
+Copyright (c) 2016-2018, Carsten Kunze <carsten.kunze@arcor.de>
+
+Permission to use, copy, modify, and/or distribute this software for any
+purpose with or without fee is hereby granted, provided that the above
+copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+PERFORMANCE OF THIS SOFTWARE.
+*/
+
+/* SHA-256 according FIPS 180-4 */
+
+#include <string.h>
+#include "sha256.h"
+
+#define ROR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void sha256_block(struct sha256 *, const unsigned char *);
+
+static const uint32_t k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+    0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+    0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+    0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+    0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+    0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+void
+sha256_init(struct sha256 *c)
+{
+    c->h[0] = 0x6a09e667;
+    c->h[1] = 0xbb67ae85;
+    c->h[2] = 0x3c6ef372;
+    c->h[3] = 0xa54ff53a;
+    c->h[4] = 0x510e527f;
+    c->h[5] = 0x9b05688c;
+    c->h[6] = 0x1f83d9ab;
+    c->h[7] = 0x5be0cd19;
+    c->len = 0;
+    c->n = 0;
+}
+
+void
+sha256_update(struct sha256 *c, const void *data, size_t l)
+{
+    const unsigned char *p = data;
+
+    c->len += l;
+
+    if (c->n) {
+        size_t m = 64 - c->n;
+
+        if (m > l)
+            m = l;
+
+        memcpy(c->buf + c->n, p, m);
+        c->n += m;
+        p += m;
+        l -= m;
+
+        if (c->n < 64)
+            return;
+
+        sha256_block(c, c->buf);
+        c->n = 0;
+    }
+
+    for (; l >= 64; p += 64, l -= 64)
+        sha256_block(c, p);
+
+    if (l) {
+        memcpy(c->buf, p, l);
+        c->n = l;
+    }
+}
+
+void
+sha256_final(struct sha256 *c, unsigned char md[SHA256_LEN])
+{
+    uint64_t bits = c->len * 8;
+    int i;
+
+    c->buf[c->n++] = 0x80;
+
+    if (c->n > 56) {
+        memset(c->buf + c->n, 0, 64 - c->n);
+        sha256_block(c, c->buf);
+        c->n = 0;
+    }
+
+    memset(c->buf + c->n, 0, 56 - c->n);
+
+    for (i = 0; i < 8; i++)
+        c->buf[56 + i] = (unsigned char)(bits >> (56 - 8 * i));
+
+    sha256_block(c, c->buf);
+
+    for (i = 0; i < 8; i++) {
+        md[4 * i    ] = (unsigned char)(c->h[i] >> 24);
+        md[4 * i + 1] = (unsigned char)(c->h[i] >> 16);
+        md[4 * i + 2] = (unsigned char)(c->h[i] >>  8);
+        md[4 * i + 3] = (unsigned char)(c->h[i]      );
+    }
+}
+
+static void
+sha256_block(struct sha256 *c, const unsigned char *p)
+{
+    uint32_t w[64];
+    uint32_t a, b, cc, d, e, f, g, h;
+    int i;
+
+    for (i = 0; i < 16; i++, p += 4)
+        w[i] = (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 |
+               (uint32_t)p[2] <<  8 | (uint32_t)p[3];
+
+    for (; i < 64; i++) {
+        uint32_t s0 = ROR(w[i - 15],  7) ^ ROR(w[i - 15], 18) ^
+                      (w[i - 15] >>  3);
+        uint32_t s1 = ROR(w[i -  2], 17) ^ ROR(w[i -  2], 19) ^
+                      (w[i -  2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    a  = c->h[0];
+    b  = c->h[1];
+    cc = c->h[2];
+    d  = c->h[3];
+    e  = c->h[4];
+    f  = c->h[5];
+    g  = c->h[6];
+    h  = c->h[7];
+
+    for (i = 0; i < 64; i++) {
+        uint32_t t1 = h + (ROR(e, 6) ^ ROR(e, 11) ^ ROR(e, 25)) +
+                      ((e & f) ^ (~e & g)) + k[i] + w[i];
+        uint32_t t2 = (ROR(a, 2) ^ ROR(a, 13) ^ ROR(a, 22)) +
+                      ((a & b) ^ (a & cc) ^ (b & cc));
+        h  = g;
+        g  = f;
+        f  = e;
+        e  = d + t1;
+        d  = cc;
+        cc = b;
+        b  = a;
+        a  = t1 + t2;
+    }
+
+    c->h[0] += a;
+    c->h[1] += b;
+    c->h[2] += cc;
+    c->h[3] += d;
+    c->h[4] += e;
+    c->h[5] += f;
+    c->h[6] += g;
+    c->h[7] += h;
+}
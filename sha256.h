@@ -0,0 +1,28 @@
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SHA256_LEN 32
+
+struct sha256 {
+    uint32_t h[8];
+    uint64_t len; /* Number of bytes hashed so far */
+    unsigned char buf[64];
+    size_t n; /* Number of bytes in `buf` */
+};
+
+void sha256_init(struct sha256 *);
+void sha256_update(struct sha256 *, const void *, size_t);
+void sha256_final(struct sha256 *, unsigned char md[SHA256_LEN]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SHA256_H */
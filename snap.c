@@ -0,0 +1,1612 @@
+/*
+Copyright (c) 2016-2018, Carsten Kunze <carsten.kunze@arcor.de>
+
+Permission to use, copy, modify, and/or distribute this software for any
+purpose with or without fee is hereby granted, provided that the above
+copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+PERFORMANCE OF THIS SOFTWARE.
+*/
+
+/*
+ * Snapshots of directory trees for the recursive scan pass.
+ *
+ * The scan writes the names, types, sizes, times and inode numbers of
+ * the entries of all scanned directories to one file per tree in
+ * ~/.vddiffsnap/.  The file name is a hash of the realpath of the tree
+ * root.  Regular files are compared by their SHA-256 digests, which are
+ * stored too.
+ *
+ * The next scan of the same tree reads a directory again only if its
+ * modification or status change time differs from the snapshot, else
+ * the names are taken from the snapshot.  Each entry is still stat(2)ed.
+ * If size, times and inode number are unchanged the digest from the
+ * snapshot is used.  Hence unchanged files are not read again.
+ *
+ * The old snapshot is kept in memory.  The new one is written while the
+ * directories are scanned.
+ *
+ * With option -z a snapshot file can be given instead of a directory.
+ * Only the file offsets of the `D` lines are kept in memory.  The entries
+ * of a directory are read when the directory is scanned.  Regular files
+ * are compared with the digests from the snapshot, hence snapshot files
+ * for -z should be written with -A -z, which stores the digests of all
+ * files and the targets of symbolic links.
+ *
+ * File format, one record per line.  In names '\' and newline are
+ * escaped with '\'.
+ *   vddiff snapshot 1
+ *   R <root>
+ *   D <mtime> <ctime> <path relative to root>
+ *   E <mode> <size> <mtime> <ctime> <ino> <rdev> <digest or -> <name>
+ *   L <target of symbolic link>
+ * `E` lines follow the `D` line of their directory, sorted by name.  An
+ * optional `L` line follows the `E` line of a symbolic link.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "compat.h"
+#include "main.h"
+#include "ui.h"
+#include "ui2.h"
+#include "diff.h"
+#include "db.h"
+#include "gq.h"
+#include "tc.h"
+#include "sha256.h"
+#include "fcmp.h"
+#include "snap.h"
+
+struct snap_ent {
+    char *name;
+    mode_t mode;
+    off_t size;
+    struct timespec mtim;
+    struct timespec ctim;
+    ino_t ino;
+    dev_t rdev;
+    unsigned char *md; /* SHA-256 digest or NULL */
+    char *link; /* Link target or NULL */
+};
+
+struct snap_dir {
+    char *rel; /* Path relative to the root, "" for the root */
+    struct timespec mtim;
+    struct timespec ctim;
+    dev_t dev; /* Not stored */
+    off_t off; /* Offset of the `E` lines in a -z snapshot file */
+    struct snap_ent *ent; /* Sorted by name */
+    size_t nent;
+};
+
+/* Snapshot of one tree */
+struct snap {
+    char *root; /* realpath */
+    struct snap_dir **tab; /* Old snapshot, hash table by `rel` */
+    size_t size; /* Power of 2 */
+    size_t used;
+    char *pth; /* Snapshot file */
+    char *tpth; /* New snapshot, renamed to `pth` */
+    FILE *out;
+};
+
+/* Snapshot file used as one side of the diff (option -z) */
+struct snap_side {
+    char *arg; /* Path as given on the command line */
+    size_t len;
+    char *rp; /* realpath of `arg` */
+    FILE *fh;
+    struct snap idx; /* Directories without entries, only `off` is set */
+    struct snap_dir *cur; /* Last directory read by sn_side_ent() */
+    dev_t dev;
+};
+
+static void sn_open(int);
+static void sn_load(struct snap *);
+static void sn_close(struct snap *);
+static void sn_parse_ent(struct snap_dir *, size_t *, char *);
+static struct snap_side *sn_side_find(const char *, const char **);
+static struct snap_dir *sn_side_read(struct snap_side *, const char *);
+static struct snap_ent *sn_side_ent(const char *, struct snap_side **);
+static int sn_dump_ent(struct snap_ent *, size_t);
+static struct snap_dir **sn_find(struct snap *, const char *);
+static void sn_add(struct snap *, struct snap_dir *);
+static int sn_grow(struct snap *);
+static struct snap_dir *sn_read(int, const char *);
+static void sn_dir_cmp(struct snap_dir *const [2], const char *);
+static int sn_cmp(struct snap_ent *const [2], struct snap_dir *const [2],
+                  const size_t [2]);
+static int sn_cmp_reg(struct snap_ent *const [2], const size_t [2]);
+static int sn_cmp_link(struct snap_ent *const [2], const size_t [2]);
+static void sn_push(const char *, const char *);
+static size_t sn_set_pth(int, const char *);
+static bool sn_add_name(int, size_t, const char *);
+static void sn_add_diff(int, size_t);
+static void sn_write(struct snap *, const struct snap_dir *);
+static void sn_clear_dir(struct snap_dir *);
+static void sn_err(const char *, const char *, int);
+static void sn_puts(const char *, FILE *);
+static char *sn_unesc(char *);
+static int sn_ent_cmp(const void *, const void *);
+static bool sn_tim_eq(struct timespec, struct timespec);
+static uint64_t sn_hash(const char *);
+
+static const char sn_dirname[] = "." BIN "snap";
+static const char sn_magic[] = "vddiff snapshot 1\n";
+bool snapshot;
+bool snap_arg;
+bool snap_sides;
+static struct snap sn[2];
+static struct snap_side *sn_side[2];
+static char sn_pth[2][PATHSIZ];
+static size_t sn_root_len[2];
+static char **sn_stack;
+static size_t sn_nstack;
+static size_t sn_stack_size;
+static struct fcmp sn_fcmp = { { lbuf, rbuf }, { NULL, NULL, NULL }, 0,
+                               FALSE, 0, -1, FALSE };
+static int sn_rv;
+
+bool
+snap_usable(void)
+{
+    /* The snapshots contain no directory statistics */
+    return snapshot && scan && !cli_mode && !bmode && !fmode &&
+           !file_pattern && !find_dir_name && !snap_sides && !add_dstat;
+}
+
+int
+snap_scan(void)
+{
+    unsigned long ndirs = 0;
+    time_t lpt = 0, t;
+    int i;
+
+#if defined(TRACE)
+    fprintf(debug, "->snap_scan lp(%s) rp(%s)\n", syspth[0], syspth[1]);
+#endif
+    sn_rv = 0;
+
+    for (i = 0; i < 2; i++) {
+        syspth[i][pthlen[i]] = 0;
+        memcpy(sn_pth[i], syspth[i], pthlen[i] + 1);
+        sn_root_len[i] = pthlen[i];
+        sn_open(i);
+    }
+
+    sn_push("", "");
+
+    while (sn_nstack) {
+        char *rel = sn_stack[--sn_nstack];
+        struct snap_dir *d[2];
+
+        /* Skipped like too long names in sn_add_name() */
+        if (sn_set_pth(0, rel) == (size_t)-1 ||
+            sn_set_pth(1, rel) == (size_t)-1)
+        {
+            free(rel);
+            continue;
+        }
+
+        d[0] = sn_read(0, rel);
+        d[1] = sn_read(1, rel);
+        sn_dir_cmp(d, rel);
+
+        for (i = 0; i < 2; i++) {
+            if (!d[i])
+                continue;
+
+            sn_write(&sn[i], d[i]);
+            sn_clear_dir(d[i]);
+            free(d[i]->rel);
+            free(d[i]);
+        }
+
+        free(rel);
+        ndirs++;
+
+        if (!dontcmp && getch() == '%')
+            dontcmp = TRUE;
+
+        if ((t = time(NULL)) - lpt) {
+            printerr(NULL, "%lu directories read", ndirs);
+            lpt = t;
+        }
+    }
+
+    for (i = 0; i < 2; i++)
+        sn_close(&sn[i]);
+
+    free(sn_stack);
+    sn_stack = NULL;
+    sn_stack_size = 0;
+    fcmp_free(&sn_fcmp);
+#if defined(TRACE)
+    fprintf(debug, "<-snap_scan: %d (%lu directories)\n", sn_rv, ndirs);
+#endif
+    return sn_rv;
+}
+
+int
+snap_side_open(int i, const char *pth, struct stat *st)
+{
+    struct snap_side *s;
+    FILE *fh;
+    char *line = NULL;
+    size_t len = 0;
+    ssize_t n;
+
+    if (!(fh = fopen(pth, "r")))
+        return -1;
+
+    if (getline(&line, &len, fh) == -1 || strcmp(line, sn_magic)) {
+        free(line);
+        fclose(fh);
+        return -1;
+    }
+
+    s = calloc(1, sizeof(struct snap_side));
+    s->arg = strdup(pth);
+    s->len = strlen(pth);
+    s->rp = realpath(pth, NULL);
+    s->fh = fh;
+    /* Not a real device, see same_file() */
+    s->dev = (dev_t)-1 - (dev_t)i;
+
+    while ((n = getline(&line, &len, fh)) != -1) {
+        struct snap_dir *d;
+        int o;
+
+        if (*line != 'D')
+            continue;
+
+        if (n && line[n - 1] == '\n')
+            line[--n] = 0;
+
+        /* `%n` is not assigned if the line doesn't match */
+        o = -1;
+
+        if (sscanf(line, "D %*d.%*d %*d.%*d%n", &o) == EOF || o < 0 ||
+            line[o] != ' ')
+        {
+            continue;
+        }
+
+        d = calloc(1, sizeof(struct snap_dir));
+        d->rel = strdup(sn_unesc(line + o + 1));
+        d->off = ftello(fh);
+        sn_add(&s->idx, d);
+    }
+
+    free(line);
+#if defined(TRACE)
+    fprintf(debug, "<>snap_side_open(%d, %s): %zu directories\n", i, pth,
+            s->idx.used);
+#endif
+    memset(st, 0, sizeof(*st));
+    st->st_mode = S_IFDIR | 0555;
+    st->st_dev = s->dev;
+    sn_side[i] = s;
+    snap_sides = TRUE;
+    readonly = TRUE;
+    return 0;
+}
+
+int
+snap_dump(const char *dir, const char *pth)
+{
+    struct snap *s = &sn[0];
+    size_t k;
+
+#if defined(TRACE)
+    fprintf(debug, "->snap_dump(%s, %s)\n", dir, pth);
+#endif
+    sn_rv = 0;
+
+    if ((sn_root_len[0] = strlen(dir)) >= PATHSIZ) {
+        sn_err("Path too long", dir, 0);
+        return sn_rv;
+    }
+
+    memcpy(sn_pth[0], dir, sn_root_len[0] + 1);
+
+    if (!(s->root = realpath(dir, NULL))) {
+        sn_err("realpath", dir, errno);
+        return sn_rv;
+    }
+
+    if (!(s->out = fopen(pth, "w"))) {
+        sn_err("fopen", pth, errno);
+        goto close;
+    }
+
+    fputs(sn_magic, s->out);
+    fputs("R ", s->out);
+    sn_puts(s->root, s->out);
+    putc('\n', s->out);
+    sn_push("", "");
+
+    while (sn_nstack) {
+        char *rel = sn_stack[--sn_nstack];
+        struct snap_dir *d;
+
+        if ((d = sn_read(0, rel))) {
+            const size_t l = sn_set_pth(0, rel);
+
+            for (k = 0; k < d->nent; k++) {
+                if (S_ISDIR(d->ent[k].mode))
+                    sn_push(rel, d->ent[k].name);
+                else
+                    sn_dump_ent(&d->ent[k], l);
+            }
+
+            sn_write(s, d);
+            sn_clear_dir(d);
+            free(d->rel);
+            free(d);
+        }
+
+        free(rel);
+    }
+
+    if (fclose(s->out) == EOF)
+        sn_err("fclose", pth, errno);
+
+    s->out = NULL;
+    free(sn_stack);
+    sn_stack = NULL;
+    sn_stack_size = 0;
+    fcmp_free(&sn_fcmp);
+close:
+    sn_close(s);
+#if defined(TRACE)
+    fprintf(debug, "<-snap_dump: %d\n", sn_rv);
+#endif
+    return sn_rv;
+}
+
+bool
+snap_is_pth(const char *pth)
+{
+    return sn_side_find(pth, NULL) != NULL;
+}
+
+struct snap_dir *
+snap_opendir(const char *pth)
+{
+    struct snap_side *s;
+    const char *rel;
+
+    if (!(s = sn_side_find(pth, &rel))) {
+        errno = ENOTDIR;
+        return NULL;
+    }
+
+    return sn_side_read(s, rel);
+}
+
+const char *
+snap_readdir(struct snap_dir *d, size_t *k, mode_t *type)
+{
+    if (*k == d->nent)
+        return NULL;
+
+    *type = d->ent[*k].mode & S_IFMT;
+    return d->ent[(*k)++].name;
+}
+
+void
+snap_closedir(struct snap_dir *d)
+{
+    sn_clear_dir(d);
+    free(d->rel);
+    free(d);
+}
+
+int
+snap_lstat(const char *pth, struct stat *st)
+{
+    struct snap_side *s;
+    struct snap_ent *e;
+    const char *rel;
+
+    memset(st, 0, sizeof(*st));
+
+    if ((s = sn_side_find(pth, &rel)) && !*rel) {
+        st->st_mode = S_IFDIR | 0555;
+        st->st_dev = s->dev;
+        return 0;
+    }
+
+    if (!(e = sn_side_ent(pth, &s)))
+        return -1;
+
+    st->st_dev = s->dev;
+    st->st_ino = e->ino;
+    st->st_mode = e->mode;
+    st->st_nlink = 1;
+    st->st_rdev = e->rdev;
+    st->st_size = e->size;
+    st->st_atim = e->mtim;
+    st->st_mtim = e->mtim;
+    st->st_ctim = e->ctim;
+    return 0;
+}
+
+char *
+snap_readlink(const char *pth)
+{
+    struct snap_side *s;
+    struct snap_ent *e;
+
+    if (!(e = sn_side_ent(pth, &s)))
+        return NULL;
+
+    if (!e->link) {
+        printerr(NULL, "No link target in snapshot for \"%s\"", pth);
+        return NULL;
+    }
+
+    return strdup(e->link);
+}
+
+int
+snap_cmp_file(const char *lpth, const char *rpth)
+{
+    const char *pth[2];
+    struct snap_ent *e[2];
+    struct snap_side *s;
+    struct sha256 ctx;
+    unsigned char md[SHA256_LEN];
+    int fd, i, j;
+    int rv = 0;
+
+    pth[0] = lpth;
+    pth[1] = rpth;
+
+    for (i = 0; i < 2; i++) {
+        e[i] = NULL;
+
+        if (sn_side_find(pth[i], NULL) && !(e[i] = sn_side_ent(pth[i], &s)))
+            return 2;
+    }
+
+    if (!e[0] && !e[1])
+        return -1;
+
+    /* Equal metadata doesn't mean equal contents */
+    for (i = 0; i < 2; i++) {
+        if (e[i] && !e[i]->md) {
+            sn_err("No digest in snapshot for", pth[i], 0);
+            return 2;
+        }
+    }
+
+    if (e[0] && e[1]) {
+        rv = memcmp(e[0]->md, e[1]->md, SHA256_LEN) ? 1 : 0;
+        goto ret;
+    }
+
+    /* `i` is the snapshot side, `j` the directory */
+    i = e[0] ? 0 : 1;
+    j = !i;
+
+    if ((fd = open(pth[j], O_RDONLY)) == -1) {
+        sn_err("open", pth[j], errno);
+        return 2;
+    }
+
+    sha256_init(&ctx);
+
+    if (fcmp_hash(&sn_fcmp, fd, e[i]->size, &ctx) == -1) {
+        sn_err("read", pth[j], errno);
+        close(fd);
+        return 2;
+    }
+
+    close(fd);
+    sha256_final(&ctx, md);
+    /* Count equal files only as cmp_file() */
+    if (!(rv = memcmp(md, e[i]->md, SHA256_LEN) ? 1 : 0) && qdiff)
+        tot_cmp_byte_count += e[i]->size;
+
+ret:
+    if (!rv && qdiff) {
+        ++tot_cmp_file_count; /* File: -q */
+
+        if (verbose)
+            printf("Equal files: \"%s\" and \"%s\"\n", lpth, rpth);
+    }
+
+    return rv;
+}
+
+char *
+snap_realpath(const char *pth)
+{
+    struct snap_side *s;
+    const char *rel;
+    char *rp;
+    size_t l;
+
+    if (!snap_sides || !(s = sn_side_find(pth, &rel)))
+        return realpath(pth, NULL);
+
+    if (!s->rp) {
+        errno = ENOENT;
+        return NULL;
+    }
+
+    l = strlen(s->rp);
+    rp = malloc(l + strlen(rel) + 2);
+    memcpy(rp, s->rp, l);
+
+    if (*rel) {
+        rp[l++] = '/';
+        strcpy(rp + l, rel);
+    } else {
+        rp[l] = 0;
+    }
+
+    return rp;
+}
+
+/* Loads the old snapshot of tree `i` and creates the new one */
+
+static void
+sn_open(int i)
+{
+    struct snap *s = &sn[i];
+    char *dir;
+    size_t l;
+
+    if (!(s->root = realpath(sn_pth[i], NULL))) {
+        sn_err("realpath", sn_pth[i], errno);
+        return;
+    }
+
+    if (!(dir = add_home_pth(sn_dirname)))
+        return;
+
+    if (mkdir(dir, 0777) == -1 && errno != EEXIST) {
+        sn_err("mkdir", dir, errno);
+        free(dir);
+        return;
+    }
+
+    l = strlen(dir) + 18;
+    s->pth = malloc(l);
+    snprintf(s->pth, l, "%s/%016jx", dir, (uintmax_t)sn_hash(s->root));
+    free(dir);
+    sn_load(s);
+
+    /* Same tree on both sides */
+    if (i && sn[0].root && !strcmp(s->root, sn[0].root))
+        return;
+
+    l = strlen(s->pth);
+    s->tpth = malloc(l + 5);
+    memcpy(s->tpth, s->pth, l);
+    memcpy(s->tpth + l, ".new", 5);
+
+    if (!(s->out = fopen(s->tpth, "w"))) {
+        sn_err("fopen", s->tpth, errno);
+        return;
+    }
+
+    fputs(sn_magic, s->out);
+    fputs("R ", s->out);
+    sn_puts(s->root, s->out);
+    putc('\n', s->out);
+}
+
+static void
+sn_load(struct snap *s)
+{
+    FILE *fh;
+    char *line = NULL;
+    size_t len = 0;
+    ssize_t n;
+    struct snap_dir *d = NULL;
+    size_t nent_size = 0;
+
+    if (!(fh = fopen(s->pth, "r")))
+        return;
+
+    if (getline(&line, &len, fh) == -1 || strcmp(line, sn_magic) ||
+        (n = getline(&line, &len, fh)) == -1 || strncmp(line, "R ", 2))
+    {
+        goto close;
+    }
+
+    line[n - 1] = 0;
+
+    if (strcmp(sn_unesc(line + 2), s->root))
+        goto close;
+
+    while ((n = getline(&line, &len, fh)) != -1) {
+        intmax_t msec, csec;
+        long mnsec, cnsec;
+        int o;
+
+        if (n && line[n - 1] == '\n')
+            line[--n] = 0;
+
+        if (*line == 'D') {
+            o = -1;
+
+            if (sscanf(line, "D %jd.%ld %jd.%ld%n", &msec, &mnsec, &csec,
+                       &cnsec, &o) != 4 || o < 0 || line[o] != ' ')
+            {
+                d = NULL;
+                continue; /* It's a cache only */
+            }
+
+            d = calloc(1, sizeof(struct snap_dir));
+            nent_size = 0;
+            d->rel = strdup(sn_unesc(line + o + 1));
+            d->mtim.tv_sec = (time_t)msec;
+            d->mtim.tv_nsec = mnsec;
+            d->ctim.tv_sec = (time_t)csec;
+            d->ctim.tv_nsec = cnsec;
+            sn_add(s, d);
+        } else if (d) {
+            sn_parse_ent(d, &nent_size, line);
+        }
+    }
+
+close:
+    free(line);
+    fclose(fh);
+#if defined(TRACE)
+    fprintf(debug, "<>sn_load(%s): %zu directories\n", s->pth, s->used);
+#endif
+}
+
+/* Adds the entry of `E` line `line` to `d` or sets the link target of
+ * the last entry from an `L` line.  `*size` is the allocated size of
+ * `d->ent`. */
+
+static void
+sn_parse_ent(struct snap_dir *d, size_t *size, char *line)
+{
+    struct snap_ent *e;
+    intmax_t siz, msec, csec;
+    long mnsec, cnsec;
+    uintmax_t ino, rdev;
+    unsigned mode;
+    char hex[2 * SHA256_LEN + 1];
+    const char *name;
+    int j, o;
+
+    if (*line == 'L') {
+        if (d->nent && line[1] == ' ' && !d->ent[d->nent - 1].link)
+            d->ent[d->nent - 1].link = strdup(sn_unesc(line + 2));
+
+        return;
+    }
+
+    o = -1;
+
+    if (*line != 'E' ||
+        sscanf(line, "E %o %jd %jd.%ld %jd.%ld %ju %ju %64s%n", &mode, &siz,
+               &msec, &mnsec, &csec, &cnsec, &ino, &rdev, hex, &o) != 9 ||
+        o < 0 || line[o] != ' ')
+    {
+        return;
+    }
+
+    name = sn_unesc(line + o + 1);
+
+    /* Keep order for bsearch(3) */
+    if (d->nent && strcmp(d->ent[d->nent - 1].name, name) >= 0)
+        return;
+
+    if (d->nent == *size) {
+        *size = *size ? 2 * *size : 64;
+        d->ent = realloc(d->ent, *size * sizeof(struct snap_ent));
+    }
+
+    e = &d->ent[d->nent++];
+    e->name = strdup(name);
+    e->mode = (mode_t)mode;
+    e->size = (off_t)siz;
+    e->mtim.tv_sec = (time_t)msec;
+    e->mtim.tv_nsec = mnsec;
+    e->ctim.tv_sec = (time_t)csec;
+    e->ctim.tv_nsec = cnsec;
+    e->ino = (ino_t)ino;
+    e->rdev = (dev_t)rdev;
+    e->md = NULL;
+    e->link = NULL;
+
+    if (strlen(hex) != 2 * SHA256_LEN)
+        return;
+
+    e->md = malloc(SHA256_LEN);
+
+    for (j = 0; j < SHA256_LEN; j++) {
+        unsigned x;
+
+        if (sscanf(hex + 2 * j, "%2x", &x) != 1)
+            break;
+
+        e->md[j] = (unsigned char)x;
+    }
+
+    if (j < SHA256_LEN) {
+        free(e->md);
+        e->md = NULL;
+    }
+}
+
+/* Renames the new snapshot file and frees the old snapshot */
+
+static void
+sn_close(struct snap *s)
+{
+    size_t i;
+
+    if (s->out) {
+        if (fclose(s->out) == EOF) {
+            sn_err("fclose", s->tpth, errno);
+            unlink(s->tpth);
+        } else if (rename(s->tpth, s->pth) == -1) {
+            sn_err("rename", s->tpth, errno);
+            unlink(s->tpth);
+        }
+    }
+
+    for (i = 0; i < s->size; i++) {
+        struct snap_dir *d = s->tab[i];
+
+        if (!d)
+            continue;
+
+        sn_clear_dir(d);
+        free(d->rel);
+        free(d);
+    }
+
+    free(s->tab);
+    free(s->root);
+    free(s->pth);
+    free(s->tpth);
+    memset(s, 0, sizeof(*s));
+}
+
+/* Returns the slot of `rel` or the free slot where it is to be inserted.
+ * Returns NULL for an empty table. */
+
+static struct snap_dir **
+sn_find(struct snap *s, const char *rel)
+{
+    size_t i;
+
+    if (!s->size)
+        return NULL;
+
+    i = (size_t)(sn_hash(rel) >> 32) & (s->size - 1);
+
+    while (s->tab[i] && strcmp(s->tab[i]->rel, rel))
+        i = (i + 1) & (s->size - 1);
+
+    return &s->tab[i];
+}
+
+static void
+sn_add(struct snap *s, struct snap_dir *d)
+{
+    struct snap_dir **p;
+
+    if (2 * (s->used + 1) > s->size && sn_grow(s) == -1) {
+        free(d->rel);
+        free(d);
+        return;
+    }
+
+    p = sn_find(s, d->rel);
+
+    if (*p) {
+        sn_clear_dir(*p);
+        free((*p)->rel);
+        free(*p);
+    } else {
+        s->used++;
+    }
+
+    *p = d;
+}
+
+static int
+sn_grow(struct snap *s)
+{
+    struct snap_dir **o = s->tab;
+    size_t n = s->size;
+    size_t i;
+
+    if (!(s->tab = calloc(n ? 2 * n : 1024, sizeof(*s->tab)))) {
+        s->tab = o;
+        return -1;
+    }
+
+    s->size = n ? 2 * n : 1024;
+
+    for (i = 0; i < n; i++) {
+        if (o[i])
+            *sn_find(s, o[i]->rel) = o[i];
+    }
+
+    free(o);
+    return 0;
+}
+
+/* Returns the entries of directory `rel` of tree `i` or NULL if it is
+ * not a directory.  The names are read from the old snapshot if the
+ * directory had not been changed. */
+
+static struct snap_dir *
+sn_read(int i, const char *rel)
+{
+    struct snap_dir *d, *o = NULL, **op;
+    struct stat st;
+    DIR *dp = NULL;
+    char *const pth = sn_pth[i];
+    const size_t l = sn_set_pth(i, rel);
+    size_t k, size = 0;
+    bool reuse;
+    int fd;
+
+    if (l == (size_t)-1)
+        return NULL;
+
+    if ((fd = open(pth, O_RDONLY | O_DIRECTORY)) == -1) {
+        if (errno != ENOENT && errno != ENOTDIR)
+            sn_err("open", pth, errno);
+
+        return NULL;
+    }
+
+    if (fstat(fd, &st) == -1) {
+        sn_err("stat", pth, errno);
+        close(fd);
+        return NULL;
+    }
+
+    d = calloc(1, sizeof(struct snap_dir));
+    d->rel = strdup(rel);
+    d->mtim = st.st_mtim;
+    d->ctim = st.st_ctim;
+    d->dev = st.st_dev;
+
+    if ((op = sn_find(&sn[i], rel)))
+        o = *op;
+
+    reuse = o && sn_tim_eq(o->mtim, st.st_mtim) &&
+                 sn_tim_eq(o->ctim, st.st_ctim);
+#if defined(TRACE) && 1
+    fprintf(debug, "  sn_read(%s)%s\n", pth, reuse ? " from snapshot" : "");
+#endif
+
+    if (!reuse && !(dp = fdopendir(fd))) {
+        sn_err("opendir", pth, errno);
+        close(fd);
+        goto ret;
+    }
+
+    for (k = 0; ; k++) {
+        struct snap_ent *e, *oe = NULL;
+        const char *name;
+
+        if (reuse) {
+            if (k == o->nent)
+                break;
+
+            oe = &o->ent[k];
+            name = oe->name;
+        } else {
+            struct dirent *ent;
+
+            errno = 0;
+
+            if (!(ent = readdir(dp))) {
+                if (errno) {
+                    pth[l] = 0;
+                    sn_err("readdir", pth, errno);
+                }
+
+                break;
+            }
+
+            name = ent->d_name;
+
+            if (*name == '.' &&
+                (!name[1] || (name[1] == '.' && !name[2])))
+            {
+                continue;
+            }
+
+            if (o) {
+                struct snap_ent key;
+
+                key.name = (char *)name;
+                oe = bsearch(&key, o->ent, o->nent, sizeof(struct snap_ent),
+                             sn_ent_cmp);
+            }
+        }
+
+        if (stat_at(fd, name, &st, NULL) == -1) {
+            if (errno != ENOENT && sn_add_name(i, l, name))
+                sn_err("stat", pth, errno);
+
+            continue;
+        }
+
+        if (d->nent == size) {
+            size = size ? 2 * size : 64;
+            d->ent = realloc(d->ent, size * sizeof(struct snap_ent));
+        }
+
+        e = &d->ent[d->nent++];
+        e->name = strdup(name);
+        e->mode = st.st_mode;
+        e->size = st.st_size;
+        e->mtim = st.st_mtim;
+        e->ctim = st.st_ctim;
+        e->ino = st.st_ino;
+        e->rdev = st.st_rdev;
+        e->md = NULL;
+        e->link = NULL;
+
+        if (oe && oe->md && oe->ino == e->ino && oe->size == e->size &&
+            sn_tim_eq(oe->mtim, e->mtim) && sn_tim_eq(oe->ctim, e->ctim))
+        {
+            e->md = oe->md;
+            oe->md = NULL;
+        }
+    }
+
+    if (dp) {
+        closedir(dp);
+        qsort(d->ent, d->nent, sizeof(struct snap_ent), sn_ent_cmp);
+    } else {
+        close(fd);
+    }
+
+ret:
+    if (o) {
+        /* Each directory is read only once per scan */
+        sn_clear_dir(o);
+        o->mtim.tv_nsec = -1;
+    }
+
+    pth[l] = 0;
+    return d;
+}
+
+/* Compares the entries of both sides, adds the directories with
+ * differences to `scan_db` and pushes the common subdirectories.
+ * Same checks as ps_scan_dir(). */
+
+static void
+sn_dir_cmp(struct snap_dir *const d[2], const char *rel)
+{
+    struct snap_ent *e[2];
+    size_t n[2], k[2] = { 0, 0 };
+    size_t l[2];
+    bool dir_diff = FALSE;
+    bool rdiff = FALSE;
+    int i;
+
+    for (i = 0; i < 2; i++) {
+        n[i] = d[i] ? d[i]->nent : 0;
+        l[i] = sn_set_pth(i, rel);
+    }
+
+    while (k[0] < n[0] || k[1] < n[1]) {
+        int c;
+
+        if (k[0] == n[0])
+            c = 1;
+        else if (k[1] == n[1])
+            c = -1;
+        else
+            c = strcmp(d[0]->ent[k[0]].name, d[1]->ent[k[1]].name);
+
+        if (c > 0) {
+            /* Only right */
+            k[1]++;
+
+            if (!real_diff)
+                rdiff = TRUE;
+
+            continue;
+        }
+
+        if (c < 0) {
+            /* Only left */
+            k[0]++;
+
+            if (!real_diff)
+                dir_diff = TRUE;
+
+            continue;
+        }
+
+        e[0] = &d[0]->ent[k[0]++];
+        e[1] = &d[1]->ent[k[1]++];
+
+        if (S_ISDIR(e[0]->mode) && S_ISDIR(e[1]->mode)) {
+            sn_push(rel, e[0]->name);
+            continue;
+        }
+
+        /* The directory is already known as different.  Only its
+         * subdirectories are still of interest. */
+        if (dir_diff)
+            continue;
+
+        switch (sn_cmp(e, d, l)) {
+        case 0:
+            break;
+        case 1:
+            dir_diff = TRUE;
+            break;
+        default:
+            sn_rv |= 2;
+        }
+    }
+
+    if (dir_diff)
+        sn_add_diff(0, l[0]);
+
+    if (rdiff)
+        sn_add_diff(1, l[1]);
+}
+
+/* Compares left and right directory entry which are not both directories.
+ * Return value as for cmp_file(). */
+
+static int
+sn_cmp(struct snap_ent *const e[2], struct snap_dir *const d[2],
+       const size_t l[2])
+{
+    mode_t m0 = e[0]->mode;
+    mode_t m1 = e[1]->mode;
+
+    if (S_ISREG(m0) && S_ISREG(m1)) {
+        if (e[0]->size != e[1]->size)
+            return 1;
+
+        if (e[0]->ino == e[1]->ino && d[0]->dev == d[1]->dev)
+            return 0;
+
+        return sn_cmp_reg(e, l);
+    }
+
+    if (S_ISLNK(m0) && S_ISLNK(m1)) {
+        if (e[0]->size != e[1]->size)
+            return 1;
+
+        return sn_cmp_link(e, l);
+    }
+
+    if ((S_ISSOCK(m0) && S_ISSOCK(m1)) || (S_ISFIFO(m0) && S_ISFIFO(m1)))
+        return 0;
+
+    if ((S_ISBLK(m0) && S_ISBLK(m1)) || (S_ISCHR(m0) && S_ISCHR(m1)))
+        return e[0]->rdev != e[1]->rdev ? 1 : 0;
+
+    if (real_diff)
+        return 0;
+
+    return m0 != m1 ? 1 : 0;
+}
+
+/* Compares the digests.  Missing digests are computed. */
+
+static int
+sn_cmp_reg(struct snap_ent *const e[2], const size_t l[2])
+{
+    struct sha256 ctx;
+    int f[2] = { -1, -1 };
+    const off_t siz = e[0]->size;
+    int rv = 0;
+    int i;
+
+    if (!siz || dontcmp)
+        return 0;
+
+    if (e[0]->md && e[1]->md)
+        return memcmp(e[0]->md, e[1]->md, SHA256_LEN) ? 1 : 0;
+
+    for (i = 0; i < 2; i++) {
+        if (!sn_add_name(i, l[i], e[i]->name))
+            goto close;
+
+        if ((f[i] = open(sn_pth[i], O_RDONLY)) == -1) {
+            sn_err("open", sn_pth[i], errno);
+            rv = 2;
+            goto close;
+        }
+    }
+
+    sha256_init(&ctx);
+
+    if (e[0]->md || e[1]->md) {
+        i = e[0]->md ? 1 : 0;
+
+        if (fcmp_hash(&sn_fcmp, f[i], siz, &ctx) == -1) {
+            sn_err("read", sn_pth[i], errno);
+            rv = 2;
+            goto close;
+        }
+
+        e[i]->md = malloc(SHA256_LEN);
+        sha256_final(&ctx, e[i]->md);
+        rv = memcmp(e[0]->md, e[1]->md, SHA256_LEN) ? 1 : 0;
+        goto close;
+    }
+
+    /* The digest of the right file is only known if the files are
+     * equal. */
+    if ((rv = fcmp_run(&sn_fcmp, f, siz, &ctx, &i)) == 2) {
+        sn_err("read", sn_pth[i], errno);
+    } else if (!rv) {
+        e[0]->md = malloc(SHA256_LEN);
+        sha256_final(&ctx, e[0]->md);
+        e[1]->md = malloc(SHA256_LEN);
+        memcpy(e[1]->md, e[0]->md, SHA256_LEN);
+    }
+
+close:
+    for (i = 0; i < 2; i++) {
+        if (f[i] != -1)
+            close(f[i]);
+
+        sn_pth[i][l[i]] = 0;
+    }
+
+    return rv;
+}
+
+static int
+sn_cmp_link(struct snap_ent *const e[2], const size_t l[2])
+{
+    char *buf[2] = { lbuf, rbuf };
+    ssize_t n[2];
+    int rv = 0;
+    int i;
+
+    if (!e[0]->size || dontcmp || e[0]->size >= BUF_SIZE)
+        return 0;
+
+    for (i = 0; i < 2; i++) {
+        if (!sn_add_name(i, l[i], e[i]->name))
+            goto ret;
+
+        if ((n[i] = readlink(sn_pth[i], buf[i], BUF_SIZE)) == -1) {
+            sn_err("readlink", sn_pth[i], errno);
+            rv = 2;
+            goto ret;
+        }
+    }
+
+    rv = n[0] != n[1] || memcmp(buf[0], buf[1], (size_t)n[0]) ? 1 : 0;
+
+ret:
+    sn_pth[0][l[0]] = 0;
+    sn_pth[1][l[1]] = 0;
+    return rv;
+}
+
+static void
+sn_push(const char *rel, const char *name)
+{
+    size_t lr = strlen(rel);
+    char *p = malloc(lr + strlen(name) + 2);
+
+    if (lr) {
+        memcpy(p, rel, lr);
+        p[lr++] = '/';
+    }
+
+    strcpy(p + lr, name);
+
+    if (sn_nstack == sn_stack_size) {
+        sn_stack_size = sn_stack_size ? 2 * sn_stack_size : 64;
+        sn_stack = realloc(sn_stack, sn_stack_size * sizeof(char *));
+    }
+
+    sn_stack[sn_nstack++] = p;
+}
+
+/* Sets `sn_pth[i]` to directory `rel` of tree `i`.  Returns the length
+ * or (size_t)-1 if the path doesn't fit. */
+
+static size_t
+sn_set_pth(int i, const char *rel)
+{
+    size_t l = sn_root_len[i];
+    size_t lr = strlen(rel);
+
+    if (lr) {
+        if (l + lr + 2 > PATHSIZ) {
+            sn_pth[i][l] = 0;
+            sn_err("Path buffer overflow", rel, 0);
+            return (size_t)-1;
+        }
+
+        if (!l || sn_pth[i][l - 1] != '/')
+            sn_pth[i][l++] = '/';
+
+        memcpy(sn_pth[i] + l, rel, lr);
+        l += lr;
+    }
+
+    sn_pth[i][l] = 0;
+    return l;
+}
+
+/* Appends `name` to `sn_pth[i]` of length `l` */
+
+static bool
+sn_add_name(int i, size_t l, const char *name)
+{
+    if (l + strlen(name) + 2 > PATHSIZ) {
+        sn_pth[i][l] = 0;
+        sn_err("Path buffer overflow", sn_pth[i], 0);
+        return FALSE;
+    }
+
+    sn_pth[i][l] = '/';
+    strcpy(sn_pth[i] + l + 1, name);
+    return TRUE;
+}
+
+static void
+sn_add_diff(int i, size_t l)
+{
+    char *rp;
+
+    sn_pth[i][l] = 0;
+
+    if (!(rp = realpath(sn_pth[i], NULL))) {
+        sn_err("realpath", sn_pth[i], errno);
+        return;
+    }
+
+    add_diff_rpath(rp);
+    sn_rv |= 1;
+}
+
+static void
+sn_write(struct snap *s, const struct snap_dir *d)
+{
+    size_t k;
+    int j;
+
+    if (!s->out)
+        return;
+
+    fprintf(s->out, "D %jd.%09ld %jd.%09ld ",
+            (intmax_t)d->mtim.tv_sec, (long)d->mtim.tv_nsec,
+            (intmax_t)d->ctim.tv_sec, (long)d->ctim.tv_nsec);
+    sn_puts(d->rel, s->out);
+    putc('\n', s->out);
+
+    for (k = 0; k < d->nent; k++) {
+        const struct snap_ent *e = &d->ent[k];
+
+        fprintf(s->out, "E %o %jd %jd.%09ld %jd.%09ld %ju %ju ",
+                (unsigned)e->mode, (intmax_t)e->size,
+                (intmax_t)e->mtim.tv_sec, (long)e->mtim.tv_nsec,
+                (intmax_t)e->ctim.tv_sec, (long)e->ctim.tv_nsec,
+                (uintmax_t)e->ino, (uintmax_t)e->rdev);
+
+        if (e->md) {
+            for (j = 0; j < SHA256_LEN; j++)
+                fprintf(s->out, "%02x", e->md[j]);
+        } else {
+            putc('-', s->out);
+        }
+
+        putc(' ', s->out);
+        sn_puts(e->name, s->out);
+        putc('\n', s->out);
+
+        if (e->link) {
+            fputs("L ", s->out);
+            sn_puts(e->link, s->out);
+            putc('\n', s->out);
+        }
+    }
+}
+
+/* Frees the entries of `d` */
+
+static void
+sn_clear_dir(struct snap_dir *d)
+{
+    size_t k;
+
+    for (k = 0; k < d->nent; k++) {
+        free(d->ent[k].name);
+        free(d->ent[k].md);
+        free(d->ent[k].link);
+    }
+
+    free(d->ent);
+    d->ent = NULL;
+    d->nent = 0;
+}
+
+/* Returns the snapshot side which contains path `pth`.  `*rel` is set to
+ * the path relative to the root of the snapshot. */
+
+static struct snap_side *
+sn_side_find(const char *pth, const char **rel)
+{
+    int i;
+
+    for (i = 0; i < 2; i++) {
+        struct snap_side *s = sn_side[i];
+
+        if (!s || strncmp(pth, s->arg, s->len) ||
+            (pth[s->len] && pth[s->len] != '/'))
+        {
+            continue;
+        }
+
+        if (rel) {
+            *rel = pth + s->len;
+
+            if (**rel)
+                ++*rel;
+        }
+
+        return s;
+    }
+
+    return NULL;
+}
+
+/* Reads the entries of directory `rel` from snapshot file `s`.  Returns
+ * NULL with errno ENOENT if the directory is not in the snapshot. */
+
+static struct snap_dir *
+sn_side_read(struct snap_side *s, const char *rel)
+{
+    struct snap_dir **p, *d;
+    char *line = NULL;
+    size_t len = 0, size = 0;
+    ssize_t n;
+
+    if (!(p = sn_find(&s->idx, rel)) || !*p) {
+        errno = ENOENT;
+        return NULL;
+    }
+
+    if (fseeko(s->fh, (*p)->off, SEEK_SET) == -1) {
+        sn_err("fseeko", s->arg, errno);
+        errno = EIO;
+        return NULL;
+    }
+
+    d = calloc(1, sizeof(struct snap_dir));
+    d->rel = strdup(rel);
+    d->dev = s->dev;
+
+    while ((n = getline(&line, &len, s->fh)) != -1) {
+        if (n && line[n - 1] == '\n')
+            line[--n] = 0;
+
+        if (*line == 'D')
+            break;
+
+        sn_parse_ent(d, &size, line);
+    }
+
+    free(line);
+#if defined(TRACE) && 1
+    fprintf(debug, "  sn_side_read(%s, %s): %zu entries\n", s->arg, rel,
+            d->nent);
+#endif
+    return d;
+}
+
+/* Returns the entry of path `pth` in a snapshot file.  The directory
+ * which contains the entry is kept until an entry of another directory
+ * of the same snapshot is requested. */
+
+static struct snap_ent *
+sn_side_ent(const char *pth, struct snap_side **sp)
+{
+    struct snap_side *s;
+    struct snap_ent key, *e;
+    const char *rel, *name;
+    char *dir;
+
+    if (!(s = sn_side_find(pth, &rel)) || !*rel) {
+        errno = ENOENT;
+        return NULL;
+    }
+
+    *sp = s;
+
+    if ((name = strrchr(rel, '/'))) {
+        dir = malloc((size_t)(name - rel) + 1);
+        memcpy(dir, rel, (size_t)(name - rel));
+        dir[name++ - rel] = 0;
+    } else {
+        dir = strdup("");
+        name = rel;
+    }
+
+    if (!s->cur || strcmp(s->cur->rel, dir)) {
+        if (s->cur)
+            snap_closedir(s->cur);
+
+        s->cur = sn_side_read(s, dir);
+    }
+
+    free(dir);
+
+    if (!s->cur) {
+        errno = ENOENT;
+        return NULL;
+    }
+
+    key.name = (char *)name;
+
+    if (!(e = bsearch(&key, s->cur->ent, s->cur->nent,
+                      sizeof(struct snap_ent), sn_ent_cmp)))
+    {
+        errno = ENOENT;
+    }
+
+    return e;
+}
+
+/* Sets the digest of regular file `e` or the target of symbolic link `e`
+ * in directory `sn_pth[0]` of length `l` for snap_dump(). */
+
+static int
+sn_dump_ent(struct snap_ent *e, size_t l)
+{
+    struct sha256 ctx;
+    ssize_t n;
+    int fd;
+
+    if (!sn_add_name(0, l, e->name))
+        return -1;
+
+    if (S_ISLNK(e->mode)) {
+        if ((n = readlink(sn_pth[0], lbuf, BUF_SIZE - 1)) == -1) {
+            sn_err("readlink", sn_pth[0], errno);
+            goto err;
+        }
+
+        lbuf[n] = 0;
+        e->link = strdup(lbuf);
+    } else if (S_ISREG(e->mode)) {
+        if ((fd = open(sn_pth[0], O_RDONLY)) == -1) {
+            sn_err("open", sn_pth[0], errno);
+            goto err;
+        }
+
+        sha256_init(&ctx);
+
+        if (fcmp_hash(&sn_fcmp, fd, e->size, &ctx) == -1) {
+            sn_err("read", sn_pth[0], errno);
+            close(fd);
+            goto err;
+        }
+
+        close(fd);
+        e->md = malloc(SHA256_LEN);
+        sha256_final(&ctx, e->md);
+        tot_cmp_byte_count += e->size;
+    }
+
+    ++tot_cmp_file_count; /* -A -z */
+    sn_pth[0][l] = 0;
+    return 0;
+
+err:
+    sn_pth[0][l] = 0;
+    return -1;
+}
+
+static void
+sn_err(const char *op, const char *pth, int e)
+{
+    sn_rv |= 2;
+
+    if (ign_diff_errs)
+        return;
+
+    if ((e ? dialog(ign_txt, NULL, "%s \"%s\": %s", op, pth, strerror(e)) :
+             dialog(ign_txt, NULL, "%s \"%s\"", op, pth)) == 'i')
+    {
+        ign_diff_errs = TRUE;
+    }
+}
+
+static void
+sn_puts(const char *s, FILE *fh)
+{
+    int c;
+
+    while ((c = *s++)) {
+        if (c == '\\') {
+            putc('\\', fh);
+        } else if (c == '\n') {
+            putc('\\', fh);
+            c = 'n';
+        }
+
+        putc(c, fh);
+    }
+}
+
+/* Reverts sn_puts() in place */
+
+static char *
+sn_unesc(char *s)
+{
+    char *d = s, *p = s;
+
+    while (*p) {
+        if (*p == '\\' && p[1]) {
+            *d++ = p[1] == 'n' ? '\n' : p[1];
+            p += 2;
+        } else {
+            *d++ = *p++;
+        }
+    }
+
+    *d = 0;
+    return s;
+}
+
+static int
+sn_ent_cmp(const void *a, const void *b)
+{
+    return strcmp(((const struct snap_ent *)a)->name,
+                  ((const struct snap_ent *)b)->name);
+}
+
+static bool
+sn_tim_eq(struct timespec a, struct timespec b)
+{
+    return a.tv_sec == b.tv_sec && a.tv_nsec == b.tv_nsec;
+}
+
+/* FNV-1a */
+
+static uint64_t
+sn_hash(const char *s)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+
+    while (*s)
+        h = (h ^ (unsigned char)*s++) * 0x100000001b3ULL;
+
+    return h;
+}
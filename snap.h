@@ -0,0 +1,71 @@
+#ifndef SNAP_H
+#define SNAP_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <sys/types.h>
+#include "compat.h"
+
+/* RC option "snapshot" */
+extern bool snapshot;
+
+/* Returns TRUE if the recursive scan (do_scan()) can be done by
+ * snap_scan() with the current options.  Not while the directory
+ * statistics column is shown. */
+bool snap_usable(void);
+
+/* Version of the recursive build_diff_db() scan pass which uses the
+ * snapshots of both trees written by the previous scan.
+ *
+ * Input:
+ *   syspth[0], syspth[1], pthlen[0], pthlen[1]
+ * Output:
+ *   scan_db
+ *   Snapshot files of both trees
+ *   Return value: Combination of
+ *     1 difference found
+ *     2 on error */
+int snap_scan(void);
+
+/* Option -z */
+extern bool snap_arg;
+/* A snapshot file is used as one side of the diff */
+extern bool snap_sides;
+
+struct stat;
+struct snap_dir;
+
+/* If `pth` is a snapshot file it is opened as side `i` of the diff and
+ * `*st` is set to a directory.  Sets `readonly`.
+ * Return value: 0 snapshot opened, -1 not a snapshot file */
+int snap_side_open(int i, const char *pth, struct stat *st);
+/* Writes a snapshot of directory tree `dir` with the digests of all
+ * regular files to file `pth` (option -A -z).
+ * Return value: 0 on success, 2 on error */
+int snap_dump(const char *dir, const char *pth);
+/* Returns TRUE if `pth` is inside a snapshot file opened by
+ * snap_side_open() */
+bool snap_is_pth(const char *pth);
+/* Functions for paths inside snapshot files, similar to opendir(3),
+ * readdir(3), closedir(3), lstat(2), readlink(2) and realpath(3).
+ * snap_readdir() returns the next name and sets `*type` to the file type.
+ * `*k` is the index of the entry and needs to be set to 0 first. */
+struct snap_dir *snap_opendir(const char *pth);
+const char *snap_readdir(struct snap_dir *, size_t *k, mode_t *type);
+void snap_closedir(struct snap_dir *);
+int snap_lstat(const char *pth, struct stat *st);
+char *snap_readlink(const char *pth);
+char *snap_realpath(const char *pth);
+/* Compares regular files of equal size of which at least one is inside a
+ * snapshot file.  Files are compared by their digests.  A file without
+ * digest in the snapshot can't be compared, 2 is returned for it.
+ * Return value: As for cmp_file(), -1 if no file is in a snapshot */
+int snap_cmp_file(const char *lpth, const char *rpth);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SNAP_H */
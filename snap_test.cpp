@@ -0,0 +1,192 @@
+#include <stdexcept>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "compat.h"
+#include "snap_test.h"
+#include "main.h"
+#include "test.h"
+#include "diff.h"
+#include "tc.h"
+#include "db.h"
+#include "snap.h"
+
+static void writeFile(const std::string &path, const char *const dat)
+{
+    FILE *const fh = fopen(path.c_str(), "w");
+
+    if (!fh)
+        FATAL_ERROR;
+
+    fputs(dat, fh);
+
+    if (fclose(fh))
+        FATAL_ERROR;
+}
+
+void SnapTest::run() const
+{
+    fprintf(debug, "->snap_test\n");
+
+    // The snapshots are written to $HOME
+
+    const char *const h = getenv("HOME");
+    const std::string home { h ? h : "" };
+    char *const dir = realpath(TEST_DIR, nullptr);
+
+    if (!dir)
+        FATAL_ERROR;
+
+    setenv("HOME", dir, 1);
+    free(dir);
+    snapScan();
+    dumpRoundTrip();
+
+    if (h)
+        setenv("HOME", home.c_str(), 1);
+    else
+        unsetenv("HOME");
+
+    fprintf(debug, "<-snap_test\n");
+}
+
+// The second scan reads the unchanged directories from the snapshots of
+// the first one.  Both need to find the changes.
+
+void SnapTest::snapScan() const
+{
+    fprintf(debug, "->snapScan\n");
+    const std::string side[2] { left, right };
+
+    for (int i = 0; i < 2; ++i) {
+        if (mkdir(side[i].c_str(), 0777) ||
+            mkdir((side[i] + "/Same").c_str(), 0777) ||
+            mkdir((side[i] + "/Diff").c_str(), 0777) ||
+            mkdir((side[i] + "/Sub").c_str(), 0777) ||
+            mkdir((side[i] + "/Sub/Deep").c_str(), 0777))
+        {
+            FATAL_ERROR;
+        }
+
+        writeFile(side[i] + "/Same/f", "same\n");
+        writeFile(side[i] + "/Diff/f", i ? "right\n" : "left\n");
+        writeFile(side[i] + "/Sub/Deep/f", "same\n");
+    }
+
+    pthlen[0] = strlen(left);
+    memcpy(syspth[0], left, pthlen[0] + 1);
+    pthlen[1] = strlen(right);
+    memcpy(syspth[1], right, pthlen[1] + 1);
+    bmode = FALSE;
+    fmode = FALSE;
+    scan = 1;
+    free_scan_db(FALSE);
+
+    if (snap_scan() != 1 || !scanDiff("") || !scanDiff("/Diff") ||
+        scanDiff("/Same") || scanDiff("/Sub"))
+    {
+        FATAL_ERROR;
+    }
+
+    // A new file changes the directory, a longer file does not
+
+    writeFile(side[1] + "/Same/New", "new\n");
+    writeFile(side[1] + "/Sub/Deep/f", "changed\n");
+    free_scan_db(FALSE);
+    pthlen[0] = strlen(left);
+    pthlen[1] = strlen(right);
+
+    // Only right files are found in the right directory
+
+    if (snap_scan() != 1 || !scanDiff("/Diff") ||
+        !scanDiff("/Same", right) || !scanDiff("/Sub/Deep"))
+    {
+        FATAL_ERROR;
+    }
+
+    scan = 0;
+    free_scan_db(FALSE);
+    fprintf(debug, "<-snapScan\n");
+}
+
+// A tree dumped to a snapshot file (-A -z) is opened as side of the diff.
+// It contains the same entries and its files compare equal to the tree.
+
+void SnapTest::dumpRoundTrip() const
+{
+    fprintf(debug, "->dumpRoundTrip\n");
+    const std::string snap { TEST_DIR "/Snap left.snap" };
+    const std::string other { TEST_DIR "/Snap other" };
+
+    if (snap_dump(left, snap.c_str()))
+        FATAL_ERROR;
+
+    struct stat st;
+
+    if (snap_side_open(0, snap.c_str(), &st) || !S_ISDIR(st.st_mode))
+        FATAL_ERROR;
+
+    std::vector<std::string> names;
+    struct snap_dir *const d = snap_opendir(snap.c_str());
+
+    if (!d)
+        FATAL_ERROR;
+
+    size_t k = 0;
+    mode_t type;
+
+    while (const char *const name = snap_readdir(d, &k, &type)) {
+        if (!S_ISDIR(type))
+            FATAL_ERROR;
+
+        names.push_back(name);
+    }
+
+    snap_closedir(d);
+    std::sort(names.begin(), names.end());
+
+    if (names != std::vector<std::string> { "Diff", "Same", "Sub" })
+        FATAL_ERROR;
+
+    // Same size, other contents
+
+    writeFile(other, "lefT\n");
+
+    if (snap_lstat((snap + "/Diff/f").c_str(), &st) ||
+        !S_ISREG(st.st_mode) || st.st_size != 5 ||
+        snap_cmp_file((snap + "/Diff/f").c_str(),
+                      (std::string(left) + "/Diff/f").c_str()) ||
+        snap_cmp_file((snap + "/Diff/f").c_str(), other.c_str()) != 1 ||
+        snap_cmp_file((snap + "/Sub/Deep/f").c_str(),
+                      (std::string(left) + "/Sub/Deep/f").c_str()))
+    {
+        FATAL_ERROR;
+    }
+
+    snap_sides = FALSE;
+    readonly = FALSE;
+    fprintf(debug, "<-dumpRoundTrip\n");
+}
+
+// Returns true if the scan found differences in directory `dir` of tree
+// `root`
+
+bool SnapTest::scanDiff(const char *const dir, const char *root) const
+{
+    if (!root)
+        root = left;
+
+    char *const rp = realpath((std::string(root) + dir).c_str(), nullptr);
+
+    if (!rp)
+        FATAL_ERROR;
+
+    const bool b = scan_db_srch(rp);
+    free(rp);
+    return b;
+}
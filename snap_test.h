@@ -0,0 +1,19 @@
+#ifndef SNAP_TEST_H
+#define SNAP_TEST_H
+
+class SnapTest
+{
+public:
+    void run() const;
+
+private:
+    void snapScan() const;
+    void dumpRoundTrip() const;
+    bool scanDiff(const char *const dir,
+                  const char *root = nullptr) const;
+
+    const char *const left { TEST_DIR "/Snap left" };
+    const char *const right { TEST_DIR "/Snap right" };
+};
+
+#endif // SNAP_TEST_H
@@ -11,6 +11,13 @@
 #include "misc_test.h"
 #include "abs2relPathTest.h"
 #include "MoveCursorToFileTest.h"
+#include "Sha256Test.h"
+#include "pscan_test.h"
+#include "cmpq_test.h"
+#include "rmtree_test.h"
+#include "snap_test.h"
+#include "watch_test.h"
+#include "db_test.h"
 
 bool printerr_called;
 
@@ -58,6 +65,13 @@ try {
     { MiscTest test; test.run(); }
     { Abs2RelPathTest test; test.run(); }
     { MoveCursorToFileTest test; test.run(); }
+    { Sha256Test test; test.run(); }
+    { PscanTest test; test.run(); }
+    { CmpqTest test; test.run(); }
+    { RmtreeTest test; test.run(); }
+    { SnapTest test; test.run(); }
+    { WatchTest test; test.run(); }
+    { DbTest test; test.run(); }
 
     rmTestDir();
     fprintf(debug, "<-test\n");
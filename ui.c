@@ -43,6 +43,7 @@ PERFORMANCE OF THIS SOFTWARE.
 #include "cplt.h"
 #include "misc.h"
 #include "gq.h"
+#include "cmpq.h"
 #ifdef TEST
 # include "test.h"
 #endif
@@ -95,6 +96,8 @@ static int disp_name(WINDOW *w, int y, int x, int mx, int o,
                      struct filediff *f, int t, short ct, char *l, int d,
                      int i);
 static size_t gettimestr(char *, size_t, time_t *);
+static const char *getcntstr(char *, size_t, unsigned long);
+static size_t getdstatstr(char *, size_t, const struct dir_stat *);
 static void disp_help(void);
 static void help_pg_down(void);
 static void help_pg_up(void);
@@ -161,6 +164,7 @@ bool add_mtime;
 bool add_ns_mtim;
 bool add_owner;
 bool add_group;
+bool add_dstat; /* directory statistics */
 bool vi_cursor_keys;
 
 int
@@ -317,7 +321,7 @@ next_key:
 
 		opt_flushinp();
 
-		while ((c = getch()) == ERR) {
+		while ((c = cmpq_getch()) == ERR) {
 		}
 
 #if defined(TRACE)
@@ -828,9 +832,39 @@ emulate_key_right:
 				}
 
 				sorting = DIRSFIRST;
-				rebuild_db(1);
+				rebuild_db(1|16);
 				break;
 
+			} else if (*key == 'A') {
+				c = 0;
+
+				if (add_dstat) {
+					goto next_key;
+				}
+
+				add_dstat = TRUE;
+
+				/* The statistics are collected by the scan */
+				if (recursive && !bmode && !fmode) {
+					free_scan_db(TRUE);
+					rebuild_db(1);
+				} else {
+					disp_fmode();
+				}
+
+				goto next_key;
+
+			} else if (*key == 'R') {
+				c = 0;
+
+				if (!add_dstat) {
+					goto next_key;
+				}
+
+				add_dstat = FALSE;
+				disp_fmode();
+				goto next_key;
+
 			} else if (*key != 'd') {
 				break;
 			}
@@ -855,7 +889,7 @@ emulate_key_right:
 				}
 
 				sorting = SORTMTIME;
-				rebuild_db(1);
+				rebuild_db(1|16);
 				goto next_key;
 
 			case 'A':
@@ -971,7 +1005,7 @@ emulate_key_right:
                 }
 
                 sorting = SORT_SYMLINK;
-                rebuild_db(1);
+                rebuild_db(1|16);
                 goto next_key;
 			}
             if (vi_cursor_keys)
@@ -1138,7 +1172,7 @@ emulate_key_right:
                         goto next_key;
                     }
                     sorting = SORT_EXTENSION;
-                    rebuild_db(1);
+                    rebuild_db(1|16);
                     goto next_key;
                 }
                 else
@@ -1204,7 +1238,7 @@ emulate_key_right:
 					break;
 
 				sorting = SORTMIXED;
-				rebuild_db(1);
+				rebuild_db(1|16);
 				break;
 			}
 
@@ -1259,7 +1293,7 @@ emulate_key_right:
 					break;
 
 				sorting = SORTSIZE;
-				rebuild_db(1);
+				rebuild_db(1|16);
 				break;
 			}
 
@@ -1319,7 +1353,7 @@ emulate_key_right:
                 if (sorting == SORT_OWNER)
                     break;
                 sorting = SORT_OWNER;
-                rebuild_db(1);
+                rebuild_db(1|16);
                 break;
             }
 			c = 0;
@@ -1387,7 +1421,7 @@ emulate_key_right:
                     break;
                 }
                 sorting = SORT_GROUP;
-                rebuild_db(1);
+                rebuild_db(1|16);
             }
             else if ('g' == *key)
             {
@@ -1812,6 +1846,7 @@ static const char *const helptxt[] = {
        "E		Toggle file name or file content filter",
        ",		Toggle display of hidden files",
        "Aa		Show mode, owner, group, size, and mtime",
+       "Ad		Show directory statistics",
        "Ah		Show scaled file size",
        "Ag		Show file group",
        "An		Show nanosecond precision mtime",
@@ -1820,6 +1855,7 @@ static const char *const helptxt[] = {
        "At		Show modification time",
        "Au		Show file owner",
        "Ra		Remove mode, owner, group, size, and mtime column",
+       "Rd		Remove directory statistics column",
        "Rh		Remove scaled file size column",
        "Rg		Remove file group column",
        "Rn		Remove nanosecond precision mtime column",
@@ -2487,7 +2523,10 @@ action(
 		if ((mode & 8) || (mode & 2))
 			tool(f1->name, f2->name, 3, 1);
 		else if (S_ISREG(typ[0])) {
-			if (f1->diff == '!')
+			cmpq_refine(f1);
+
+			/* '?': Compare had been stopped */
+			if (f1->diff == '!' || f1->diff == '?')
 				tool(f1->name, f2->name, 3, 0);
 			else
 				tool(f1->name, NULL, 1, 0);
@@ -3013,6 +3052,24 @@ void disp_list(const unsigned md)
 	return;
 }
 
+void disp_fdiff(const struct filediff *const f)
+{
+    unsigned y, i;
+
+    if (fmode || bmode)
+        return;
+
+    for (y = 0, i = top_idx[right_col];
+         y < listh && i < db_num[right_col]; y++, i++)
+    {
+        if (db_list[right_col][i] == f) {
+            disp_marked_line(y, i, 1, getlstwin());
+            refr_scr();
+            break;
+        }
+    }
+}
+
 static void disp_marked_line(const unsigned y, const unsigned i, const unsigned md, WINDOW *const w)
 {
     bool cg = CHGAT_MRKS;
@@ -3271,6 +3328,8 @@ static int disp_name(WINDOW *w, int y, int x, int mx, int o,
     static const int ns_time_width = 28; /* "18-09-17 17:42:54.000000000"
                                           * ("%'09ld" does not work!?) */
     static const int mtime_width = 13;
+    /* "1234< 1234> 1234! 1234= 1023K" */
+    static const int dstat_width = 30;
 
 	db = fmode ? right_col : 0;
 
@@ -3298,6 +3357,10 @@ static int disp_name(WINDOW *w, int y, int x, int mx, int o,
         mx -= ns_time_width;
     }
 
+	if (add_dstat) {
+		mx -= dstat_width;
+	}
+
 	if (!o) {
 		if (!color) {
 			if (d != ' ') {
@@ -3362,7 +3425,7 @@ static int disp_name(WINDOW *w, int y, int x, int mx, int o,
 		size_t n;
 
 		mx += 5;
-		n = getfilesize(lbuf, sizeof lbuf, f->siz[i], 1);
+		n = getfilesize(lbuf, sizeof lbuf, FD_SIZ(f, i), 1);
 		wmove(w, y, mx - n);
 		addmbs(w, lbuf, 0);
 
@@ -3387,23 +3450,36 @@ static int disp_name(WINDOW *w, int y, int x, int mx, int o,
 	if (add_mtime) {
 		size_t n;
         mx += mtime_width;
-        n = gettimestr(lbuf, sizeof lbuf, &f->mtim[i].tv_sec);
+        n = gettimestr(lbuf, sizeof lbuf, &f->mtime[i]);
 		wmove(w, y, mx - n);
 		addmbs(w, lbuf, 0);
     } else if (add_ns_mtim) {
         struct tm tm;
-        if (localtime_r(&f->mtim[i].tv_sec, &tm)) {
+        if (localtime_r(&f->mtime[i], &tm)) {
             const size_t n = snprintf(lbuf, sizeof(lbuf),
                          "%02d-%02d-%02d %02d:%02d:%02d.%09ld",
                          tm.tm_year % 100, tm.tm_mon + 1, tm.tm_mday,
                          tm.tm_hour, tm.tm_min, tm.tm_sec,
-                         f->mtim[i].tv_nsec);
+                         (long)f->mtime_ns[i]);
             mx += ns_time_width;
             wmove(w, y, mx - n);
             addmbs(w, lbuf, 0);
         }
     }
 
+	if (add_dstat) {
+		const struct dir_stat *st;
+
+		mx += dstat_width;
+
+		if (S_ISDIR(f->type[i]) && (st = get_dir_stat(f))) {
+			size_t n = getdstatstr(lbuf, sizeof lbuf, st);
+
+			wmove(w, y, mx - n);
+			addmbs(w, lbuf, 0);
+		}
+	}
+
 	return 0;
 }
 
@@ -3633,13 +3709,13 @@ file_stat(struct filediff *f, struct filediff *f2)
 		rtyp = 0;
 
 	if (ltyp) {
-        lx1 = x + gettimestr(lbuf, sizeof lbuf, &f->mtim[0].tv_sec);
+        lx1 = x + gettimestr(lbuf, sizeof lbuf, &f->mtime[0]);
 		wmove(wstat, yl, x);
 		addmbs(wstat, lbuf, mx1);
 	}
 
 	if (rtyp) {
-        lx2 = x2 + gettimestr(rbuf, sizeof rbuf, &f2->mtim[1].tv_sec);
+        lx2 = x2 + gettimestr(rbuf, sizeof rbuf, &f2->mtime[1]);
 		wmove(wstat, yr, x2);
 		addmbs(wstat, rbuf, 0);
 	}
@@ -3702,6 +3778,36 @@ size_t getfilesize(char *buf, size_t bufsiz, off_t size,
 	}
 }
 
+/* Returns a count with at most 4 characters */
+
+static const char *
+getcntstr(char *buf, size_t bufsiz, unsigned long n)
+{
+	if (n < 10000)
+		snprintf(buf, bufsiz, "%lu", n);
+	else if (n < 1000000)
+		snprintf(buf, bufsiz, "%luk", n / 1000);
+	else if (n < 1000000000)
+		snprintf(buf, bufsiz, "%luM", n / 1000000);
+	else
+		snprintf(buf, bufsiz, "%luG", n / 1000000000);
+
+	return buf;
+}
+
+static size_t
+getdstatstr(char *buf, size_t bufsiz, const struct dir_stat *st)
+{
+	char n[4][16], s[16];
+
+	getfilesize(s, sizeof s, st->dsiz, 1);
+	return snprintf(buf, bufsiz, "%4s< %4s> %4s! %4s= %5s",
+	    getcntstr(n[0], sizeof n[0], st->only[0]),
+	    getcntstr(n[1], sizeof n[1], st->only[1]),
+	    getcntstr(n[2], sizeof n[2], st->diff),
+	    getcntstr(n[3], sizeof n[3], st->equal), s);
+}
+
 static size_t
 gettimestr(char *buf, size_t bufsiz, time_t *t)
 {
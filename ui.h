@@ -20,7 +20,7 @@
 #define DB_LST_IDX (top_idx[right_col] + curs[right_col])
 #define DB_LST_ITM (db_list[right_col][DB_LST_IDX])
 #define CHGAT_MRKS (fmode || add_mode || add_hsize || add_bsize || add_mtime \
-    || add_owner || add_group)
+    || add_owner || add_group || add_dstat)
 
 struct ui_state {
 	/* Path before going to temp dir for returning when leaving temp dir */
@@ -28,7 +28,7 @@ struct ui_state {
 	/* Path to temp dir for removing it later */
     char *lzip, *rzip;
 	size_t llen, rlen;
-	void *bst;
+	void *db; /* diff DB */
 	unsigned num; /* db_num */
 	struct filediff **list;
     unsigned top_idx, curs;
@@ -68,6 +68,8 @@ int vdialog(const char *, const char *, const char *, va_list);
  * @param md [0]: 1: Enable cursor
  */
 void disp_list(unsigned md);
+/* Redraws the line of `f` if it is visible in diff mode */
+void disp_fdiff(const struct filediff *f);
 void center(unsigned);
 void no_file(void);
 void action(short, unsigned);
@@ -133,6 +135,7 @@ extern bool add_mtime;
 extern bool add_ns_mtim;
 extern bool add_owner;
 extern bool add_group;
+extern bool add_dstat; /* directory statistics */
 extern bool vi_cursor_keys;
 
 #endif /* UI_H */
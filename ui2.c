@@ -24,6 +24,7 @@ PERFORMANCE OF THIS SOFTWARE.
 #include <stdarg.h>
 #include <signal.h>
 #include <time.h>
+#include <stdint.h>
 #include "ed.h"
 #include "ui.h"
 #include "exec.h"
@@ -791,7 +792,7 @@ next_opt:
 		 (next_arg = TRUE)))
 	{
 		sortic = not ? FALSE : TRUE ;
-		rebuild_db(1);
+		rebuild_db(1|16);
 
 	} else if (!strcmp(buf, "ws") ||
 	    (!strncmp(buf, "ws ", (skip = 3)) &&
@@ -1000,6 +1001,12 @@ ret:
 #endif
 		break;
 	case 1:
+        if (cmp_diff_off != -1) {
+            printerr(any_txt, "\"%s\" and \"%s\" differ at offset %jd",
+                     olnam, ornam, (intmax_t)cmp_diff_off);
+            break;
+        }
+
         printerr(any_txt, "Different: \"%s\" and \"%s\"",
 #if defined(DEBUG) && 0
 		    lnam, rnam);
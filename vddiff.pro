@@ -1,8 +1,16 @@
 DEFINES = \
     DEBUG \
     HAVE_FUTIMENS BIN='""' \
+    HAVE_INOTIFY \
     HAVE_LIBAVLBST \
+    HAVE_COPY_FILE_RANGE \
+    HAVE_FICLONE \
     HAVE_MKDTEMP \
+    HAVE_MMAP \
+    HAVE_POSIX_FADVISE \
+    HAVE_PTHREAD \
+    HAVE_SENDFILE \
+    HAVE_STATX \
     HAVE_NCURSESW_CURSES_H \
     LEX_HAS_BUFS \
     TEST \
@@ -18,6 +26,7 @@ SOURCES += \
     test.cpp \
     cplt.c \
     db.c \
+    db_test.cpp \
     diff.c \
     dl.c \
     ed.c \
@@ -36,13 +45,30 @@ SOURCES += \
     MoveCursorToFile.c \
     MoveCursorToFileTest.cpp \
     unit_prefix.c \
-    format_time.c
+    format_time.c \
+    pscan.c \
+    pscan_test.cpp \
+    sha256.c \
+    Sha256Test.cpp \
+    digest.c \
+    fcmp.c \
+    mismatch.c \
+    cmpq.c \
+    cmpq_test.cpp \
+    pcopy.c \
+    rmtree.c \
+    rmtree_test.cpp \
+    snap.c \
+    snap_test.cpp \
+    watch.c \
+    watch_test.cpp
 
 HEADERS += \
     abs2relPath.h \
     abs2relPathTest.h \
     cplt.h \
     db.h \
+    db_test.h \
     diff.h \
     dl.h \
     ed.h \
@@ -68,4 +94,20 @@ HEADERS += \
     MoveCursorToFileTest.h \
     ver.h \
     unit_prefix.h \
-    format_time.h
+    format_time.h \
+    pscan.h \
+    pscan_test.h \
+    sha256.h \
+    Sha256Test.h \
+    digest.h \
+    fcmp.h \
+    mismatch.h \
+    cmpq.h \
+    cmpq_test.h \
+    pcopy.h \
+    rmtree.h \
+    rmtree_test.h \
+    snap.h \
+    snap_test.h \
+    watch.h \
+    watch_test.h
@@ -0,0 +1,396 @@
+/*
+Copyright (c) 2016-2018, Carsten Kunze <carsten.kunze@arcor.de>
+
+Permission to use, copy, modify, and/or distribute this software for any
+purpose with or without fee is hereby granted, provided that the above
+copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+PERFORMANCE OF THIS SOFTWARE.
+*/
+
+/*
+ * Watches the displayed directories with inotify(7).
+ *
+ * The names of changed files are collected from the events.  Only these
+ * files are read again (update_diff_ent()), then the list is sorted and
+ * redrawn.  This is done while waiting for input (watch_getch()) and
+ * after file system operations (rebuild_db() mode 8), which hence don't
+ * read the whole directory again.
+ *
+ * If events had been lost (queue overflow, too many changes) or a
+ * watched directory had been removed, the directory is read again by
+ * rebuild_db().
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#ifdef HAVE_INOTIFY
+# include <poll.h>
+# include <sys/inotify.h>
+#endif
+#include "compat.h"
+#include "main.h"
+#include "ui.h"
+#include "ui2.h"
+#include "diff.h"
+#include "db.h"
+#include "gq.h"
+#include "tc.h"
+#include "fs.h"
+#include "cmpq.h"
+#include "snap.h"
+#include "watch.h"
+
+bool watch_dirs;
+
+#ifdef HAVE_INOTIFY
+
+/* More changes are not applied one by one */
+#define WT_MAX 1024
+/* IN_MODIFY is not used, a file which is being written would be compared
+ * for each write(2) */
+#define WT_MASK (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | \
+                 IN_CLOSE_WRITE | IN_ATTRIB | IN_DELETE_SELF | \
+                 IN_MOVE_SELF | IN_ONLYDIR)
+
+static bool wt_usable(void);
+static const char *wt_dir(int, size_t *);
+static bool wt_watched(void);
+static void wt_read(void);
+static void wt_add(int, const char *);
+static void wt_apply(void);
+static void wt_clear(int);
+
+static int wt_fd = -1;
+static int wt_wd[2] = { -1, -1 };
+static char *wt_pth[2];
+/* Names of changed files */
+static char **wt_names[2];
+static size_t wt_num[2];
+static size_t wt_size[2];
+static bool wt_lost;
+
+void
+watch_set(void)
+{
+    const char *p;
+    size_t l;
+    int i;
+
+    if (!wt_usable())
+        return;
+
+    if (wt_fd == -1 &&
+        (wt_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) == -1)
+    {
+        printerr(strerror(errno), "inotify_init1");
+        watch_dirs = FALSE;
+        return;
+    }
+
+    for (i = 0; i < 2; i++) {
+        p = wt_dir(i, &l);
+
+        if (p && wt_pth[i] && strlen(wt_pth[i]) == l &&
+            !memcmp(wt_pth[i], p, l))
+        {
+            continue;
+        }
+
+        if (wt_wd[i] != -1 && wt_wd[i] != wt_wd[!i])
+            inotify_rm_watch(wt_fd, wt_wd[i]);
+
+        wt_wd[i] = -1;
+        free(wt_pth[i]);
+        wt_pth[i] = NULL;
+        wt_clear(i);
+
+        if (!p)
+            continue;
+
+        wt_pth[i] = malloc(l + 1);
+        memcpy(wt_pth[i], p, l);
+        wt_pth[i][l] = 0;
+
+        /* Same directory on both sides gives the same `wd` */
+        if ((wt_wd[i] = inotify_add_watch(wt_fd, wt_pth[i], WT_MASK)) ==
+            -1)
+        {
+#if defined(TRACE)
+            fprintf(debug, "  inotify_add_watch(%s): %s\n", wt_pth[i],
+                    strerror(errno));
+#endif
+        }
+    }
+}
+
+int
+watch_sync(void)
+{
+    int i;
+
+    if (!wt_usable() || !wt_watched())
+        return -1;
+
+    wt_read();
+
+    if (wt_lost) {
+        wt_lost = FALSE;
+
+        for (i = 0; i < 2; i++)
+            wt_clear(i);
+
+        return -1;
+    }
+
+    wt_apply();
+    return 0;
+}
+
+int
+watch_getch(void)
+{
+    struct pollfd pfd[2];
+    int c;
+
+    watch_set();
+
+    if (!wt_usable() || !wt_watched())
+        return getch();
+
+    while (1) {
+        timeout(0);
+        c = getch();
+        timeout(-1);
+
+        if (c != ERR)
+            return c;
+
+        pfd[0].fd = STDIN_FILENO;
+        pfd[0].events = POLLIN;
+        pfd[1].fd = wt_fd;
+        pfd[1].events = POLLIN;
+
+        if (poll(pfd, 2, -1) == -1) {
+            if (errno == EINTR)
+                continue; /* E.g. SIGWINCH, getch() gets KEY_RESIZE */
+
+            return getch();
+        }
+
+        if (pfd[1].revents & POLLIN) {
+            if (watch_sync() == -1)
+                rebuild_db(1);
+
+            /* Let cmpq_getch() compare the files queued by the update */
+            return ERR;
+        }
+    }
+}
+
+static bool
+wt_usable(void)
+{
+    return watch_dirs && !scan && !cli_mode && !file_pattern && !snap_sides;
+}
+
+/* Returns the directory displayed for side `i` and its length or NULL */
+
+static const char *
+wt_dir(int i, size_t *l)
+{
+    /* bmode: syspth[0] is ".", syspth[1] is set by build_diff_db() */
+    if (bmode) {
+        if (i)
+            return NULL;
+
+        i = 1;
+    }
+
+    *l = pthlen[i];
+    return syspth[i];
+}
+
+/* Returns TRUE if the events of the displayed directories are read */
+
+static bool
+wt_watched(void)
+{
+    const char *p;
+    size_t l;
+    int i;
+
+    if (wt_fd == -1)
+        return FALSE;
+
+    for (i = 0; i < 2; i++) {
+        if (!(p = wt_dir(i, &l)))
+            continue;
+
+        if (wt_wd[i] == -1 || !wt_pth[i] || strlen(wt_pth[i]) != l ||
+            memcmp(wt_pth[i], p, l))
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+static void
+wt_read(void)
+{
+    union {
+        struct inotify_event ev;
+        char buf[4096];
+    } u;
+    ssize_t n;
+
+    while ((n = read(wt_fd, u.buf, sizeof u.buf)) > 0) {
+        const char *p = u.buf;
+
+        while (p < u.buf + n) {
+            const struct inotify_event *ev =
+                (const struct inotify_event *)(const void *)p;
+            int i;
+
+            if (ev->mask & IN_Q_OVERFLOW)
+                wt_lost = TRUE;
+
+            for (i = 0; i < 2; i++) {
+                if (ev->wd != wt_wd[i])
+                    continue;
+
+                if (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF))
+                    wt_lost = TRUE;
+                else if (ev->len && *ev->name)
+                    wt_add(i, ev->name);
+            }
+
+            p += sizeof(struct inotify_event) + ev->len;
+        }
+    }
+}
+
+static void
+wt_add(int i, const char *name)
+{
+    size_t k;
+
+    if (wt_lost)
+        return;
+
+    for (k = 0; k < wt_num[i]; k++) {
+        if (!strcmp(wt_names[i][k], name))
+            return;
+    }
+
+    if (wt_num[i] == WT_MAX) {
+        wt_lost = TRUE;
+        return;
+    }
+
+    if (wt_num[i] == wt_size[i]) {
+        wt_size[i] = wt_size[i] ? 2 * wt_size[i] : 16;
+        wt_names[i] = realloc(wt_names[i], wt_size[i] * sizeof(char *));
+    }
+
+    wt_names[i][wt_num[i]++] = strdup(name);
+}
+
+/* Updates the changed entries, sorts and redraws the list.  The cursor
+ * stays on the selected file. */
+
+static void
+wt_apply(void)
+{
+    char *name;
+    unsigned u;
+    size_t k;
+    int i;
+
+    if (mark && !gl_mark)
+        mark_global();
+
+    name = saveselname();
+    cmpq_clear();
+    nodelay(stdscr, TRUE); /* cmp_file() waits for key */
+
+    for (i = 0; i < 2; i++) {
+        if (!wt_num[i])
+            continue;
+
+        for (k = 0; k < wt_num[i]; k++)
+            update_diff_ent(wt_names[i][k], i);
+
+        wt_clear(i);
+
+        if (fmode)
+            diff_db_sort(i);
+    }
+
+    nodelay(stdscr, FALSE);
+
+    if (!fmode)
+        diff_db_sort(0);
+
+    if (bg_cmp || fast_approx)
+        cmpq_rescan();
+
+    if (name) {
+        u = findlistname(name);
+
+        if (u < db_num[right_col] &&
+            !strcmp(db_list[right_col][u]->name, name))
+        {
+            if (u < top_idx[right_col] || u >= top_idx[right_col] + listh)
+            {
+                free(name);
+                center(u);
+                return;
+            }
+
+            curs[right_col] = u - top_idx[right_col];
+        }
+
+        free(name);
+    }
+
+    disp_fmode();
+}
+
+static void
+wt_clear(int i)
+{
+    while (wt_num[i])
+        free(wt_names[i][--wt_num[i]]);
+}
+
+#else /* HAVE_INOTIFY */
+
+void
+watch_set(void)
+{
+}
+
+int
+watch_sync(void)
+{
+    return -1;
+}
+
+int
+watch_getch(void)
+{
+    return getch();
+}
+
+#endif /* HAVE_INOTIFY */
@@ -0,0 +1,28 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "compat.h"
+
+/* RC option "watch" */
+extern bool watch_dirs;
+
+/* Watches the displayed directories.  Called before waiting for input. */
+void watch_set(void);
+/* Applies the changes of the watched directories to the diff DB and
+ * redraws the list.
+ * Return value: 0 done, -1 the list needs to be read again, e.g. since
+ * the directories are not watched or events had been lost */
+int watch_sync(void);
+/* getch() which applies the changes of the watched directories while no
+ * key is typed.  Returns ERR after the changes had been applied. */
+int watch_getch(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* WATCH_H */
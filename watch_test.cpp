@@ -0,0 +1,107 @@
+#include <stdexcept>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "compat.h"
+#include "watch_test.h"
+#include "main.h"
+#include "test.h"
+#include "diff.h"
+#include "tc.h"
+#include "db.h"
+#include "watch.h"
+
+static void writeFile(const std::string &path, const char *const dat)
+{
+    FILE *const fh = fopen(path.c_str(), "w");
+
+    if (!fh)
+        FATAL_ERROR;
+
+    fputs(dat, fh);
+
+    if (fclose(fh))
+        FATAL_ERROR;
+}
+
+void WatchTest::run() const
+{
+    fprintf(debug, "->watch_test\n");
+    updateList();
+    fprintf(debug, "<-watch_test\n");
+}
+
+// Created, changed and removed files are applied to the diff DB from the
+// inotify events without reading the directories again
+
+void WatchTest::updateList() const
+{
+    fprintf(debug, "->updateList\n");
+    const std::string side[2] { left, right };
+
+    for (int i = 0; i < 2; ++i) {
+        if (mkdir(side[i].c_str(), 0777))
+            FATAL_ERROR;
+
+        writeFile(side[i] + "/Changed", "same\n");
+        writeFile(side[i] + "/Removed", "same\n");
+    }
+
+    pthlen[0] = strlen(left);
+    memcpy(syspth[0], left, pthlen[0] + 1);
+    pthlen[1] = strlen(right);
+    memcpy(syspth[1], right, pthlen[1] + 1);
+    bmode = FALSE;
+    fmode = FALSE;
+    scan = 0;
+
+    // FsTest had set the lists to its own arrays
+
+    for (int i = 0; i < 2; ++i) {
+        db_list[i] = nullptr;
+        db_num[i] = 0;
+    }
+
+    build_diff_db(3);
+
+    if (!findName("Changed") || findName("Changed")->diff != ' ')
+        FATAL_ERROR;
+
+    watch_dirs = TRUE;
+    watch_set();
+
+    writeFile(side[1] + "/Changed", "other\n");
+    writeFile(side[1] + "/Created", "new\n");
+
+    if (unlink((side[0] + "/Removed").c_str()) ||
+        unlink((side[1] + "/Removed").c_str()))
+    {
+        FATAL_ERROR;
+    }
+
+    if (watch_sync())
+        FATAL_ERROR;
+
+    watch_dirs = FALSE;
+
+    if (!findName("Changed") || findName("Changed")->diff != '!' ||
+        !findName("Created") || findName("Removed"))
+    {
+        FATAL_ERROR;
+    }
+
+    diff_db_free(0);
+    fprintf(debug, "<-updateList\n");
+}
+
+const filediff *WatchTest::findName(const char *const name) const
+{
+    for (unsigned u = 0; u < db_num[0]; ++u) {
+        if (!strcmp(db_list[0][u]->name, name))
+            return db_list[0][u];
+    }
+
+    return nullptr;
+}
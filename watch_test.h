@@ -0,0 +1,19 @@
+#ifndef WATCH_TEST_H
+#define WATCH_TEST_H
+
+struct filediff;
+
+class WatchTest
+{
+public:
+    void run() const;
+
+private:
+    void updateList() const;
+    const filediff *findName(const char *const name) const;
+
+    const char *const left { TEST_DIR "/Watch left" };
+    const char *const right { TEST_DIR "/Watch right" };
+};
+
+#endif // WATCH_TEST_H
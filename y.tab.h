@@ -0,0 +1,246 @@
+/* A Bison parser, made by GNU Bison 3.8.2.  */
+
+/* Bison interface for Yacc-like parsers in C
+
+   Copyright (C) 1984, 1989-1990, 2000-2015, 2018-2021 Free Software Foundation,
+   Inc.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.  */
+
+/* As a special exception, you may create a larger work that contains
+   part or all of the Bison parser skeleton and distribute that work
+   under terms of your choice, so long as that work isn't itself a
+   parser generator using the skeleton or a modified version thereof
+   as a parser skeleton.  Alternatively, if you modify or redistribute
+   the parser skeleton itself, you may (at your option) remove this
+   special exception, which will cause the skeleton and the resulting
+   Bison output files to be licensed under the GNU General Public
+   License without this special exception.
+
+   This special exception was added by the Free Software Foundation in
+   version 2.2 of Bison.  */
+
+/* DO NOT RELY ON FEATURES THAT ARE NOT DOCUMENTED in the manual,
+   especially those whose name start with YY_ or yy_.  They are
+   private implementation details that can be changed or removed.  */
+
+#ifndef YY_YY_Y_TAB_H_INCLUDED
+# define YY_YY_Y_TAB_H_INCLUDED
+/* Debug traces.  */
+#ifndef YYDEBUG
+# define YYDEBUG 0
+#endif
+#if YYDEBUG
+extern int yydebug;
+#endif
+
+/* Token kinds.  */
+#ifndef YYTOKENTYPE
+# define YYTOKENTYPE
+  enum yytokentype
+  {
+    YYEMPTY = -2,
+    YYEOF = 0,                     /* "end of file"  */
+    YYerror = 256,                 /* error  */
+    YYUNDEF = 257,                 /* "invalid token"  */
+    DIFFTOOL = 258,                /* DIFFTOOL  */
+    FILES = 259,                   /* FILES  */
+    DIRS = 260,                    /* DIRS  */
+    MIXED = 261,                   /* MIXED  */
+    FOLLOW = 262,                  /* FOLLOW  */
+    MONO = 263,                    /* MONO  */
+    NOEQUAL = 264,                 /* NOEQUAL  */
+    LEFT_COLOR = 265,              /* LEFT_COLOR  */
+    RIGHT_COLOR = 266,             /* RIGHT_COLOR  */
+    DIFF_COLOR = 267,              /* DIFF_COLOR  */
+    DIR_COLOR = 268,               /* DIR_COLOR  */
+    UNKNOWN_COLOR = 269,           /* UNKNOWN_COLOR  */
+    LINK_COLOR = 270,              /* LINK_COLOR  */
+    REAL_DIFF = 271,               /* REAL_DIFF  */
+    RECURSIVE = 272,               /* RECURSIVE  */
+    VIEWTOOL = 273,                /* VIEWTOOL  */
+    EXT = 274,                     /* EXT  */
+    BG = 275,                      /* BG  */
+    FKEY = 276,                    /* FKEY  */
+    HISTSIZE = 277,                /* HISTSIZE  */
+    SKIPEXT = 278,                 /* SKIPEXT  */
+    NOIC = 279,                    /* NOIC  */
+    MAGIC = 280,                   /* MAGIC  */
+    NOWS = 281,                    /* NOWS  */
+    SCALE = 282,                   /* SCALE  */
+    SHELL = 283,                   /* SHELL  */
+    SH = 284,                      /* SH  */
+    NORMAL_COLOR = 285,            /* NORMAL_COLOR  */
+    CURSOR_COLOR = 286,            /* CURSOR_COLOR  */
+    ERROR_COLOR = 287,             /* ERROR_COLOR  */
+    MARK_COLOR = 288,              /* MARK_COLOR  */
+    BG_COLOR = 289,                /* BG_COLOR  */
+    ALIAS = 290,                   /* ALIAS  */
+    TWOCOLUMN = 291,               /* TWOCOLUMN  */
+    READONLY = 292,                /* READONLY  */
+    DISP_PERM = 293,               /* DISP_PERM  */
+    DISP_OWNER = 294,              /* DISP_OWNER  */
+    DISP_GROUP = 295,              /* DISP_GROUP  */
+    DISP_HSIZE = 296,              /* DISP_HSIZE  */
+    DISP_MTIME = 297,              /* DISP_MTIME  */
+    MMRK_COLOR = 298,              /* MMRK_COLOR  */
+    LOCALE = 299,                  /* LOCALE  */
+    FILE_EXEC = 300,               /* FILE_EXEC  */
+    UZ_ADD = 301,                  /* UZ_ADD  */
+    UZ_DEL = 302,                  /* UZ_DEL  */
+    WAIT = 303,                    /* WAIT  */
+    NOBOLD = 304,                  /* NOBOLD  */
+    DOTDOT = 305,                  /* DOTDOT  */
+    SORTIC = 306,                  /* SORTIC  */
+    PRESERVE_ALL = 307,            /* PRESERVE_ALL  */
+    PRESERVE_MTIM = 308,           /* PRESERVE_MTIM  */
+    DISP_ALL = 309,                /* DISP_ALL  */
+    NO_DOTDOT = 310,               /* NO_DOTDOT  */
+    HIDDEN = 311,                  /* HIDDEN  */
+    NO_HIDDEN = 312,               /* NO_HIDDEN  */
+    NO_DISP_PERM = 313,            /* NO_DISP_PERM  */
+    NO_DISP_OWNER = 314,           /* NO_DISP_OWNER  */
+    NO_DISP_GROUP = 315,           /* NO_DISP_GROUP  */
+    NO_DISP_HSIZE = 316,           /* NO_DISP_HSIZE  */
+    NO_DISP_MTIME = 317,           /* NO_DISP_MTIME  */
+    NO_PRESERVE = 318,             /* NO_PRESERVE  */
+    FKEY_SET = 319,                /* FKEY_SET  */
+    OVERRIDE = 320,                /* OVERRIDE  */
+    DISP_DSTAT = 321,              /* DISP_DSTAT  */
+    NO_DISP_DSTAT = 322,           /* NO_DISP_DSTAT  */
+    VI_CURSOR_KEYS = 323,          /* VI_CURSOR_KEYS  */
+    THREADS = 324,                 /* THREADS  */
+    DIGEST_CACHE = 325,            /* DIGEST_CACHE  */
+    CMP_BUFFER_SIZE = 326,         /* CMP_BUFFER_SIZE  */
+    CMP_MMAP = 327,                /* CMP_MMAP  */
+    NO_QUICK_CMP = 328,            /* NO_QUICK_CMP  */
+    FAST_APPROX = 329,             /* FAST_APPROX  */
+    BG_CMP = 330,                  /* BG_CMP  */
+    COPY_METHOD = 331,             /* COPY_METHOD  */
+    SNAPSHOT = 332,                /* SNAPSHOT  */
+    WATCH = 333,                   /* WATCH  */
+    STRING = 334,                  /* STRING  */
+    INTEGER = 335                  /* INTEGER  */
+  };
+  typedef enum yytokentype yytoken_kind_t;
+#endif
+/* Token kinds.  */
+#define YYEMPTY -2
+#define YYEOF 0
+#define YYerror 256
+#define YYUNDEF 257
+#define DIFFTOOL 258
+#define FILES 259
+#define DIRS 260
+#define MIXED 261
+#define FOLLOW 262
+#define MONO 263
+#define NOEQUAL 264
+#define LEFT_COLOR 265
+#define RIGHT_COLOR 266
+#define DIFF_COLOR 267
+#define DIR_COLOR 268
+#define UNKNOWN_COLOR 269
+#define LINK_COLOR 270
+#define REAL_DIFF 271
+#define RECURSIVE 272
+#define VIEWTOOL 273
+#define EXT 274
+#define BG 275
+#define FKEY 276
+#define HISTSIZE 277
+#define SKIPEXT 278
+#define NOIC 279
+#define MAGIC 280
+#define NOWS 281
+#define SCALE 282
+#define SHELL 283
+#define SH 284
+#define NORMAL_COLOR 285
+#define CURSOR_COLOR 286
+#define ERROR_COLOR 287
+#define MARK_COLOR 288
+#define BG_COLOR 289
+#define ALIAS 290
+#define TWOCOLUMN 291
+#define READONLY 292
+#define DISP_PERM 293
+#define DISP_OWNER 294
+#define DISP_GROUP 295
+#define DISP_HSIZE 296
+#define DISP_MTIME 297
+#define MMRK_COLOR 298
+#define LOCALE 299
+#define FILE_EXEC 300
+#define UZ_ADD 301
+#define UZ_DEL 302
+#define WAIT 303
+#define NOBOLD 304
+#define DOTDOT 305
+#define SORTIC 306
+#define PRESERVE_ALL 307
+#define PRESERVE_MTIM 308
+#define DISP_ALL 309
+#define NO_DOTDOT 310
+#define HIDDEN 311
+#define NO_HIDDEN 312
+#define NO_DISP_PERM 313
+#define NO_DISP_OWNER 314
+#define NO_DISP_GROUP 315
+#define NO_DISP_HSIZE 316
+#define NO_DISP_MTIME 317
+#define NO_PRESERVE 318
+#define FKEY_SET 319
+#define OVERRIDE 320
+#define DISP_DSTAT 321
+#define NO_DISP_DSTAT 322
+#define VI_CURSOR_KEYS 323
+#define THREADS 324
+#define DIGEST_CACHE 325
+#define CMP_BUFFER_SIZE 326
+#define CMP_MMAP 327
+#define NO_QUICK_CMP 328
+#define FAST_APPROX 329
+#define BG_CMP 330
+#define COPY_METHOD 331
+#define SNAPSHOT 332
+#define WATCH 333
+#define STRING 334
+#define INTEGER 335
+
+/* Value type.  */
+#if ! defined YYSTYPE && ! defined YYSTYPE_IS_DECLARED
+union YYSTYPE
+{
+#line 49 "pars.y"
+
+	char *str;
+	int  integer;
+
+#line 232 "y.tab.h"
+
+};
+typedef union YYSTYPE YYSTYPE;
+# define YYSTYPE_IS_TRIVIAL 1
+# define YYSTYPE_IS_DECLARED 1
+#endif
+
+
+extern YYSTYPE yylval;
+
+
+int yyparse (void);
+
+
+#endif /* !YY_YY_Y_TAB_H_INCLUDED  */